@@ -3,7 +3,9 @@
 #include <string.h>
 #include <stdio.h>
 #include "devices/ide.h"
+#include "threads/interrupt.h"
 #include "threads/malloc.h"
+#include "threads/thread.h"
 
 /* A block device. */
 struct block
@@ -17,8 +19,15 @@ struct block
     const struct block_operations *ops;  /* Driver operations. */
     void *aux;                          /* Extra data owned by driver. */
 
-    unsigned long long read_cnt;        /* Number of sectors read. */
-    unsigned long long write_cnt;       /* Number of sectors written. */
+    /* Statistics.  Protected by disabling interrupts, because
+       drivers may complete requests in interrupt handlers. */
+    struct blkstat stats;
+
+    /* Request queue, for drivers without a submit operation. */
+    struct lock queue_lock;             /* Protects the members below. */
+    struct condition queue_nonempty;    /* Signaled when queue grows. */
+    struct list queue;                  /* Pending requests by sector. */
+    block_sector_t head;                /* Sector after last dispatched. */
   };
 
 /* List of all block devices. */
@@ -28,6 +37,16 @@ static struct list all_blocks = LIST_INITIALIZER (all_blocks);
 static struct block *block_by_role[BLOCK_ROLE_CNT];
 
 static struct block *list_elem_to_block (struct list_elem *);
+static void block_dispatch (void *block_);
+
+/* Returns the CPU's time-stamp counter, which counts cycles. */
+static inline uint64_t
+rdtsc (void)
+{
+  uint64_t tsc;
+  asm volatile ("rdtsc" : "=A" (tsc));
+  return tsc;
+}
 
 /* Returns a human-readable name for the given block device
    TYPE. */
@@ -120,9 +139,7 @@ check_sector (struct block *block, block_sector_t sector)
 void
 block_read (struct block *block, block_sector_t sector, void *buffer)
 {
-  check_sector (block, sector);
-  block->ops->read (block->aux, sector, buffer);
-  block->read_cnt++;
+  block_read_multiple (block, sector, 1, buffer);
 }
 
 /* Write sector SECTOR to BLOCK from BUFFER, which must contain
@@ -133,10 +150,283 @@ block_read (struct block *block, block_sector_t sector, void *buffer)
 void
 block_write (struct block *block, block_sector_t sector, const void *buffer)
 {
-  check_sector (block, sector);
-  ASSERT (block->type != BLOCK_FOREIGN);
-  block->ops->write (block->aux, sector, buffer);
-  block->write_cnt++;
+  block_write_multiple (block, sector, 1, buffer);
+}
+
+/* Reads CNT consecutive sectors starting at SECTOR from BLOCK
+   into BUFFER, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes.  Uses a single driver request if the driver supports
+   multi-sector transfers. */
+void
+block_read_multiple (struct block *block, block_sector_t sector,
+                     size_t cnt, void *buffer)
+{
+  struct block_request req;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&req, false, sector, cnt, buffer, NULL, NULL);
+  block_submit (block, &req);
+  block_wait (&req);
+}
+
+/* Writes CNT consecutive sectors starting at SECTOR to BLOCK from
+   BUFFER, which must contain CNT * BLOCK_SECTOR_SIZE bytes.
+   Returns after the block device has acknowledged receiving all
+   of the data.  Uses a single driver request if the driver
+   supports multi-sector transfers. */
+void
+block_write_multiple (struct block *block, block_sector_t sector,
+                      size_t cnt, const void *buffer)
+{
+  struct block_request req;
+
+  if (cnt == 0)
+    return;
+  block_request_init (&req, true, sector, cnt, (void *) buffer, NULL, NULL);
+  block_submit (block, &req);
+  block_wait (&req);
+}
+
+/* Initializes REQ as a request to read (or, if WRITE is true, to
+   write) CNT sectors starting at SECTOR to or from BUFFER.  When
+   the request finishes, COMPLETE is called with REQ and AUX if it
+   is non-null, in which case REQ may be freed by COMPLETE;
+   otherwise, the submitter must wait for it with block_wait(). */
+void
+block_request_init (struct block_request *req, bool write,
+                    block_sector_t sector, size_t cnt, void *buffer,
+                    block_request_func *complete, void *aux)
+{
+  ASSERT (cnt > 0);
+  req->write = write;
+  req->sector = sector;
+  req->cnt = cnt;
+  req->buffer = buffer;
+  req->complete = complete;
+  req->aux = aux;
+  sema_init (&req->done, 0);
+  req->start = 0;
+  req->origin = req->device = NULL;
+}
+
+/* Queues REQ on BLOCK and returns without waiting for it.
+   Pending requests are dispatched in C-LOOK order: ascending by
+   sector from the current head position, then wrapping around to
+   the lowest pending sector.  Requests for adjacent sectors and
+   buffers in the same direction are merged into one transfer. */
+void
+block_submit (struct block *block, struct block_request *req)
+{
+  struct blkstat *st = &block->stats;
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  check_sector (block, req->sector);
+  check_sector (block, req->sector + req->cnt - 1);
+  ASSERT (!req->write || block->type != BLOCK_FOREIGN);
+
+  /* A request passed through, as from a partition to its disk,
+     keeps its start time and counts toward both devices. */
+  old_level = intr_disable ();
+  if (req->origin == NULL)
+    {
+      req->origin = block;
+      req->start = rdtsc ();
+    }
+  req->device = block;
+  if (req->write)
+    {
+      st->write_reqs++;
+      st->write_bytes += (uint64_t) req->cnt * BLOCK_SECTOR_SIZE;
+    }
+  else
+    {
+      st->read_reqs++;
+      st->read_bytes += (uint64_t) req->cnt * BLOCK_SECTOR_SIZE;
+    }
+  if (++st->in_flight > st->max_in_flight)
+    st->max_in_flight = st->in_flight;
+  intr_set_level (old_level);
+
+  if (block->ops->submit != NULL)
+    {
+      block->ops->submit (block->aux, req);
+      return;
+    }
+
+  lock_acquire (&block->queue_lock);
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector > req->sector)
+      break;
+  list_insert (e, &req->elem);
+  cond_signal (&block->queue_nonempty, &block->queue_lock);
+  lock_release (&block->queue_lock);
+}
+
+/* Waits for REQ to complete. */
+void
+block_wait (struct block_request *req)
+{
+  sema_down (&req->done);
+}
+
+/* Records in BLOCK's statistics that REQ finished after CYCLES
+   cycles.  Interrupts must be off. */
+static void
+account_done (struct block *block, const struct block_request *req,
+              uint64_t cycles)
+{
+  uint64_t *hist = req->write ? block->stats.write_hist
+                              : block->stats.read_hist;
+  int bucket = 0;
+
+  ASSERT (intr_get_level () == INTR_OFF);
+  while ((cycles >>= 1) != 0 && bucket < BLKSTAT_BUCKETS - 1)
+    bucket++;
+  hist[bucket]++;
+  block->stats.in_flight--;
+}
+
+/* Marks REQ complete by calling its completion function or, if
+   it has none, waking up its waiter.  Called by the block layer,
+   or by drivers with a submit operation.  May be called from an
+   interrupt handler. */
+void
+block_request_done (struct block_request *req)
+{
+  if (req->origin != NULL)
+    {
+      uint64_t cycles = rdtsc () - req->start;
+      enum intr_level old_level = intr_disable ();
+      account_done (req->origin, req, cycles);
+      if (req->device != req->origin)
+        account_done (req->device, req, cycles);
+      intr_set_level (old_level);
+    }
+
+  if (req->complete != NULL)
+    req->complete (req, req->aux);
+  else
+    sema_up (&req->done);
+}
+
+/* Removes and returns the next request to dispatch from BLOCK's
+   queue, which must not be empty, in C-LOOK order. */
+static struct block_request *
+queue_pop (struct block *block)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+  ASSERT (!list_empty (&block->queue));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    if (list_entry (e, struct block_request, elem)->sector >= block->head)
+      break;
+  if (e == list_end (&block->queue))
+    e = list_begin (&block->queue);
+  list_remove (e);
+  return list_entry (e, struct block_request, elem);
+}
+
+/* Returns true if request B continues request A: same direction,
+   next sector and next buffer byte. */
+static bool
+request_continues (const struct block_request *a,
+                   const struct block_request *b)
+{
+  return (a->write == b->write
+          && a->sector + a->cnt == b->sector
+          && (uint8_t *) a->buffer + a->cnt * BLOCK_SECTOR_SIZE
+             == (uint8_t *) b->buffer);
+}
+
+/* Returns a queued request on BLOCK that continues LAST, or a
+   null pointer if there is none. */
+static struct block_request *
+queue_find_continuation (struct block *block, struct block_request *last)
+{
+  struct list_elem *e;
+
+  ASSERT (lock_held_by_current_thread (&block->queue_lock));
+
+  for (e = list_begin (&block->queue); e != list_end (&block->queue);
+       e = list_next (e))
+    {
+      struct block_request *r = list_entry (e, struct block_request, elem);
+      if (r->sector > last->sector + last->cnt)
+        break;
+      if (request_continues (last, r))
+        return r;
+    }
+  return NULL;
+}
+
+/* Transfers CNT sectors starting at SECTOR between BLOCK's driver
+   and BUFFER, in one driver call if the driver allows it. */
+static void
+block_transfer (struct block *block, bool write, block_sector_t sector,
+                size_t cnt, uint8_t *buffer)
+{
+  const struct block_operations *ops = block->ops;
+  size_t i;
+
+  if (write && ops->write_multiple != NULL)
+    ops->write_multiple (block->aux, sector, cnt, buffer);
+  else if (!write && ops->read_multiple != NULL)
+    ops->read_multiple (block->aux, sector, cnt, buffer);
+  else
+    for (i = 0; i < cnt; i++)
+      if (write)
+        ops->write (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+      else
+        ops->read (block->aux, sector + i, buffer + i * BLOCK_SECTOR_SIZE);
+}
+
+/* Dispatcher thread for BLOCK_, a block device without a submit
+   operation.  Takes requests off the queue one at a time, merges
+   requests that continue it, and passes each batch to the
+   driver. */
+static void
+block_dispatch (void *block_)
+{
+  struct block *block = block_;
+
+  for (;;)
+    {
+      struct list batch;
+      struct block_request *first, *last, *next;
+      size_t cnt;
+
+      /* Take the next request and any requests that continue it. */
+      list_init (&batch);
+      lock_acquire (&block->queue_lock);
+      while (list_empty (&block->queue))
+        cond_wait (&block->queue_nonempty, &block->queue_lock);
+      first = last = queue_pop (block);
+      list_push_back (&batch, &first->elem);
+      cnt = first->cnt;
+      while ((next = queue_find_continuation (block, last)) != NULL)
+        {
+          list_remove (&next->elem);
+          list_push_back (&batch, &next->elem);
+          cnt += next->cnt;
+          block->stats.merge_cnt++;
+          last = next;
+        }
+      block->head = last->sector + last->cnt;
+      lock_release (&block->queue_lock);
+
+      /* Do the transfer and complete the batch. */
+      block_transfer (block, first->write, first->sector, cnt,
+                      first->buffer);
+      while (!list_empty (&batch))
+        block_request_done (list_entry (list_pop_front (&batch),
+                                        struct block_request, elem));
+    }
 }
 
 /* Returns the number of sectors in BLOCK. */
@@ -160,6 +450,20 @@ block_type (struct block *block)
   return block->type;
 }
 
+/* Prints the nonempty buckets of latency histogram HIST, with
+   the given LABEL. */
+static void
+print_histogram (const char *label, const uint64_t hist[BLKSTAT_BUCKETS])
+{
+  int i;
+
+  printf ("  %s cycles:", label);
+  for (i = 0; i < BLKSTAT_BUCKETS; i++)
+    if (hist[i] != 0)
+      printf (" 2^%d:%llu", i, hist[i]);
+  printf ("\n");
+}
+
 /* Prints statistics for each block device used for a Pintos role. */
 void
 block_print_stats (void)
@@ -171,13 +475,34 @@ block_print_stats (void)
       struct block *block = block_by_role[i];
       if (block != NULL)
         {
-          printf ("%s (%s): %llu reads, %llu writes\n",
+          struct blkstat st;
+
+          block_get_stats (block, &st);
+          printf ("%s (%s): %llu reads, %llu writes, %llu merges\n",
                   block->name, block_type_name (block->type),
-                  block->read_cnt, block->write_cnt);
+                  st.read_bytes / BLOCK_SECTOR_SIZE,
+                  st.write_bytes / BLOCK_SECTOR_SIZE, st.merge_cnt);
+          if (st.read_reqs + st.write_reqs == 0)
+            continue;
+          printf ("  %llu read requests, %llu write requests, "
+                  "%"PRIu32" in flight (peak %"PRIu32")\n",
+                  st.read_reqs, st.write_reqs,
+                  st.in_flight, st.max_in_flight);
+          print_histogram ("read", st.read_hist);
+          print_histogram ("write", st.write_hist);
         }
     }
 }
 
+/* Copies a snapshot of BLOCK's I/O statistics into *ST. */
+void
+block_get_stats (struct block *block, struct blkstat *st)
+{
+  enum intr_level old_level = intr_disable ();
+  *st = block->stats;
+  intr_set_level (old_level);
+}
+
 /* Registers a new block device with the given NAME.  If
    EXTRA_INFO is non-null, it is printed as part of a user
    message.  The block device's SIZE in sectors and its TYPE must
@@ -198,8 +523,11 @@ block_register (const char *name, enum block_type type,
   block->size = size;
   block->ops = ops;
   block->aux = aux;
-  block->read_cnt = 0;
-  block->write_cnt = 0;
+  memset (&block->stats, 0, sizeof block->stats);
+  lock_init (&block->queue_lock);
+  cond_init (&block->queue_nonempty);
+  list_init (&block->queue);
+  block->head = 0;
 
   printf ("%s: %'"PRDSNu" sectors (", block->name, block->size);
   print_human_readable_size ((uint64_t) block->size * BLOCK_SECTOR_SIZE);
@@ -208,6 +536,14 @@ block_register (const char *name, enum block_type type,
     printf (", %s", extra_info);
   printf ("\n");
 
+  /* Start a dispatcher for drivers that need queuing. */
+  if (ops->submit == NULL)
+    {
+      char thread_name[16];
+      snprintf (thread_name, sizeof thread_name, "io-%.12s", block->name);
+      thread_create (thread_name, PRI_MAX, block_dispatch, block);
+    }
+
   return block;
 }
 
@@ -2,7 +2,11 @@
 #define DEVICES_BLOCK_H
 
 #include <stddef.h>
+#include <stdbool.h>
 #include <inttypes.h>
+#include <list.h>
+#include <blkstat.h>
+#include "threads/synch.h"
 
 /* Size of a block device sector in bytes.
    All IDE disks use this sector size, as do most USB and SCSI
@@ -53,11 +57,54 @@ struct block *block_next (struct block *);
 block_sector_t block_size (struct block *);
 void block_read (struct block *, block_sector_t, void *);
 void block_write (struct block *, block_sector_t, const void *);
+void block_read_multiple (struct block *, block_sector_t, size_t cnt,
+                          void *);
+void block_write_multiple (struct block *, block_sector_t, size_t cnt,
+                           const void *);
 const char *block_name (struct block *);
 enum block_type block_type (struct block *);
 
+/* Asynchronous requests. */
+
+struct block_request;
+
+/* Called when a request finishes.  Runs in the block device's
+   dispatcher thread, or in an interrupt handler for drivers that
+   complete requests from interrupts, so it must not sleep. */
+typedef void block_request_func (struct block_request *, void *aux);
+
+/* A request to transfer CNT consecutive sectors between a block
+   device and BUFFER.  Owned by the submitter, which must keep it
+   (and BUFFER) alive until the request completes.  Drivers that
+   pass requests on to another device, such as partitions, may
+   rewrite SECTOR on the way. */
+struct block_request
+  {
+    struct list_elem elem;              /* Element in a request queue. */
+    bool write;                         /* True to write, false to read. */
+    block_sector_t sector;              /* First sector. */
+    size_t cnt;                         /* Number of sectors. */
+    void *buffer;                       /* CNT * BLOCK_SECTOR_SIZE bytes. */
+    block_request_func *complete;       /* Completion callback, or null. */
+    void *aux;                          /* Passed to COMPLETE. */
+    struct semaphore done;              /* Up'd on completion if
+                                           COMPLETE is null. */
+
+    /* Accounting, owned by the block layer. */
+    uint64_t start;                     /* Time-stamp counter at submit. */
+    struct block *origin;               /* Device first submitted to. */
+    struct block *device;               /* Device last submitted to. */
+  };
+
+void block_request_init (struct block_request *, bool write,
+                         block_sector_t, size_t cnt, void *buffer,
+                         block_request_func *, void *aux);
+void block_submit (struct block *, struct block_request *);
+void block_wait (struct block_request *);
+
 /* Statistics. */
 void block_print_stats (void);
+void block_get_stats (struct block *, struct blkstat *);
 
 /* Lower-level interface to block device drivers. */
 
@@ -65,10 +112,27 @@ struct block_operations
   {
     void (*read) (void *aux, block_sector_t, void *buffer);
     void (*write) (void *aux, block_sector_t, const void *buffer);
+
+    /* Optional.  Transfer CNT consecutive sectors in one request.
+       If null, the block layer issues CNT single-sector
+       requests instead. */
+    void (*read_multiple) (void *aux, block_sector_t, size_t cnt,
+                           void *buffer);
+    void (*write_multiple) (void *aux, block_sector_t, size_t cnt,
+                            const void *buffer);
+
+    /* Optional.  Accepts a request without waiting for it and
+       calls block_request_done() once it finishes.  Drivers that
+       supply this bypass the block layer's request queue.  If
+       null, requests are sorted in the device's queue and passed
+       one at a time to the functions above by a dispatcher
+       thread. */
+    void (*submit) (void *aux, struct block_request *);
   };
 
 struct block *block_register (const char *name, enum block_type,
                               const char *extra_info, block_sector_t size,
                               const struct block_operations *, void *aux);
+void block_request_done (struct block_request *);
 
 #endif /* devices/block.h */
@@ -5,13 +5,19 @@
 #include <stdio.h>
 #include "devices/block.h"
 #include "devices/partition.h"
+#include "devices/pci.h"
 #include "devices/timer.h"
 #include "threads/io.h"
 #include "threads/interrupt.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
 /* The code in this file is an interface to an ATA (IDE)
-   controller.  It attempts to comply to [ATA-3]. */
+   controller.  It attempts to comply to [ATA-3].  If a PCI
+   bus-master IDE controller is present, transfers use DMA as
+   described in the PCI IDE bus master specification; otherwise
+   they fall back to PIO. */
 
 /* ATA command block port addresses. */
 #define reg_data(CHANNEL) ((CHANNEL)->reg_base + 0)     /* Data. */
@@ -30,10 +36,25 @@
 #define reg_ctl(CHANNEL) ((CHANNEL)->reg_base + 0x206)  /* Control (w/o). */
 #define reg_alt_status(CHANNEL) reg_ctl (CHANNEL)       /* Alt Status (r/o). */
 
+/* Bus master IDE port addresses, relative to the channel's part
+   of the controller's BAR4 I/O range. */
+#define bm_command(CHANNEL) ((CHANNEL)->bm_base + 0)    /* Command. */
+#define bm_status(CHANNEL) ((CHANNEL)->bm_base + 2)     /* Status. */
+#define bm_prdt(CHANNEL) ((CHANNEL)->bm_base + 4)       /* PRD table addr. */
+
+/* Bus master Command Register bits. */
+#define BM_CMD_START 0x01       /* Start/stop bus master. */
+#define BM_CMD_READ 0x08        /* Transfer from disk to memory. */
+
+/* Bus master Status Register bits. */
+#define BM_STA_ERR 0x02         /* Error (write 1 to clear). */
+#define BM_STA_INTR 0x04        /* Interrupt (write 1 to clear). */
+
 /* Alternate Status Register bits. */
 #define STA_BSY 0x80            /* Busy. */
 #define STA_DRDY 0x40           /* Device Ready. */
 #define STA_DRQ 0x08            /* Data Request. */
+#define STA_ERR 0x01            /* Error. */
 
 /* Control Register bits. */
 #define CTL_SRST 0x04           /* Software Reset. */
@@ -49,6 +70,14 @@
 #define CMD_IDENTIFY_DEVICE 0xec        /* IDENTIFY DEVICE. */
 #define CMD_READ_SECTOR_RETRY 0x20      /* READ SECTOR with retries. */
 #define CMD_WRITE_SECTOR_RETRY 0x30     /* WRITE SECTOR with retries. */
+#define CMD_READ_MULTIPLE 0xc4          /* READ MULTIPLE. */
+#define CMD_WRITE_MULTIPLE 0xc5         /* WRITE MULTIPLE. */
+#define CMD_SET_MULTIPLE_MODE 0xc6      /* SET MULTIPLE MODE. */
+#define CMD_READ_DMA 0xc8               /* READ DMA. */
+#define CMD_WRITE_DMA 0xca              /* WRITE DMA. */
+
+/* Maximum number of sectors transferred by a single command. */
+#define MAX_COMMAND_SECTORS 256
 
 /* An ATA device. */
 struct ata_disk
@@ -57,8 +86,23 @@ struct ata_disk
     struct channel *channel;    /* Channel that disk is attached to. */
     int dev_no;                 /* Device 0 or 1 for master or slave. */
     bool is_ata;                /* Is device an ATA disk? */
+    int multiple_cnt;           /* Sectors per DRQ block for READ/WRITE
+                                   MULTIPLE, or 0 if not enabled. */
+    bool dma;                   /* Transfer with bus-master DMA? */
+  };
+
+/* A physical region descriptor, one entry in the table that tells
+   the bus master where to transfer data.  A region must not cross
+   a 64 kB boundary. */
+struct prd
+  {
+    uint32_t addr;              /* Physical base address. */
+    uint16_t size;              /* Byte count, with 0 meaning 64 kB. */
+    uint16_t flags;             /* PRD_EOT in the last entry. */
   };
 
+#define PRD_EOT 0x8000          /* End of table. */
+
 /* An ATA channel (aka controller).
    Each channel can control up to two disks. */
 struct channel
@@ -72,6 +116,9 @@ struct channel
                                    any interrupt would be spurious. */
     struct semaphore completion_wait;   /* Up'd by interrupt handler. */
 
+    uint16_t bm_base;           /* Bus master base port, or 0 if none. */
+    struct prd *prdt;           /* Page holding the PRD table. */
+
     struct ata_disk devices[2];     /* The devices on this channel. */
   };
 
@@ -84,11 +131,14 @@ static struct block_operations ide_operations;
 static void reset_channel (struct channel *);
 static bool check_device_type (struct ata_disk *);
 static void identify_ata_device (struct ata_disk *);
+static void set_multiple_mode (struct ata_disk *, int multiple_cnt);
+static uint16_t find_bus_master (void);
 
-static void select_sector (struct ata_disk *, block_sector_t);
+static void select_sector (struct ata_disk *, block_sector_t, size_t cnt);
 static void issue_pio_command (struct channel *, uint8_t command);
-static void input_sector (struct channel *, void *);
-static void output_sector (struct channel *, const void *);
+static void input_sectors (struct channel *, void *, size_t cnt);
+static void output_sectors (struct channel *, const void *, size_t cnt);
+static void build_prdt (struct channel *, const void *, size_t size);
 
 static void wait_until_idle (const struct ata_disk *);
 static bool wait_while_busy (const struct ata_disk *);
@@ -101,6 +151,7 @@ static void interrupt_handler (struct intr_frame *);
 void
 ide_init (void) 
 {
+  uint16_t bm_base = find_bus_master ();
   size_t chan_no;
 
   for (chan_no = 0; chan_no < CHANNEL_CNT; chan_no++)
@@ -126,6 +177,14 @@ ide_init (void)
       lock_init (&c->lock);
       c->expecting_interrupt = false;
       sema_init (&c->completion_wait, 0);
+      c->bm_base = 0;
+      c->prdt = NULL;
+      if (bm_base != 0)
+        {
+          /* Each channel has 8 bus master ports. */
+          c->bm_base = bm_base + chan_no * 8;
+          c->prdt = palloc_get_page (PAL_ASSERT);
+        }
  
       /* Initialize devices. */
       for (dev_no = 0; dev_no < 2; dev_no++)
@@ -136,6 +195,8 @@ ide_init (void)
           d->channel = c;
           d->dev_no = dev_no;
           d->is_ata = false;
+          d->multiple_cnt = 0;
+          d->dma = false;
         }
 
       /* Register interrupt handler. */
@@ -159,6 +220,32 @@ ide_init (void)
 
 static char *descramble_ata_string (char *, int size);
 
+/* Looks for a PCI bus-master IDE controller and enables bus
+   mastering on it.  Returns the base I/O port of its bus master
+   registers, or 0 if there is no such controller, in which case
+   all transfers use PIO. */
+static uint16_t
+find_bus_master (void)
+{
+  struct pci_address pci;
+  uint32_t class, bar4;
+
+  if (!pci_find_class (PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0, &pci))
+    return 0;
+
+  /* Bit 7 of the programming interface says whether the
+     controller can be a bus master, and BAR4 must be an I/O
+     range for us to program it. */
+  class = pci_read_config (&pci, PCI_REG_CLASS);
+  bar4 = pci_read_config (&pci, PCI_REG_BAR (4));
+  if (!(class & 0x8000) || !(bar4 & PCI_BAR_IO)
+      || (bar4 & PCI_BAR_IO_MASK) == 0)
+    return 0;
+
+  pci_enable (&pci, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+  return bar4 & PCI_BAR_IO_MASK;
+}
+
 /* Resets an ATA channel and waits for any devices present on it
    to finish the reset. */
 static void
@@ -262,6 +349,8 @@ identify_ata_device (struct ata_disk *d)
   struct channel *c = d->channel;
   char id[BLOCK_SECTOR_SIZE];
   block_sector_t capacity;
+  int max_multiple;
+  bool dma_capable;
   char *model, *serial;
   char extra_info[128];
   struct block *block;
@@ -279,15 +368,20 @@ identify_ata_device (struct ata_disk *d)
       d->is_ata = false;
       return;
     }
-  input_sector (c, id);
+  input_sectors (c, id, 1);
 
-  /* Calculate capacity.
+  /* Calculate capacity and the largest DRQ block size usable with
+     READ/WRITE MULTIPLE.
      Read model name and serial number. */
   capacity = *(uint32_t *) &id[60 * 2];
+  max_multiple = *(uint16_t *) &id[47 * 2] & 0xff;
+  dma_capable = (*(uint16_t *) &id[49 * 2] & 0x0100) != 0;
   model = descramble_ata_string (&id[10 * 2], 20);
   serial = descramble_ata_string (&id[27 * 2], 40);
+  d->dma = dma_capable && c->bm_base != 0;
   snprintf (extra_info, sizeof extra_info,
-            "model \"%s\", serial \"%s\"", model, serial);
+            "model \"%s\", serial \"%s\"%s", model, serial,
+            d->dma ? ", DMA" : "");
 
   /* Disable access to IDE disks over 1 GB, which are likely
      physical IDE disks rather than virtual ones.  If we don't
@@ -303,12 +397,36 @@ identify_ata_device (struct ata_disk *d)
       return;
     }
 
+  /* Transfer as many sectors per interrupt as the disk allows. */
+  if (max_multiple > 0)
+    set_multiple_mode (d, max_multiple);
+
   /* Register. */
   block = block_register (d->name, BLOCK_RAW, extra_info, capacity,
                           &ide_operations, d);
   partition_scan (block);
 }
 
+/* Sends a SET MULTIPLE MODE command to disk D so that READ
+   MULTIPLE and WRITE MULTIPLE transfer MULTIPLE_CNT sectors per
+   interrupt.  Leaves D using single-sector DRQ blocks if the disk
+   rejects the command. */
+static void
+set_multiple_mode (struct ata_disk *d, int multiple_cnt)
+{
+  struct channel *c = d->channel;
+
+  select_device_wait (d);
+  outb (reg_nsect (c), multiple_cnt);
+  issue_pio_command (c, CMD_SET_MULTIPLE_MODE);
+  sema_down (&c->completion_wait);
+  wait_while_busy (d);
+  if (inb (reg_status (c)) & STA_ERR)
+    printf ("%s: SET MULTIPLE MODE %d failed\n", d->name, multiple_cnt);
+  else
+    d->multiple_cnt = multiple_cnt;
+}
+
 /* Translates STRING, which consists of SIZE bytes in a funky
    format, into a null-terminated string in-place.  Drops
    trailing whitespace and null bytes.  Returns STRING.  */
@@ -337,25 +455,127 @@ descramble_ata_string (char *string, int size)
   return string;
 }
 
-/* Reads sector SEC_NO from disk D into BUFFER, which must have
-   room for BLOCK_SECTOR_SIZE bytes.
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER with bus-master DMA, reading if WRITE is false and
+   writing otherwise.  Issues one command per MAX_COMMAND_SECTORS
+   sectors and sleeps until the controller interrupts, so other
+   threads run while the data moves.
+   The caller must hold D's channel lock. */
+static void
+dma_transfer (struct ata_disk *d, bool write, block_sector_t sec_no,
+              size_t cnt, void *buffer_)
+{
+  struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  uint8_t direction = write ? 0 : BM_CMD_READ;
+
+  while (cnt > 0)
+    {
+      size_t cmd_cnt = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+      uint8_t bm_sta;
+
+      build_prdt (c, buffer, cmd_cnt * BLOCK_SECTOR_SIZE);
+      outl (bm_prdt (c), vtop (c->prdt));
+      outb (bm_command (c), direction);
+      outb (bm_status (c), inb (bm_status (c)) | BM_STA_ERR | BM_STA_INTR);
+
+      select_sector (d, sec_no, cmd_cnt);
+      issue_pio_command (c, write ? CMD_WRITE_DMA : CMD_READ_DMA);
+      outb (bm_command (c), direction | BM_CMD_START);
+      sema_down (&c->completion_wait);
+
+      outb (bm_command (c), direction);
+      bm_sta = inb (bm_status (c));
+      outb (bm_status (c), bm_sta | BM_STA_ERR | BM_STA_INTR);
+      if ((bm_sta & BM_STA_ERR) || (inb (reg_status (c)) & STA_ERR))
+        PANIC ("%s: DMA %s failed, sector=%"PRDSNu, d->name,
+               write ? "write" : "read", sec_no);
+
+      buffer += cmd_cnt * BLOCK_SECTOR_SIZE;
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
+}
+
+/* Transfers CNT sectors starting at SEC_NO between disk D and
+   BUFFER, reading if WRITE is false and writing otherwise.
+   Uses DMA when D supports it and BUFFER is word-aligned, as the
+   bus master requires.  Otherwise, uses PIO, with one command per
+   MAX_COMMAND_SECTORS sectors.  Each PIO command moves data in
+   DRQ blocks of D's multiple count, or of one sector if
+   READ/WRITE MULTIPLE is not enabled, with one interrupt per
+   block.
    Internally synchronizes accesses to disks, so external
    per-disk locking is unneeded. */
 static void
-ide_read (void *d_, block_sector_t sec_no, void *buffer)
+ide_transfer (struct ata_disk *d, bool write, block_sector_t sec_no,
+              size_t cnt, void *buffer_)
 {
-  struct ata_disk *d = d_;
   struct channel *c = d->channel;
+  uint8_t *buffer = buffer_;
+  size_t drq_cnt = d->multiple_cnt > 0 ? (size_t) d->multiple_cnt : 1;
+  uint8_t command;
+
+  if (d->multiple_cnt > 0)
+    command = write ? CMD_WRITE_MULTIPLE : CMD_READ_MULTIPLE;
+  else
+    command = write ? CMD_WRITE_SECTOR_RETRY : CMD_READ_SECTOR_RETRY;
+
   lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_READ_SECTOR_RETRY);
-  sema_down (&c->completion_wait);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk read failed, sector=%"PRDSNu, d->name, sec_no);
-  input_sector (c, buffer);
+  if (d->dma && (uintptr_t) buffer % 2 == 0)
+    {
+      dma_transfer (d, write, sec_no, cnt, buffer);
+      cnt = 0;
+    }
+  while (cnt > 0)
+    {
+      size_t cmd_cnt = cnt < MAX_COMMAND_SECTORS ? cnt : MAX_COMMAND_SECTORS;
+      size_t done;
+
+      select_sector (d, sec_no, cmd_cnt);
+      issue_pio_command (c, command);
+      for (done = 0; done < cmd_cnt; )
+        {
+          size_t block_cnt = cmd_cnt - done < drq_cnt ? cmd_cnt - done : drq_cnt;
+
+          /* A read interrupts when each block is ready.  A write
+             wants its first block right away and interrupts when
+             it is ready for each later one. */
+          if (!write || done > 0)
+            sema_down (&c->completion_wait);
+          if (!wait_while_busy (d))
+            PANIC ("%s: disk %s failed, sector=%"PRDSNu, d->name,
+                   write ? "write" : "read", sec_no + done);
+          if (write)
+            output_sectors (c, buffer, block_cnt);
+          else
+            input_sectors (c, buffer, block_cnt);
+
+          buffer += block_cnt * BLOCK_SECTOR_SIZE;
+          done += block_cnt;
+        }
+
+      /* A write interrupts once more when the disk has the last
+         block. */
+      if (write)
+        sema_down (&c->completion_wait);
+
+      sec_no += cmd_cnt;
+      cnt -= cmd_cnt;
+    }
   lock_release (&c->lock);
 }
 
+/* Reads sector SEC_NO from disk D into BUFFER, which must have
+   room for BLOCK_SECTOR_SIZE bytes.
+   Internally synchronizes accesses to disks, so external
+   per-disk locking is unneeded. */
+static void
+ide_read (void *d_, block_sector_t sec_no, void *buffer)
+{
+  ide_transfer (d_, false, sec_no, 1, buffer);
+}
+
 /* Write sector SEC_NO to disk D from BUFFER, which must contain
    BLOCK_SECTOR_SIZE bytes.  Returns after the disk has
    acknowledged receiving the data.
@@ -364,36 +584,51 @@ ide_read (void *d_, block_sector_t sec_no, void *buffer)
 static void
 ide_write (void *d_, block_sector_t sec_no, const void *buffer)
 {
-  struct ata_disk *d = d_;
-  struct channel *c = d->channel;
-  lock_acquire (&c->lock);
-  select_sector (d, sec_no);
-  issue_pio_command (c, CMD_WRITE_SECTOR_RETRY);
-  if (!wait_while_busy (d))
-    PANIC ("%s: disk write failed, sector=%"PRDSNu, d->name, sec_no);
-  output_sector (c, buffer);
-  sema_down (&c->completion_wait);
-  lock_release (&c->lock);
+  ide_transfer (d_, true, sec_no, 1, (void *) buffer);
+}
+
+/* Reads CNT sectors starting at SEC_NO from disk D into BUFFER,
+   which must have room for CNT * BLOCK_SECTOR_SIZE bytes. */
+static void
+ide_read_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                   void *buffer)
+{
+  ide_transfer (d_, false, sec_no, cnt, buffer);
+}
+
+/* Writes CNT sectors starting at SEC_NO to disk D from BUFFER,
+   which must contain CNT * BLOCK_SECTOR_SIZE bytes.  Returns
+   after the disk has acknowledged receiving the data. */
+static void
+ide_write_multiple (void *d_, block_sector_t sec_no, size_t cnt,
+                    const void *buffer)
+{
+  ide_transfer (d_, true, sec_no, cnt, (void *) buffer);
 }
 
 static struct block_operations ide_operations =
   {
     ide_read,
-    ide_write
+    ide_write,
+    ide_read_multiple,
+    ide_write_multiple,
+    NULL
   };
-
+
 /* Selects device D, waiting for it to become ready, and then
-   writes SEC_NO to the disk's sector selection registers.  (We
-   use LBA mode.) */
+   writes SEC_NO and the sector count CNT, which must be between 1
+   and MAX_COMMAND_SECTORS, to the disk's sector selection
+   registers.  (We use LBA mode.) */
 static void
-select_sector (struct ata_disk *d, block_sector_t sec_no)
+select_sector (struct ata_disk *d, block_sector_t sec_no, size_t cnt)
 {
   struct channel *c = d->channel;
 
   ASSERT (sec_no < (1UL << 28));
+  ASSERT (cnt >= 1 && cnt <= MAX_COMMAND_SECTORS);
   
   select_device_wait (d);
-  outb (reg_nsect (c), 1);
+  outb (reg_nsect (c), cnt == MAX_COMMAND_SECTORS ? 0 : cnt);
   outb (reg_lbal (c), sec_no);
   outb (reg_lbam (c), sec_no >> 8);
   outb (reg_lbah (c), (sec_no >> 16));
@@ -414,22 +649,54 @@ issue_pio_command (struct channel *c, uint8_t command)
   outb (reg_command (c), command);
 }
 
-/* Reads a sector from channel C's data register in PIO mode into
-   SECTOR, which must have room for BLOCK_SECTOR_SIZE bytes. */
+/* Reads CNT sectors from channel C's data register in PIO mode
+   into SECTORS, which must have room for CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-input_sector (struct channel *c, void *sector) 
+input_sectors (struct channel *c, void *sectors, size_t cnt) 
 {
-  insw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  insw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
-/* Writes SECTOR to channel C's data register in PIO mode.
-   SECTOR must contain BLOCK_SECTOR_SIZE bytes. */
+/* Writes CNT sectors from SECTORS to channel C's data register in
+   PIO mode.  SECTORS must contain CNT * BLOCK_SECTOR_SIZE
+   bytes. */
 static void
-output_sector (struct channel *c, const void *sector) 
+output_sectors (struct channel *c, const void *sectors, size_t cnt) 
 {
-  outsw (reg_data (c), sector, BLOCK_SECTOR_SIZE / 2);
+  outsw (reg_data (c), sectors, cnt * BLOCK_SECTOR_SIZE / 2);
 }
 
+/* Fills channel C's PRD table to describe the SIZE bytes of
+   kernel memory starting at BUFFER, which is also physically
+   contiguous because kernel virtual memory maps physical memory
+   linearly. */
+static void
+build_prdt (struct channel *c, const void *buffer, size_t size)
+{
+  uintptr_t paddr = vtop (buffer);
+  struct prd *prd = c->prdt;
+
+  ASSERT (size > 0 && size % 2 == 0);
+  while (size > 0)
+    {
+      /* Split at 64 kB boundaries. */
+      size_t chunk = 0x10000 - (paddr & 0xffff);
+      if (chunk > size)
+        chunk = size;
+
+      ASSERT ((void *) (prd + 1) <= (void *) c->prdt + PGSIZE);
+      prd->addr = paddr;
+      prd->size = chunk & 0xffff;
+      prd->flags = 0;
+      prd++;
+
+      paddr += chunk;
+      size -= chunk;
+    }
+  prd[-1].flags = PRD_EOT;
+}
+
 /* Low-level ATA primitives. */
 
 /* Wait up to 10 seconds for the controller to become idle, that
@@ -0,0 +1,124 @@
+#include "devices/pci.h"
+#include <debug.h>
+#include "threads/io.h"
+
+/* Minimal access to PCI configuration space through
+   configuration mechanism #1, which every PC chipset we care
+   about (and QEMU and Bochs) implements.  See [PCI] chapter 3. */
+
+/* Configuration mechanism #1 ports. */
+#define PCI_CONFIG_ADDRESS 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+/* Header type register bits. */
+#define PCI_HEADER_MULTIFUNCTION 0x80   /* Device has functions 1...7. */
+
+static bool pci_find (uint8_t reg, uint32_t mask, uint32_t value, int skip,
+                      struct pci_address *);
+
+/* Selects register REG, which must be 32-bit aligned, of the
+   function at ADDR in configuration space. */
+static void
+select_register (const struct pci_address *addr, uint8_t reg)
+{
+  ASSERT (reg % 4 == 0);
+  ASSERT (addr->slot < 32 && addr->func < 8);
+
+  outl (PCI_CONFIG_ADDRESS, (0x80000000u | ((uint32_t) addr->bus << 16)
+                             | ((uint32_t) addr->slot << 11)
+                             | ((uint32_t) addr->func << 8) | reg));
+}
+
+/* Returns the 32-bit configuration register REG of the function
+   at ADDR.  Reads 0xffffffff if no such function exists. */
+uint32_t
+pci_read_config (const struct pci_address *addr, uint8_t reg)
+{
+  select_register (addr, reg);
+  return inl (PCI_CONFIG_DATA);
+}
+
+/* Writes VALUE to the 32-bit configuration register REG of the
+   function at ADDR. */
+void
+pci_write_config (const struct pci_address *addr, uint8_t reg,
+                  uint32_t value)
+{
+  select_register (addr, reg);
+  outl (PCI_CONFIG_DATA, value);
+}
+
+/* Sets COMMAND_BITS, a combination of PCI_COMMAND_* bits, in the
+   command register of the function at ADDR. */
+void
+pci_enable (const struct pci_address *addr, uint16_t command_bits)
+{
+  /* The status register in the upper half clears bits written
+     as 1, so write zeros there. */
+  uint32_t command = pci_read_config (addr, PCI_REG_COMMAND) & 0xffff;
+  pci_write_config (addr, PCI_REG_COMMAND, command | command_bits);
+}
+
+/* Finds the function with the given VENDOR and DEVICE IDs,
+   skipping the first SKIP matches.  On success, stores its
+   location in *ADDR and returns true. */
+bool
+pci_find_device (uint16_t vendor, uint16_t device, int skip,
+                 struct pci_address *addr)
+{
+  return pci_find (PCI_REG_ID, 0xffffffff,
+                   ((uint32_t) device << 16) | vendor, skip, addr);
+}
+
+/* Finds the function with the given CLASS and SUBCLASS codes,
+   skipping the first SKIP matches.  On success, stores its
+   location in *ADDR and returns true. */
+bool
+pci_find_class (uint8_t class, uint8_t subclass, int skip,
+                struct pci_address *addr)
+{
+  return pci_find (PCI_REG_CLASS, 0xffff0000,
+                   ((uint32_t) class << 24) | ((uint32_t) subclass << 16),
+                   skip, addr);
+}
+
+/* Scans every bus, slot, and function for one whose register REG,
+   masked with MASK, equals VALUE.  Skips the first SKIP matches
+   and stores the location of the next one in *ADDR.  Returns true
+   if successful, false if there are not enough matches. */
+static bool
+pci_find (uint8_t reg, uint32_t mask, uint32_t value, int skip,
+          struct pci_address *addr)
+{
+  int bus, slot, func;
+
+  for (bus = 0; bus < 256; bus++)
+    for (slot = 0; slot < 32; slot++)
+      for (func = 0; func < 8; func++)
+        {
+          struct pci_address a;
+
+          a.bus = bus;
+          a.slot = slot;
+          a.func = func;
+          if ((pci_read_config (&a, PCI_REG_ID) & 0xffff) == 0xffff)
+            {
+              /* No function 0 means no device in this slot. */
+              if (func == 0)
+                break;
+              continue;
+            }
+
+          if ((pci_read_config (&a, reg) & mask) == value && skip-- == 0)
+            {
+              *addr = a;
+              return true;
+            }
+
+          if (func == 0
+              && !((pci_read_config (&a, PCI_REG_HEADER) >> 16)
+                   & PCI_HEADER_MULTIFUNCTION))
+            break;
+        }
+  return false;
+}
@@ -0,0 +1,46 @@
+#ifndef DEVICES_PCI_H
+#define DEVICES_PCI_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Location of a PCI function in configuration space. */
+struct pci_address
+  {
+    uint8_t bus;                /* Bus number, 0...255. */
+    uint8_t slot;               /* Device number on the bus, 0...31. */
+    uint8_t func;               /* Function number, 0...7. */
+  };
+
+/* Configuration space registers (byte offsets). */
+#define PCI_REG_ID 0x00         /* Vendor ID 15:0, device ID 31:16. */
+#define PCI_REG_COMMAND 0x04    /* Command 15:0, status 31:16. */
+#define PCI_REG_CLASS 0x08      /* Revision, prog IF, subclass, class. */
+#define PCI_REG_HEADER 0x0c     /* Header type in 23:16. */
+#define PCI_REG_BAR(N) (0x10 + 4 * (N))  /* Base address register N. */
+#define PCI_REG_INTERRUPT 0x3c  /* Interrupt line 7:0, pin 15:8. */
+
+/* Command register bits. */
+#define PCI_COMMAND_IO 0x0001           /* Respond to I/O space. */
+#define PCI_COMMAND_MEMORY 0x0002       /* Respond to memory space. */
+#define PCI_COMMAND_MASTER 0x0004       /* Enable bus mastering. */
+
+/* Base address register bits. */
+#define PCI_BAR_IO 0x00000001           /* BAR is in I/O space. */
+#define PCI_BAR_IO_MASK 0xfffffffc      /* I/O space base address. */
+
+/* Class codes. */
+#define PCI_CLASS_STORAGE 0x01          /* Mass storage controller. */
+#define PCI_SUBCLASS_IDE 0x01           /* IDE controller. */
+
+uint32_t pci_read_config (const struct pci_address *, uint8_t reg);
+void pci_write_config (const struct pci_address *, uint8_t reg,
+                       uint32_t value);
+void pci_enable (const struct pci_address *, uint16_t command_bits);
+
+bool pci_find_device (uint16_t vendor, uint16_t device, int skip,
+                      struct pci_address *);
+bool pci_find_class (uint8_t class, uint8_t subclass, int skip,
+                     struct pci_address *);
+
+#endif /* devices/pci.h */
@@ -0,0 +1,105 @@
+#include "devices/ramdisk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
+
+/* A block device held in kernel memory.  Its contents are lost at
+   shutdown, so it suits scratch space, swap, and benchmarks that
+   should not be dominated by disk latency.  Pages need not be
+   contiguous, so the disk is kept as an array of pages. */
+
+#define SECTORS_PER_PAGE (PGSIZE / BLOCK_SECTOR_SIZE)
+
+static uint8_t **pages;         /* Pages holding the disk. */
+static size_t page_cnt;         /* Number of pages. */
+
+static struct block_operations ramdisk_operations;
+
+/* Creates a RAM disk named "rd0" of SIZE_KB kilobytes, rounded up
+   to a whole number of pages, and registers it with the given
+   TYPE.  Its contents start out zeroed.  Panics if memory runs
+   out. */
+void
+ramdisk_init (enum block_type type, size_t size_kb)
+{
+  size_t i;
+
+  ASSERT (type < BLOCK_CNT);
+
+  page_cnt = DIV_ROUND_UP (size_kb * 1024, PGSIZE);
+  if (page_cnt == 0)
+    PANIC ("ramdisk: size must be positive");
+  pages = malloc (sizeof *pages * page_cnt);
+  if (pages == NULL)
+    PANIC ("ramdisk: out of memory");
+  for (i = 0; i < page_cnt; i++)
+    {
+      pages[i] = palloc_get_page (PAL_ZERO);
+      if (pages[i] == NULL)
+        PANIC ("ramdisk: out of memory after %zu of %zu pages",
+               i, page_cnt);
+    }
+
+  block_register ("rd0", type, "RAM disk", page_cnt * SECTORS_PER_PAGE,
+                  &ramdisk_operations, NULL);
+}
+
+/* Returns the address of SECTOR in the RAM disk. */
+static uint8_t *
+sector_addr (block_sector_t sector)
+{
+  return pages[sector / SECTORS_PER_PAGE]
+         + sector % SECTORS_PER_PAGE * BLOCK_SECTOR_SIZE;
+}
+
+/* Copies REQ's sectors between the RAM disk and REQ's buffer, a
+   page at a time, and completes REQ before returning. */
+static void
+ramdisk_submit (void *aux UNUSED, struct block_request *req)
+{
+  block_sector_t sector = req->sector;
+  size_t left = req->cnt;
+  uint8_t *buffer = req->buffer;
+
+  while (left > 0)
+    {
+      size_t cnt = SECTORS_PER_PAGE - sector % SECTORS_PER_PAGE;
+      if (cnt > left)
+        cnt = left;
+
+      if (req->write)
+        memcpy (sector_addr (sector), buffer, cnt * BLOCK_SECTOR_SIZE);
+      else
+        memcpy (buffer, sector_addr (sector), cnt * BLOCK_SECTOR_SIZE);
+
+      sector += cnt;
+      buffer += cnt * BLOCK_SECTOR_SIZE;
+      left -= cnt;
+    }
+  block_request_done (req);
+}
+
+static void
+ramdisk_read (void *aux UNUSED, block_sector_t sector, void *buffer)
+{
+  memcpy (buffer, sector_addr (sector), BLOCK_SECTOR_SIZE);
+}
+
+static void
+ramdisk_write (void *aux UNUSED, block_sector_t sector, const void *buffer)
+{
+  memcpy (sector_addr (sector), buffer, BLOCK_SECTOR_SIZE);
+}
+
+static struct block_operations ramdisk_operations =
+  {
+    ramdisk_read,
+    ramdisk_write,
+    NULL,
+    NULL,
+    ramdisk_submit
+  };
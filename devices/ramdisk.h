@@ -0,0 +1,9 @@
+#ifndef DEVICES_RAMDISK_H
+#define DEVICES_RAMDISK_H
+
+#include <stddef.h>
+#include "devices/block.h"
+
+void ramdisk_init (enum block_type, size_t size_kb);
+
+#endif /* devices/ramdisk.h */
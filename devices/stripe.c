@@ -0,0 +1,235 @@
+#include "devices/stripe.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "threads/interrupt.h"
+#include "threads/synch.h"
+
+/* A striped (RAID-0) block device.  Its sectors are divided into
+   chunks of CHUNK_SECTORS sectors, which are dealt out to the
+   member devices in turn: chunk 0 on member 0, chunk 1 on member
+   1, and so on.  A request that spans several chunks becomes one
+   request per chunk, submitted to every member at once, so that
+   members on different IDE channels (or virtio disks) transfer in
+   parallel. */
+
+/* Most member devices we support. */
+#define MEMBER_MAX 4
+
+/* Number of pieces and striped requests that may be in flight. */
+#define PIECE_CNT 64
+#define IO_CNT 32
+
+/* A request to the striped device, being carried out as pieces. */
+struct stripe_io
+  {
+    struct list_elem free_elem;         /* Element in free_ios. */
+    struct block_request *req;          /* Original request. */
+    int pending;                        /* Pieces not yet finished. */
+  };
+
+/* Part of a striped request that lies within one chunk. */
+struct stripe_piece
+  {
+    struct list_elem free_elem;         /* Element in free_pieces. */
+    struct block_request req;           /* Request to a member. */
+    struct stripe_io *io;               /* Request this is part of. */
+  };
+
+/* The striped device. */
+static struct block *members[MEMBER_MAX];
+static size_t member_cnt;
+static size_t chunk_sectors;
+
+/* Pools of pieces and requests.  The free lists are protected by
+   disabling interrupts, because members may complete pieces from
+   interrupt handlers. */
+static struct stripe_piece pieces[PIECE_CNT];
+static struct stripe_io ios[IO_CNT];
+static struct list free_pieces, free_ios;
+static struct semaphore pieces_free, ios_free;
+
+static struct block_operations stripe_operations;
+
+/* Creates a striped block device named "md0" over the
+   comma-separated list of block device names in MEMBERS, with
+   chunks of CHUNK_SECTORS sectors, and registers it as a file
+   system device.  Modifies MEMBERS.  Panics if a member does not
+   exist. */
+void
+stripe_init (char *members_, size_t chunk_sectors_)
+{
+  block_sector_t member_size = 0, size;
+  char *name, *save_ptr;
+  size_t i;
+
+  if (chunk_sectors_ == 0)
+    PANIC ("stripe: chunk size must be positive");
+  chunk_sectors = chunk_sectors_;
+
+  for (name = strtok_r (members_, ",", &save_ptr); name != NULL;
+       name = strtok_r (NULL, ",", &save_ptr))
+    {
+      struct block *block = block_get_by_name (name);
+      if (block == NULL)
+        PANIC ("stripe: no such block device \"%s\"", name);
+      if (member_cnt >= MEMBER_MAX)
+        PANIC ("stripe: more than %d members", MEMBER_MAX);
+      if (member_cnt == 0 || block_size (block) < member_size)
+        member_size = block_size (block);
+      members[member_cnt++] = block;
+    }
+  if (member_cnt == 0)
+    PANIC ("stripe: no members");
+
+  list_init (&free_pieces);
+  for (i = 0; i < PIECE_CNT; i++)
+    list_push_back (&free_pieces, &pieces[i].free_elem);
+  sema_init (&pieces_free, PIECE_CNT);
+  list_init (&free_ios);
+  for (i = 0; i < IO_CNT; i++)
+    list_push_back (&free_ios, &ios[i].free_elem);
+  sema_init (&ios_free, IO_CNT);
+
+  /* Use only whole chunks of the smallest member. */
+  size = member_size / chunk_sectors * chunk_sectors * member_cnt;
+  block_register ("md0", BLOCK_FILESYS, "striped", size,
+                  &stripe_operations, NULL);
+}
+
+/* Waits for a free element in LIST, whose length is counted by
+   FREE, and removes it. */
+static struct list_elem *
+pool_get (struct list *list, struct semaphore *free)
+{
+  enum intr_level old_level;
+  struct list_elem *e;
+
+  sema_down (free);
+  old_level = intr_disable ();
+  e = list_pop_front (list);
+  intr_set_level (old_level);
+  return e;
+}
+
+/* Returns E to LIST, whose length is counted by FREE.  May be
+   called from an interrupt handler. */
+static void
+pool_put (struct list *list, struct semaphore *free, struct list_elem *e)
+{
+  enum intr_level old_level = intr_disable ();
+  list_push_front (list, e);
+  intr_set_level (old_level);
+  sema_up (free);
+}
+
+/* Drops a reference to IO, completing its request when the last
+   one goes away. */
+static void
+io_release (struct stripe_io *io)
+{
+  enum intr_level old_level = intr_disable ();
+  bool finished = --io->pending == 0;
+  intr_set_level (old_level);
+
+  if (finished)
+    {
+      struct block_request *req = io->req;
+      pool_put (&free_ios, &ios_free, &io->free_elem);
+      block_request_done (req);
+    }
+}
+
+/* Called when a member finishes piece AUX. */
+static void
+piece_done (struct block_request *req UNUSED, void *p_)
+{
+  struct stripe_piece *p = p_;
+  struct stripe_io *io = p->io;
+
+  pool_put (&free_pieces, &pieces_free, &p->free_elem);
+  io_release (io);
+}
+
+/* Splits REQ at chunk boundaries and submits each piece to its
+   member without waiting.  REQ completes when all of its pieces
+   have. */
+static void
+stripe_submit (void *aux UNUSED, struct block_request *req)
+{
+  struct stripe_io *io;
+  block_sector_t sector = req->sector;
+  size_t left = req->cnt;
+  uint8_t *buffer = req->buffer;
+
+  ASSERT (!intr_context ());
+
+  /* Hold an extra reference so that REQ cannot complete before
+     all of its pieces are submitted. */
+  io = list_entry (pool_get (&free_ios, &ios_free), struct stripe_io,
+                   free_elem);
+  io->req = req;
+  io->pending = 1;
+
+  while (left > 0)
+    {
+      block_sector_t chunk = sector / chunk_sectors;
+      size_t ofs = sector % chunk_sectors;
+      size_t cnt = chunk_sectors - ofs < left ? chunk_sectors - ofs : left;
+      struct stripe_piece *p;
+      enum intr_level old_level;
+
+      p = list_entry (pool_get (&free_pieces, &pieces_free),
+                      struct stripe_piece, free_elem);
+      p->io = io;
+      old_level = intr_disable ();
+      io->pending++;
+      intr_set_level (old_level);
+
+      block_request_init (&p->req, req->write,
+                          chunk / member_cnt * chunk_sectors + ofs, cnt,
+                          buffer, piece_done, p);
+      block_submit (members[chunk % member_cnt], &p->req);
+
+      sector += cnt;
+      buffer += cnt * BLOCK_SECTOR_SIZE;
+      left -= cnt;
+    }
+
+  io_release (io);
+}
+
+/* Reads or writes one sector synchronously through
+   stripe_submit(). */
+static void
+stripe_transfer (bool write, block_sector_t sector, void *buffer)
+{
+  struct block_request req;
+
+  block_request_init (&req, write, sector, 1, buffer, NULL, NULL);
+  stripe_submit (NULL, &req);
+  block_wait (&req);
+}
+
+static void
+stripe_read (void *aux UNUSED, block_sector_t sector, void *buffer)
+{
+  stripe_transfer (false, sector, buffer);
+}
+
+static void
+stripe_write (void *aux UNUSED, block_sector_t sector, const void *buffer)
+{
+  stripe_transfer (true, sector, (void *) buffer);
+}
+
+static struct block_operations stripe_operations =
+  {
+    stripe_read,
+    stripe_write,
+    NULL,
+    NULL,
+    stripe_submit
+  };
@@ -0,0 +1,375 @@
+#include "devices/virtio-blk.h"
+#include <debug.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "devices/block.h"
+#include "devices/partition.h"
+#include "devices/pci.h"
+#include "threads/interrupt.h"
+#include "threads/io.h"
+#include "threads/malloc.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* The code in this file drives virtio block devices, as provided
+   by QEMU's "virtio-blk-pci", through the legacy (virtio 0.9.5)
+   PCI interface.  Unlike an IDE channel, which runs one command
+   at a time, a virtio disk accepts many requests at once through
+   a shared-memory ring (a "virtqueue") and interrupts as they
+   complete, in any order. */
+
+/* PCI IDs of a legacy virtio block device. */
+#define VIRTIO_VENDOR 0x1af4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+/* Legacy virtio I/O port addresses, relative to BAR0. */
+#define reg_guest_features(DISK) ((DISK)->io_base + 0x04)
+#define reg_queue_pfn(DISK) ((DISK)->io_base + 0x08)
+#define reg_queue_size(DISK) ((DISK)->io_base + 0x0c)
+#define reg_queue_select(DISK) ((DISK)->io_base + 0x0e)
+#define reg_queue_notify(DISK) ((DISK)->io_base + 0x10)
+#define reg_status(DISK) ((DISK)->io_base + 0x12)
+#define reg_isr(DISK) ((DISK)->io_base + 0x13)
+#define reg_capacity(DISK) ((DISK)->io_base + 0x14)  /* 64 bits. */
+
+/* Device Status Register bits. */
+#define STATUS_ACKNOWLEDGE 0x01 /* Guest has noticed the device. */
+#define STATUS_DRIVER 0x02      /* Guest knows how to drive it. */
+#define STATUS_DRIVER_OK 0x04   /* Driver is ready. */
+
+/* Virtqueue descriptor flags. */
+#define DESC_NEXT 0x0001        /* NEXT field is valid. */
+#define DESC_WRITE 0x0002       /* Device writes (vs. reads) buffer. */
+
+/* Block request types and status. */
+#define BLK_T_IN 0              /* Read. */
+#define BLK_T_OUT 1             /* Write. */
+#define BLK_S_OK 0              /* Success. */
+
+/* Virtqueue descriptor, describing one physically contiguous
+   buffer. */
+struct vring_desc
+  {
+    uint64_t addr;              /* Physical address. */
+    uint32_t len;               /* Length in bytes. */
+    uint16_t flags;             /* DESC_* flags. */
+    uint16_t next;              /* Next descriptor if DESC_NEXT. */
+  };
+
+/* Ring of descriptor chains the driver offers to the device. */
+struct vring_avail
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the driver puts the next entry. */
+    uint16_t ring[];            /* Heads of descriptor chains. */
+  };
+
+/* Ring of descriptor chains the device has finished with. */
+struct vring_used_elem
+  {
+    uint32_t id;                /* Head of descriptor chain. */
+    uint32_t len;               /* Bytes written by the device. */
+  };
+
+struct vring_used
+  {
+    uint16_t flags;
+    uint16_t idx;               /* Where the device puts the next entry. */
+    struct vring_used_elem ring[];
+  };
+
+/* Header that starts every block request. */
+struct blk_header
+  {
+    uint32_t type;              /* BLK_T_IN or BLK_T_OUT. */
+    uint32_t reserved;
+    uint64_t sector;            /* First sector. */
+  };
+
+/* Each request occupies a slot, which owns three descriptors: the
+   header, the data buffer, and the status byte. */
+#define SLOT_DESCS 3
+
+struct slot
+  {
+    struct blk_header header;   /* Request header (device reads). */
+    uint8_t status;             /* BLK_S_* (device writes). */
+    struct block_request *req;  /* Request in flight, if any. */
+    int next_free;              /* Next free slot, or -1. */
+  };
+
+/* A virtio block device. */
+struct virtio_disk
+  {
+    char name[8];               /* Name, e.g. "vda". */
+    uint16_t io_base;           /* Base I/O port (BAR0). */
+    uint8_t irq;                /* Interrupt vector. */
+
+    uint16_t queue_size;        /* Descriptors in the virtqueue. */
+    struct vring_desc *desc;    /* Descriptor table. */
+    struct vring_avail *avail;  /* Available ring. */
+    volatile struct vring_used *used;   /* Used ring. */
+    uint16_t last_used;         /* Used ring entries processed so far. */
+
+    /* Slots.  Protected by disabling interrupts, because the
+       interrupt handler frees them. */
+    struct slot *slots;         /* QUEUE_SIZE / SLOT_DESCS slots. */
+    int free_slot;              /* First free slot, or -1. */
+    struct semaphore slots_free;        /* Number of free slots. */
+  };
+
+/* We support up to this many virtio disks. */
+#define DISK_MAX 4
+static struct virtio_disk disks[DISK_MAX];
+static size_t disk_cnt;
+
+static struct block_operations virtio_operations;
+
+static bool init_disk (struct virtio_disk *, const struct pci_address *);
+static void interrupt_handler (struct intr_frame *);
+
+/* Detects virtio block devices on the PCI bus and registers each
+   one with the block layer. */
+void
+virtio_blk_init (void)
+{
+  struct pci_address pci;
+  int skip;
+
+  for (skip = 0; disk_cnt < DISK_MAX
+         && pci_find_device (VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, skip, &pci);
+       skip++)
+    {
+      struct virtio_disk *d = &disks[disk_cnt];
+      snprintf (d->name, sizeof d->name, "vd%c", 'a' + (int) disk_cnt);
+      init_disk (d, &pci);
+    }
+}
+
+/* Returns the number of bytes needed for a legacy virtqueue of
+   QUEUE_SIZE descriptors, and stores in *USED_OFS the offset of
+   its used ring, which must be page-aligned. */
+static size_t
+vring_size (uint16_t queue_size, size_t *used_ofs)
+{
+  *used_ofs = ROUND_UP (sizeof (struct vring_desc) * queue_size
+                        + sizeof (uint16_t) * (3 + queue_size), PGSIZE);
+  return *used_ofs + ROUND_UP (sizeof (uint16_t) * 3
+                               + sizeof (struct vring_used_elem) * queue_size,
+                               PGSIZE);
+}
+
+/* Resets and sets up the virtio disk D, which must be
+   disks[disk_cnt], at PCI address PCI, then adds it to DISKS and
+   registers it.  Returns true if successful, false if the device
+   is unusable. */
+static bool
+init_disk (struct virtio_disk *d, const struct pci_address *pci)
+{
+  uint32_t bar0 = pci_read_config (pci, PCI_REG_BAR (0));
+  block_sector_t capacity;
+  size_t used_ofs, slot_cnt, i;
+  uint8_t *vring, line;
+  struct block *block;
+  bool shared;
+
+  if (!(bar0 & PCI_BAR_IO))
+    return false;
+  d->io_base = bar0 & PCI_BAR_IO_MASK;
+  line = pci_read_config (pci, PCI_REG_INTERRUPT) & 0xff;
+  if (line >= 16)
+    return false;
+  d->irq = line + 0x20;
+  pci_enable (pci, PCI_COMMAND_IO | PCI_COMMAND_MASTER);
+
+  /* Reset the device and announce ourselves.  We need none of
+     the optional features. */
+  outb (reg_status (d), 0);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE);
+  outb (reg_status (d), STATUS_ACKNOWLEDGE | STATUS_DRIVER);
+  outl (reg_guest_features (d), 0);
+
+  /* Set up virtqueue 0 in physically contiguous pages. */
+  outw (reg_queue_select (d), 0);
+  d->queue_size = inw (reg_queue_size (d));
+  if (d->queue_size < SLOT_DESCS)
+    {
+      printf ("%s: unusable virtqueue size %"PRIu16"\n",
+              d->name, d->queue_size);
+      return false;
+    }
+  vring = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                               vring_size (d->queue_size, &used_ofs)
+                               / PGSIZE);
+  d->desc = (struct vring_desc *) vring;
+  d->avail = (struct vring_avail *) (vring + (sizeof (struct vring_desc)
+                                              * d->queue_size));
+  d->used = (struct vring_used *) (vring + used_ofs);
+  d->last_used = 0;
+
+  /* Each slot's descriptors are chained once, here. */
+  slot_cnt = d->queue_size / SLOT_DESCS;
+  d->slots = malloc (sizeof *d->slots * slot_cnt);
+  if (d->slots == NULL)
+    PANIC ("%s: out of memory", d->name);
+  for (i = 0; i < slot_cnt; i++)
+    {
+      struct slot *s = &d->slots[i];
+      struct vring_desc *desc = &d->desc[i * SLOT_DESCS];
+
+      s->req = NULL;
+      s->next_free = i + 1 < slot_cnt ? (int) i + 1 : -1;
+
+      desc[0].addr = vtop (&s->header);
+      desc[0].len = sizeof s->header;
+      desc[0].flags = DESC_NEXT;
+      desc[0].next = i * SLOT_DESCS + 1;
+      desc[1].flags = DESC_NEXT;
+      desc[1].next = i * SLOT_DESCS + 2;
+      desc[2].addr = vtop (&s->status);
+      desc[2].len = sizeof s->status;
+      desc[2].flags = DESC_WRITE;
+    }
+  d->free_slot = 0;
+  sema_init (&d->slots_free, slot_cnt);
+  outl (reg_queue_pfn (d), vtop (vring) / PGSIZE);
+
+  /* Disks that share an interrupt line share a handler.  D must
+     be visible to the handler before the device can interrupt. */
+  shared = false;
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == d->irq)
+      shared = true;
+  disk_cnt++;
+  if (!shared)
+    intr_register_ext (d->irq, interrupt_handler, "virtio-blk");
+
+  outb (reg_status (d),
+        STATUS_ACKNOWLEDGE | STATUS_DRIVER | STATUS_DRIVER_OK);
+
+  /* Register.  The capacity is 64 bits, but block_sector_t only
+     has 32. */
+  capacity = inl (reg_capacity (d));
+  if (inl (reg_capacity (d) + 4) != 0)
+    capacity = (block_sector_t) -1;
+  block = block_register (d->name, BLOCK_RAW, "virtio", capacity,
+                          &virtio_operations, d);
+  partition_scan (block);
+  return true;
+}
+
+/* Puts REQ into a free slot of disk D's virtqueue and notifies the
+   device.  Waits for a slot if all are in use.  Returns without
+   waiting for the transfer; the interrupt handler completes REQ. */
+static void
+virtio_submit (void *d_, struct block_request *req)
+{
+  struct virtio_disk *d = d_;
+  enum intr_level old_level;
+  struct vring_desc *desc;
+  struct slot *s;
+  int slot_no;
+
+  ASSERT (!intr_context ());
+
+  sema_down (&d->slots_free);
+  old_level = intr_disable ();
+  slot_no = d->free_slot;
+  ASSERT (slot_no >= 0);
+  s = &d->slots[slot_no];
+  d->free_slot = s->next_free;
+
+  s->req = req;
+  s->header.type = req->write ? BLK_T_OUT : BLK_T_IN;
+  s->header.reserved = 0;
+  s->header.sector = req->sector;
+  s->status = 0xff;
+
+  desc = &d->desc[slot_no * SLOT_DESCS];
+  desc[1].addr = vtop (req->buffer);
+  desc[1].len = req->cnt * BLOCK_SECTOR_SIZE;
+  desc[1].flags = DESC_NEXT | (req->write ? 0 : DESC_WRITE);
+
+  /* The device must see the ring entry before the new index. */
+  d->avail->ring[d->avail->idx % d->queue_size] = slot_no * SLOT_DESCS;
+  barrier ();
+  d->avail->idx++;
+  barrier ();
+  outw (reg_queue_notify (d), 0);
+  intr_set_level (old_level);
+}
+
+/* Reads or writes one sector synchronously through
+   virtio_submit(). */
+static void
+virtio_transfer (struct virtio_disk *d, bool write, block_sector_t sector,
+                 void *buffer)
+{
+  struct block_request req;
+
+  block_request_init (&req, write, sector, 1, buffer, NULL, NULL);
+  virtio_submit (d, &req);
+  block_wait (&req);
+}
+
+static void
+virtio_read (void *d, block_sector_t sector, void *buffer)
+{
+  virtio_transfer (d, false, sector, buffer);
+}
+
+static void
+virtio_write (void *d, block_sector_t sector, const void *buffer)
+{
+  virtio_transfer (d, true, sector, (void *) buffer);
+}
+
+static struct block_operations virtio_operations =
+  {
+    virtio_read,
+    virtio_write,
+    NULL,
+    NULL,
+    virtio_submit
+  };
+
+/* Completes the requests that disk D has finished with. */
+static void
+reap_requests (struct virtio_disk *d)
+{
+  /* Reading the ISR status acknowledges the interrupt. */
+  inb (reg_isr (d));
+
+  while (d->last_used != d->used->idx)
+    {
+      uint32_t id = d->used->ring[d->last_used % d->queue_size].id;
+      int slot_no = id / SLOT_DESCS;
+      struct slot *s = &d->slots[slot_no];
+      struct block_request *req = s->req;
+
+      d->last_used++;
+      if (s->status != BLK_S_OK)
+        PANIC ("%s: %s failed, sector=%"PRDSNu", status=%"PRIu8,
+               d->name, req->write ? "write" : "read", req->sector,
+               s->status);
+
+      s->req = NULL;
+      s->next_free = d->free_slot;
+      d->free_slot = slot_no;
+      sema_up (&d->slots_free);
+      block_request_done (req);
+    }
+}
+
+/* virtio-blk interrupt handler. */
+static void
+interrupt_handler (struct intr_frame *f)
+{
+  size_t i;
+
+  for (i = 0; i < disk_cnt; i++)
+    if (disks[i].irq == f->vec_no)
+      reap_requests (&disks[i]);
+}
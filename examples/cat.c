@@ -20,13 +20,10 @@ main (int argc, char *argv[])
           success = false;
           continue;
         }
-      for (;;) 
+      if (sendfile (STDOUT_FILENO, fd, filesize (fd)) != filesize (fd))
         {
-          char buffer[1024];
-          int bytes_read = read (fd, buffer, sizeof buffer);
-          if (bytes_read == 0)
-            break;
-          write (STDOUT_FILENO, buffer, bytes_read);
+          printf ("%s: read failed\n", argv[i]);
+          success = false;
         }
       close (fd);
     }
@@ -0,0 +1,112 @@
+/* compbench.c
+
+   Writes the same compressible text to a plain file and to a
+   compressed one, drops both from the caches, reads each back,
+   and reports how many bytes were read from the file system
+   device for each. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+
+/* Size of each test file. */
+#define FILE_SIZE (64 * 1024)
+
+static char buf[4096];
+
+/* Fills BUF with lines of text, numbered so that they are not all
+   alike. */
+static void
+fill_text (void)
+{
+  size_t ofs = 0;
+  int line = 0;
+
+  while (ofs < sizeof buf)
+    {
+      char text[80];
+      size_t len;
+
+      snprintf (text, sizeof text,
+                "%05d the quick brown fox jumps over the lazy dog\n",
+                line++);
+      len = strlen (text);
+      if (len > sizeof buf - ofs)
+        len = sizeof buf - ofs;
+      memcpy (buf + ofs, text, len);
+      ofs += len;
+    }
+}
+
+/* Writes FILE_SIZE bytes of text to a new file named NAME,
+   compressed if COMPRESSED is true, then reads it back cold.
+   Returns the number of bytes read from the device to read it,
+   or -1 on failure. */
+static long long
+run (const char *name, bool compressed)
+{
+  struct blkstat before, after;
+  int fd;
+  int ofs;
+
+  remove (name);
+  if (!create (name, 0))
+    {
+      printf ("%s: create failed\n", name);
+      return -1;
+    }
+  fd = open (name);
+  if (fd < 0)
+    {
+      printf ("%s: open failed\n", name);
+      return -1;
+    }
+  if (compressed && !compress (fd, true))
+    {
+      printf ("%s: compress failed\n", name);
+      close (fd);
+      return -1;
+    }
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    if (write (fd, buf, sizeof buf) != (int) sizeof buf)
+      {
+        printf ("%s: write failed\n", name);
+        close (fd);
+        return -1;
+      }
+
+  /* Put the file on disk and out of memory, so that reading it
+     back has to go to the device. */
+  fsync (fd);
+  fadvise (fd, 0, 0, FADV_DONTNEED);
+
+  blkstat (NULL, &before);
+  seek (fd, 0);
+  for (ofs = 0; ofs < FILE_SIZE; ofs += sizeof buf)
+    if (read (fd, buf, sizeof buf) != (int) sizeof buf)
+      {
+        printf ("%s: read failed\n", name);
+        close (fd);
+        return -1;
+      }
+  blkstat (NULL, &after);
+  close (fd);
+  remove (name);
+  return after.read_bytes - before.read_bytes;
+}
+
+int
+main (void)
+{
+  long long plain, packed;
+
+  fill_text ();
+  plain = run ("compbench.plain", false);
+  packed = run ("compbench.packed", true);
+  if (plain < 0 || packed < 0)
+    return EXIT_FAILURE;
+
+  printf ("plain:      %lld bytes read\n", plain);
+  printf ("compressed: %lld bytes read\n", packed);
+  return EXIT_SUCCESS;
+}
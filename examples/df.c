@@ -0,0 +1,26 @@
+/* df.c
+
+   Reports the size and free space of the file system. */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <syscall.h>
+
+int
+main (void)
+{
+  struct statfs st;
+
+  if (!statfs (&st))
+    {
+      printf ("df: statfs failed\n");
+      return EXIT_FAILURE;
+    }
+
+  printf ("%10s %10s %10s %10s %10s\n",
+          "block size", "blocks", "free", "inodes", "free");
+  printf ("%10"PRIu32" %10"PRIu32" %10"PRIu32" %10"PRIu32" %10"PRIu32"\n",
+          st.block_size, st.block_cnt, st.free_blocks,
+          st.inode_cnt, st.free_inodes);
+  return EXIT_SUCCESS;
+}
@@ -1,16 +1,49 @@
 #include <stdio.h>
 #include <string.h>
 #include <debug.h>
+#include <round.h>
 #include "filesys/filesys.h"
 #include "filesys/cache.h"
+#include "filesys/journal.h"
 #include "threads/thread.h"
 #include "threads/synch.h"
+#include "threads/palloc.h"
+#include "threads/vaddr.h"
 #include "devices/timer.h"
 
 /* Size of buffer cache */
 #define BUFFER_CACHE_SIZE 64
 /* Period to flush all the cache into the disk */
 #define BUFFER_CACHE_FLUSH_INTERVAL 20
+/* Maximum number of blocks loaded together by read-ahead or a
+   prefetch.  Must be well below BUFFER_CACHE_SIZE. */
+#define READ_AHEAD_MAX 16
+
+/* Metadata partition.  Entries holding metadata (the inode table,
+   indirect blocks, directories and the free maps) form a pool
+   apart from those holding file data.  Data never evicts metadata
+   while the pool holds META_RESERVED entries or fewer, so that a
+   bulk read or write cannot push out the blocks every path lookup
+   needs, and metadata never takes more than META_MAX entries from
+   data.  Within those bounds each pool replaces its own least
+   recently used entry. */
+#define META_RESERVED (BUFFER_CACHE_SIZE / 4)
+#define META_MAX (BUFFER_CACHE_SIZE * 3 / 4)
+
+/* Dirty entries past which background writeback starts and
+   writers are slowed down, and past which writers write back
+   dirty entries themselves. */
+#define DIRTY_BACKGROUND (BUFFER_CACHE_SIZE / 4)
+#define DIRTY_LIMIT (BUFFER_CACHE_SIZE / 2)
+/* Longest pause, in timer ticks, imposed on a writer below
+   DIRTY_LIMIT. */
+#define DIRTY_PAUSE_MAX 4
+/* Most dirty entries written back at a time by background
+   writeback or by a throttled writer. */
+#define WRITE_BACK_BATCH 8
+
+/* Return minimum. */
+#define min(a, b) ((a < b) ? (a) : (b))
 
 /* Entries of buffer cache */
 struct buffer_cache_entry
@@ -18,12 +51,16 @@ struct buffer_cache_entry
   bool using;                   /* Whether this sector is being used */
 
   /* Information of the cache */
-  block_sector_t sector;        /* Sector on the disk of the cached file */
+  block_sector_t sector;        /* File system block that is cached */
   bool dirty;                   /* Dirty bit */
+  block_sector_t owner;         /* Inode number of the last writer */
+  bool journaled;               /* In the running journal transaction,
+                                   so not to be written in place */
+  bool meta;                    /* Holds metadata? */
   int64_t access_time;          /* Last access time */
 
-  /* Data storage for a block */
-  uint8_t buffer[BLOCK_SECTOR_SIZE];
+  /* Data storage for a block, fs_block_size bytes */
+  uint8_t *buffer;
 };
 
 /* Buffer cache entries */
@@ -35,8 +72,64 @@ bool buffer_cache_initialized = false;
 
 /* Last time buffer cache flushed */
 int64_t buffer_cache_last_flush = 30;
-/* Last sector read, 0 for no need to read ahead */
-block_sector_t buffer_cache_last_sector_loaded = 0;
+/* Blocks queued for read-ahead by the periodic thread.
+   Protected by buffer_cache_lock. */
+static block_sector_t read_ahead_queue[READ_AHEAD_MAX];
+static size_t read_ahead_cnt;
+
+/* Number of entries in the running journal transaction.
+   Protected by buffer_cache_lock. */
+static size_t journaled_cnt;
+
+/* Number of dirty entries.  Protected by buffer_cache_lock. */
+static size_t dirty_cnt;
+/* Number of entries in the metadata pool.  Protected by
+   buffer_cache_lock. */
+static size_t meta_cnt;
+/* Set when writers want background writeback to run. */
+static bool write_back_wanted;
+
+/* Marks BCE dirty or clean, keeping dirty_cnt up to date. */
+static void
+buffer_cache_set_dirty (struct buffer_cache_entry *bce, bool dirty)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  if (bce->dirty != dirty)
+    {
+      if (dirty)
+        dirty_cnt++;
+      else
+        dirty_cnt--;
+      bce->dirty = dirty;
+    }
+}
+
+/* Moves BCE into the metadata pool if META is true, or into the
+   data pool otherwise, keeping meta_cnt up to date. */
+static void
+buffer_cache_set_meta (struct buffer_cache_entry *bce, bool meta)
+{
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  if (bce->meta != meta)
+    {
+      if (meta)
+        meta_cnt++;
+      else
+        meta_cnt--;
+      bce->meta = meta;
+    }
+}
+
+/* Takes BCE, which must be clean, out of use. */
+static void
+buffer_cache_free_entry (struct buffer_cache_entry *bce)
+{
+  ASSERT (!bce->dirty);
+  buffer_cache_set_meta (bce, false);
+  bce->using = false;
+}
 
 /* Flush the given buffer cache entry ID */
 static void
@@ -52,8 +145,9 @@ buffer_cache_flush (int to_evict)
   if (bce->dirty == false)
     return ;
   
-  block_write (fs_device, bce->sector, bce->buffer);
-  bce->dirty = false;
+  block_write_multiple (fs_device, bce->sector * fs_block_sectors,
+                        fs_block_sectors, bce->buffer);
+  buffer_cache_set_dirty (bce, false);
 }
 
 /* Lookup the given buffer cache entry by the sector
@@ -73,32 +167,53 @@ buffer_cache_lookup_sector (block_sector_t sector)
   return -1;
 }
 
-/* Find an entry to evict */
+/* Find an entry to evict to make room for a block of metadata if
+   META is true, or of file data otherwise */
 static int
-buffer_cache_evict (void)
+buffer_cache_evict (bool meta)
 {
   ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
 
-  /* Find cache to evict according to LRU */
-  ASSERT (buffer_cache[0].using);
-  int to_evict = 0;
-  for (int i = 1; i < BUFFER_CACHE_SIZE; i++)
-    {
-      ASSERT (buffer_cache[i].using);
-      if (buffer_cache[i].access_time < buffer_cache[to_evict].access_time)
-        to_evict = i;
-    }
+  /* Which pools may give up an entry: the block's own, and the
+     other one as far as the partition bounds allow. */
+  bool from_meta = meta || meta_cnt > META_RESERVED;
+  bool from_data = !meta || meta_cnt < META_MAX;
+
+  /* Find cache to evict according to LRU, passing over entries
+     that the journal has not committed yet.  A clean entry is
+     preferred to any dirty one, so that a reader does not have to
+     wait for a writer's data to go to disk first. */
+  int to_evict = -1;
+  for (int pass = 0; pass < 2 && to_evict == -1; pass++)
+    for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
+      {
+        struct buffer_cache_entry *bce = &buffer_cache[i];
+        ASSERT (bce->using);
+        if (bce->journaled)
+          continue;
+        /* Stay within the allowed pools unless they have nothing
+           to give, which the second pass allows for. */
+        if (pass == 0 && !(bce->meta ? from_meta : from_data))
+          continue;
+        if (to_evict == -1
+            || (bce->dirty == buffer_cache[to_evict].dirty
+                && bce->access_time < buffer_cache[to_evict].access_time)
+            || (!bce->dirty && buffer_cache[to_evict].dirty))
+          to_evict = i;
+      }
+  ASSERT (to_evict != -1);
   
   /* Evict the cache */
   buffer_cache_flush (to_evict);
-  buffer_cache[to_evict].using = false;
+  buffer_cache_free_entry (&buffer_cache[to_evict]);
   return to_evict;
 }
 
-/* Allocate an empty buffer cache 
+/* Allocate an empty buffer cache for a block of metadata if META
+   is true, or of file data otherwise
    Returns the ID of the buffer cache */
 static int
-buffer_cache_allocate (void)
+buffer_cache_allocate (bool meta)
 {
   ASSERT (lock_held_by_current_thread(&buffer_cache_lock));
 
@@ -110,52 +225,406 @@ buffer_cache_allocate (void)
     }
   
   /* Otherwise evict a cache and return */
-  return buffer_cache_evict ();
+  return buffer_cache_evict (meta);
 }
 
-/* Load data from disk sector to the given buffer cache entry */
+/* Load data from disk sector to the given buffer cache entry,
+   unless READ is false because the caller is about to overwrite
+   the whole block */
 static void
-buffer_cache_load (block_sector_t sector, struct buffer_cache_entry *bce)
+buffer_cache_load (block_sector_t sector, struct buffer_cache_entry *bce,
+                   bool read)
 {
-  /* Copy the data in sectors to the cache */
-  block_read (fs_device, sector, bce->buffer);
+  /* Copy the data in the block's sectors to the cache */
+  if (read)
+    block_read_multiple (fs_device, sector * fs_block_sectors,
+                         fs_block_sectors, bce->buffer);
   /* Set the parameters */
   bce->dirty = false;
+  bce->owner = CACHE_NO_OWNER;
+  bce->journaled = false;
   bce->sector = sector;
   bce->using = true;
   bce->access_time = timer_ticks ();
-  buffer_cache_last_sector_loaded = sector;
 }
 
-/* Initialize the buffer cache */
+/* Loads those of the CNT blocks in SECTORS that are not cached
+   yet, at most READ_AHEAD_MAX of them, issuing all the reads
+   before waiting for any so that the device can sort and merge
+   them. */
+static void
+buffer_cache_load_many (const block_sector_t *sectors, size_t cnt)
+{
+  /* Read requests and the entries they fill.  Protected by
+     buffer_cache_lock. */
+  static struct block_request requests[READ_AHEAD_MAX];
+  static int entries[READ_AHEAD_MAX];
+  size_t request_cnt = 0;
+
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
+
+  for (size_t i = 0; i < cnt && request_cnt < READ_AHEAD_MAX; i++)
+    {
+      if (sectors[i] >= filesys_block_cnt ()
+          || buffer_cache_lookup_sector (sectors[i]) != -1)
+        continue;
+
+      int cache_id = buffer_cache_allocate (false);
+      struct buffer_cache_entry *bce = &buffer_cache[cache_id];
+      ASSERT (bce->using == false);
+
+      /* Claim the entry now, and keep it from being chosen for
+         eviction by the rest of this batch while its read is in
+         flight. */
+      bce->dirty = false;
+      bce->owner = CACHE_NO_OWNER;
+      bce->journaled = false;
+      bce->sector = sectors[i];
+      bce->using = true;
+      bce->access_time = INT64_MAX;
+
+      block_request_init (&requests[request_cnt], false,
+                          bce->sector * fs_block_sectors,
+                          fs_block_sectors, bce->buffer, NULL, NULL);
+      block_submit (fs_device, &requests[request_cnt]);
+      entries[request_cnt++] = cache_id;
+    }
+  for (size_t i = 0; i < request_cnt; i++)
+    {
+      block_wait (&requests[i]);
+      buffer_cache[entries[i]].access_time = timer_ticks ();
+    }
+}
+
+/* Initialize the buffer cache.
+   Must be called after the file system block size is known. */
 void
 buffer_cache_init (void)
 {
   lock_init (&buffer_cache_lock);
 
+  /* Carve the data buffers out of one run of kernel pages. */
+  size_t page_cnt = DIV_ROUND_UP (BUFFER_CACHE_SIZE * fs_block_size, PGSIZE);
+  uint8_t *buffers = palloc_get_multiple (PAL_ASSERT, page_cnt);
+
   for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
-    buffer_cache[i].using = false;
+    {
+      buffer_cache[i].using = false;
+      buffer_cache[i].buffer = buffers + i * fs_block_size;
+    }
   
   buffer_cache_initialized = true;
 }
 
-/* Flush all buffer caches */
-void
-buffer_cache_flush_all (void)
+/* Which dirty entries buffer_cache_write_back() writes. */
+enum write_back_scope
+  {
+    WRITE_BACK_ALL,             /* Every dirty entry. */
+    WRITE_BACK_OWNER,           /* Entries last written by an inode. */
+    WRITE_BACK_BLOCK            /* The entry for one block. */
+  };
+
+/* Writes back the dirty entries selected by SCOPE and KEY, which
+   is an inode number or a block number depending on SCOPE, and
+   waits for the writes to complete.  Entries in the running
+   journal transaction are never written. */
+static void
+buffer_cache_write_back (enum write_back_scope scope, block_sector_t key)
 {
   /* Do nothing if not initialized */
   if (!buffer_cache_initialized)
     return ;
   
+  /* Write requests, one per dirty entry.  Protected by
+     buffer_cache_lock. */
+  static struct block_request requests[BUFFER_CACHE_SIZE];
+  int request_cnt = 0;
+
   lock_acquire (&buffer_cache_lock);
 
+  /* Queue every dirty block before waiting for any of them, so
+     that the device can sort and merge the writes. */
   for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
-      if (buffer_cache[i].using)
-        buffer_cache_flush (i);
+    {
+      struct buffer_cache_entry *bce = &buffer_cache[i];
+      if (!bce->using || bce->journaled || !bce->dirty)
+        continue;
+      if ((scope == WRITE_BACK_OWNER && bce->owner != key)
+          || (scope == WRITE_BACK_BLOCK && bce->sector != key))
+        continue;
+
+      struct block_request *req = &requests[request_cnt++];
+      block_request_init (req, true, bce->sector * fs_block_sectors,
+                          fs_block_sectors, bce->buffer, NULL, NULL);
+      block_submit (fs_device, req);
+      buffer_cache_set_dirty (bce, false);
+    }
+  for (int i = 0; i < request_cnt; i++)
+    block_wait (&requests[i]);
 
   lock_release (&buffer_cache_lock);
 }
 
+/* Flush all buffer caches */
+void
+buffer_cache_flush_all (void)
+{
+  buffer_cache_write_back (WRITE_BACK_ALL, 0);
+}
+
+/* Flush the dirty blocks last written on behalf of inode OWNER,
+   and wait until they are on disk */
+void
+buffer_cache_flush_owner (block_sector_t owner)
+{
+  buffer_cache_write_back (WRITE_BACK_OWNER, owner);
+}
+
+/* Flush block SECTOR if it is cached and dirty, and wait until it
+   is on disk */
+void
+buffer_cache_flush_block (block_sector_t sector)
+{
+  buffer_cache_write_back (WRITE_BACK_BLOCK, sector);
+}
+
+/* Writes back up to MAX of the dirty entries that are not in the
+   journal transaction, least recently used first, and waits for
+   them.  Returns the number written. */
+static size_t
+buffer_cache_write_back_some (size_t max)
+{
+  /* Write requests.  Protected by buffer_cache_lock. */
+  static struct block_request requests[WRITE_BACK_BATCH];
+  size_t request_cnt = 0;
+
+  ASSERT (max <= WRITE_BACK_BATCH);
+
+  lock_acquire (&buffer_cache_lock);
+  while (request_cnt < max)
+    {
+      struct buffer_cache_entry *oldest = NULL;
+      for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
+        {
+          struct buffer_cache_entry *bce = &buffer_cache[i];
+          if (bce->using && bce->dirty && !bce->journaled
+              && (oldest == NULL || bce->access_time < oldest->access_time))
+            oldest = bce;
+        }
+      if (oldest == NULL)
+        break;
+
+      /* Clean as of now; a write meanwhile dirties it again. */
+      block_request_init (&requests[request_cnt], true,
+                          oldest->sector * fs_block_sectors,
+                          fs_block_sectors, oldest->buffer, NULL, NULL);
+      block_submit (fs_device, &requests[request_cnt++]);
+      buffer_cache_set_dirty (oldest, false);
+    }
+  for (size_t i = 0; i < request_cnt; i++)
+    block_wait (&requests[i]);
+  lock_release (&buffer_cache_lock);
+  return request_cnt;
+}
+
+/* Keeps a writer from filling the cache with dirty blocks.  To be
+   called after writing through the cache, holding no locks.
+   Past DIRTY_BACKGROUND dirty entries, wakes background writeback
+   and pauses the running thread for longer the closer the count
+   is to DIRTY_LIMIT; past DIRTY_LIMIT, has the running thread
+   write back a batch of dirty entries itself. */
+void
+buffer_cache_balance_dirty (void)
+{
+  size_t dirty = dirty_cnt;
+
+  if (dirty <= DIRTY_BACKGROUND)
+    return;
+  write_back_wanted = true;
+  if (dirty >= DIRTY_LIMIT)
+    buffer_cache_write_back_some (WRITE_BACK_BATCH);
+  else
+    timer_sleep (DIV_ROUND_UP ((dirty - DIRTY_BACKGROUND) * DIRTY_PAUSE_MAX,
+                               DIRTY_LIMIT - DIRTY_BACKGROUND));
+}
+
+/* Queues the CNT blocks in SECTORS to be read into the cache in
+   the background.  Blocks that do not fit in the read-ahead queue
+   are skipped. */
+void
+buffer_cache_read_ahead (const block_sector_t *sectors, size_t cnt)
+{
+  lock_acquire (&buffer_cache_lock);
+  for (size_t i = 0; i < cnt && read_ahead_cnt < READ_AHEAD_MAX; i++)
+    read_ahead_queue[read_ahead_cnt++] = sectors[i];
+  lock_release (&buffer_cache_lock);
+}
+
+/* Reads those of the CNT blocks in SECTORS that are not cached
+   into the cache now, and waits for them. */
+void
+buffer_cache_prefetch (const block_sector_t *sectors, size_t cnt)
+{
+  lock_acquire (&buffer_cache_lock);
+  for (size_t i = 0; i < cnt; i += READ_AHEAD_MAX)
+    buffer_cache_load_many (sectors + i, min (cnt - i, READ_AHEAD_MAX));
+  lock_release (&buffer_cache_lock);
+}
+
+/* Drops block SECTOR from the cache, writing it back first if it
+   is dirty. */
+void
+buffer_cache_drop (block_sector_t sector)
+{
+  lock_acquire (&buffer_cache_lock);
+  int cache_id = buffer_cache_lookup_sector (sector);
+  if (cache_id != -1 && !buffer_cache[cache_id].journaled)
+    {
+      buffer_cache_flush (cache_id);
+      buffer_cache_free_entry (&buffer_cache[cache_id]);
+    }
+  lock_release (&buffer_cache_lock);
+}
+
+/* Makes block SECTOR, if it is cached, the first candidate for
+   eviction, for data that will not be used again soon. */
+void
+buffer_cache_age (block_sector_t sector)
+{
+  lock_acquire (&buffer_cache_lock);
+  int cache_id = buffer_cache_lookup_sector (sector);
+  if (cache_id != -1)
+    buffer_cache[cache_id].access_time = 0;
+  lock_release (&buffer_cache_lock);
+}
+
+/* Copies each entry in the running journal transaction into
+   consecutive blocks of COPIES, storing its block number into the
+   corresponding element of SECTORS, which must have room for
+   JOURNAL_TXN_MAX.  The entries stay in the transaction.  Returns
+   the number of entries copied. */
+size_t
+buffer_cache_journal_collect (block_sector_t *sectors, uint8_t *copies)
+{
+  size_t cnt = 0;
+
+  lock_acquire (&buffer_cache_lock);
+  for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
+    {
+      struct buffer_cache_entry *bce = &buffer_cache[i];
+      if (!bce->using || !bce->journaled)
+        continue;
+
+      ASSERT (cnt < JOURNAL_TXN_MAX);
+      sectors[cnt] = bce->sector;
+      memcpy (copies + cnt * fs_block_size, bce->buffer, fs_block_size);
+      cnt++;
+    }
+  lock_release (&buffer_cache_lock);
+  return cnt;
+}
+
+/* Ends the running journal transaction, which has been committed
+   to the log.  Its entries stay dirty, to be written in place in
+   the usual way or by buffer_cache_journal_checkpoint(). */
+void
+buffer_cache_journal_end (void)
+{
+  lock_acquire (&buffer_cache_lock);
+  for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
+    buffer_cache[i].journaled = false;
+  journaled_cnt = 0;
+  lock_release (&buffer_cache_lock);
+}
+
+/* Puts in place the CNT blocks of a journal transaction that has
+   been committed to the log, whose home blocks are listed in
+   SECTORS and whose committed contents are the consecutive blocks
+   of COPIES, and waits for the writes to complete.  A block that
+   has joined the running transaction since is written from its
+   copy, since its cached contents must wait for the next commit.
+   Any other is written back if it is still cached and dirty; one
+   that is not went home when it was evicted. */
+void
+buffer_cache_journal_checkpoint (const block_sector_t *sectors,
+                                 const uint8_t *copies, size_t cnt)
+{
+  /* Write requests.  Protected by buffer_cache_lock. */
+  static struct block_request requests[JOURNAL_TXN_MAX];
+  size_t request_cnt = 0;
+
+  ASSERT (cnt <= JOURNAL_TXN_MAX);
+
+  lock_acquire (&buffer_cache_lock);
+  for (size_t i = 0; i < cnt; i++)
+    {
+      int cache_id = buffer_cache_lookup_sector (sectors[i]);
+      struct buffer_cache_entry *bce;
+      const uint8_t *data;
+
+      if (cache_id == -1)
+        continue;
+      bce = &buffer_cache[cache_id];
+      if (bce->journaled)
+        data = copies + i * fs_block_size;
+      else if (bce->dirty)
+        {
+          data = bce->buffer;
+          buffer_cache_set_dirty (bce, false);
+        }
+      else
+        continue;
+
+      block_request_init (&requests[request_cnt], true,
+                          sectors[i] * fs_block_sectors, fs_block_sectors,
+                          (void *) data, NULL, NULL);
+      block_submit (fs_device, &requests[request_cnt++]);
+    }
+  for (size_t i = 0; i < request_cnt; i++)
+    block_wait (&requests[i]);
+  lock_release (&buffer_cache_lock);
+}
+
+/* Returns the number of entries in the running journal
+   transaction. */
+size_t
+buffer_cache_journal_cnt (void)
+{
+  return journaled_cnt;
+}
+
+/* Prepares blocks FIRST through FIRST + CNT - 1 for a transfer
+   that bypasses the cache.  Writes back any of them that are
+   cached and dirty, so that a direct read sees their latest
+   contents, or, if DISCARD is true, drops them from the cache
+   without writing them, so that a direct write that replaces
+   them is not later overwritten by stale cached data. */
+void
+buffer_cache_sync (block_sector_t first, size_t cnt, bool discard)
+{
+  lock_acquire (&buffer_cache_lock);
+  for (int i = 0; i < BUFFER_CACHE_SIZE; i++)
+    {
+      struct buffer_cache_entry *bce = &buffer_cache[i];
+      if (!bce->using || bce->sector < first || bce->sector - first >= cnt)
+        continue;
+
+      if (discard)
+        {
+          /* The block now holds file data, which is not
+             journaled. */
+          if (bce->journaled)
+            journaled_cnt--;
+          bce->journaled = false;
+          buffer_cache_set_dirty (bce, false);
+          buffer_cache_free_entry (bce);
+        }
+      else if (!bce->journaled)
+        buffer_cache_flush (i);
+    }
+  lock_release (&buffer_cache_lock);
+}
+
 /* Periodically check the value */
 void
 buffer_cache_period (void *aux UNUSED)
@@ -165,29 +634,23 @@ buffer_cache_period (void *aux UNUSED)
     /* Try to acquire the lock and then do the read ahead
        Do nothing if lock cannot be acquired, i.e. someone is operating
        on the buffer cache */
-    if (buffer_cache_last_sector_loaded != 0)
+    if (read_ahead_cnt != 0)
       if (lock_try_acquire (&buffer_cache_lock))
         {
-          block_sector_t to_load = buffer_cache_last_sector_loaded + 1;
-          
-          /* Only load if the data is not in the cache */
-          if (buffer_cache_lookup_sector (to_load) == -1)
-            {
-              /* Allocate a cache for read ahead */
-              int cache_id = buffer_cache_allocate ();
-              ASSERT (0 <= cache_id && cache_id < BUFFER_CACHE_SIZE);
-              struct buffer_cache_entry *bce = &buffer_cache[cache_id];
-              ASSERT (bce->using == false);
-
-              /* Load data from the next disk sector */
-              buffer_cache_load (to_load, bce);
-            }
-          
-          /* No need to further load */
-          buffer_cache_last_sector_loaded = 0;
+          buffer_cache_load_many (read_ahead_queue, read_ahead_cnt);
+          read_ahead_cnt = 0;
           lock_release (&buffer_cache_lock);
         }
 
+    /* Write back dirty entries a batch at a time while writers
+       have too many, holding the cache only briefly each time. */
+    if (write_back_wanted)
+      {
+        if (dirty_cnt <= DIRTY_BACKGROUND
+            || buffer_cache_write_back_some (WRITE_BACK_BATCH) == 0)
+          write_back_wanted = false;
+      }
+
     /* Flush all every 20 timer ticks */
     if (timer_ticks () - buffer_cache_last_flush 
       >= BUFFER_CACHE_FLUSH_INTERVAL)
@@ -202,11 +665,14 @@ buffer_cache_period (void *aux UNUSED)
 
 /* Read/write operations through cache */
 
-/* Read through cache */
-void
-buffer_cache_read (block_sector_t sector, void *memory)
+/* Returns the entry caching SECTOR, loading it from disk first if
+   it is not cached yet, unless READ is false because the caller
+   is about to overwrite the whole block.  If META is true, the
+   block holds metadata and the entry joins the metadata pool. */
+static struct buffer_cache_entry *
+buffer_cache_get (block_sector_t sector, bool meta, bool read)
 {
-  lock_acquire (&buffer_cache_lock);
+  ASSERT (lock_held_by_current_thread (&buffer_cache_lock));
 
   /* Find the corresponding buffer cache */
   int cache_id = buffer_cache_lookup_sector (sector);
@@ -215,58 +681,146 @@ buffer_cache_read (block_sector_t sector, void *memory)
   /* Allocate a new one if not found */
   if (cache_id == -1)
     {
-      cache_id = buffer_cache_allocate ();
+      cache_id = buffer_cache_allocate (meta);
       ASSERT (0 <= cache_id && cache_id < BUFFER_CACHE_SIZE);
 
       bce = &buffer_cache[cache_id];
       ASSERT (bce->using == false);
 
       /* Load data from disk sector */
-      buffer_cache_load (sector, bce);
+      buffer_cache_load (sector, bce, read);
     }
   else
     bce = &buffer_cache[cache_id];
 
-  /* Copy data to target memory */
-  memcpy (memory, bce->buffer, BLOCK_SECTOR_SIZE);
-  
   /* Set access time */
   bce->access_time = timer_ticks ();
+  if (meta)
+    buffer_cache_set_meta (bce, true);
+  return bce;
+}
+
+/* Read SIZE bytes starting at byte OFS of block SECTOR through
+   cache into MEMORY.  META says whether the block holds
+   metadata. */
+static void
+buffer_cache_read_common (block_sector_t sector, void *memory,
+                          size_t ofs, size_t size, bool meta)
+{
+  ASSERT (ofs + size <= fs_block_size);
+
+  lock_acquire (&buffer_cache_lock);
+  struct buffer_cache_entry *bce = buffer_cache_get (sector, meta, true);
+
+  /* Copy data to target memory */
+  memcpy (memory, bce->buffer + ofs, size);
 
   lock_release (&buffer_cache_lock);
 }
 
-/* Write through cache */
+/* Read SIZE bytes starting at byte OFS of block SECTOR through
+   cache into MEMORY */
+void
+buffer_cache_read_at (block_sector_t sector, void *memory,
+                      size_t ofs, size_t size)
+{
+  buffer_cache_read_common (sector, memory, ofs, size, false);
+}
+
+/* Like buffer_cache_read_at(), for a metadata block */
 void
-buffer_cache_write (block_sector_t sector, void *memory)
+buffer_cache_read_meta_at (block_sector_t sector, void *memory,
+                           size_t ofs, size_t size)
 {
+  buffer_cache_read_common (sector, memory, ofs, size, true);
+}
+
+/* Write SIZE bytes from MEMORY through cache into block SECTOR,
+   starting at byte OFS, on behalf of inode OWNER.  If META is
+   true, the block is metadata: it joins the metadata pool and, if
+   the running thread is inside a journal operation, the running
+   journal transaction.  The journal sets aside room for each
+   operation's blocks, so the transaction is never full unless an
+   operation writes more than it may; such a block is written in
+   place as without a journal, and the overflow reported. */
+static void
+buffer_cache_write_common (block_sector_t sector, const void *memory,
+                           size_t ofs, size_t size, block_sector_t owner,
+                           bool meta)
+{
+  ASSERT (ofs + size <= fs_block_size);
+
   lock_acquire (&buffer_cache_lock);
+  /* A write of the whole block need not read it first. */
+  struct buffer_cache_entry *bce
+    = buffer_cache_get (sector, meta, size < fs_block_size);
 
-  /* Find the corresponding buffer cache */
-  int cache_id = buffer_cache_lookup_sector (sector);
-  struct buffer_cache_entry *bce;
+  /* Copy data from source memory */
+  memcpy (bce->buffer + ofs, memory, size);
+  buffer_cache_set_dirty (bce, true);
+  buffer_cache_set_meta (bce, meta);
+  bce->owner = owner;
 
-  /* Allocate a new one if not found */
-  if (cache_id == -1)
+  if (meta && !bce->journaled && journal_active ())
     {
-      cache_id = buffer_cache_allocate ();
-      ASSERT (0 <= cache_id && cache_id < BUFFER_CACHE_SIZE);
+      if (journaled_cnt < JOURNAL_TXN_MAX)
+        {
+          bce->journaled = true;
+          journaled_cnt++;
+        }
+      else
+        printf ("cache: journal transaction full, block %"PRDSNu
+                " not journaled\n", sector);
+    }
 
-      bce = &buffer_cache[cache_id];
-      ASSERT (bce->using == false);
+  lock_release (&buffer_cache_lock);
+}
 
-      /* Load data from disk sector */
-      buffer_cache_load (sector, bce);
-    }
-  else
-    bce = &buffer_cache[cache_id];
+/* Write SIZE bytes from MEMORY through cache into block SECTOR,
+   starting at byte OFS, on behalf of inode OWNER */
+void
+buffer_cache_write_at (block_sector_t sector, const void *memory,
+                       size_t ofs, size_t size, block_sector_t owner)
+{
+  buffer_cache_write_common (sector, memory, ofs, size, owner, false);
+}
 
-  /* Copy data to target memory */
-  memcpy (bce->buffer, memory, BLOCK_SECTOR_SIZE);
-  bce->dirty = true;
-  
-  /* Set access time */
-  bce->access_time = timer_ticks ();
+/* Like buffer_cache_write_at(), for a metadata block, which is
+   journaled */
+void
+buffer_cache_write_meta_at (block_sector_t sector, const void *memory,
+                            size_t ofs, size_t size, block_sector_t owner)
+{
+  buffer_cache_write_common (sector, memory, ofs, size, owner, true);
+}
 
-  lock_release (&buffer_cache_lock);
+/* Read a whole block through cache */
+void
+buffer_cache_read (block_sector_t sector, void *memory)
+{
+  buffer_cache_read_at (sector, memory, 0, fs_block_size);
+}
+
+/* Read a whole metadata block through cache */
+void
+buffer_cache_read_meta (block_sector_t sector, void *memory)
+{
+  buffer_cache_read_meta_at (sector, memory, 0, fs_block_size);
+}
+
+/* Write a whole block through cache on behalf of inode OWNER */
+void
+buffer_cache_write (block_sector_t sector, const void *memory,
+                    block_sector_t owner)
+{
+  buffer_cache_write_at (sector, memory, 0, fs_block_size, owner);
+}
+
+/* Write a whole metadata block through cache on behalf of inode
+   OWNER */
+void
+buffer_cache_write_meta (block_sector_t sector, const void *memory,
+                         block_sector_t owner)
+{
+  buffer_cache_write_meta_at (sector, memory, 0, fs_block_size, owner);
 }
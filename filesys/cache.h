@@ -3,11 +3,41 @@
 
 #include "devices/block.h"
 
+/* Owner passed when writing a block that does not belong to any
+   one inode, such as the superblock or an inode table block. */
+#define CACHE_NO_OWNER ((block_sector_t) -1)
+
 void buffer_cache_init (void);
 void buffer_cache_flush_all (void);
+void buffer_cache_flush_owner (block_sector_t owner);
+void buffer_cache_flush_block (block_sector_t);
 
 void buffer_cache_read (block_sector_t, void *);
-void buffer_cache_write (block_sector_t, void *);
+void buffer_cache_write (block_sector_t, const void *, block_sector_t owner);
+void buffer_cache_read_at (block_sector_t, void *, size_t ofs, size_t size);
+void buffer_cache_read_meta (block_sector_t, void *);
+void buffer_cache_read_meta_at (block_sector_t, void *,
+                                size_t ofs, size_t size);
+void buffer_cache_write_at (block_sector_t, const void *,
+                            size_t ofs, size_t size, block_sector_t owner);
+void buffer_cache_write_meta (block_sector_t, const void *,
+                              block_sector_t owner);
+void buffer_cache_write_meta_at (block_sector_t, const void *,
+                                 size_t ofs, size_t size,
+                                 block_sector_t owner);
+void buffer_cache_sync (block_sector_t first, size_t cnt, bool discard);
+
+void buffer_cache_read_ahead (const block_sector_t *, size_t cnt);
+void buffer_cache_prefetch (const block_sector_t *, size_t cnt);
+void buffer_cache_drop (block_sector_t);
+void buffer_cache_age (block_sector_t);
+void buffer_cache_balance_dirty (void);
+
+size_t buffer_cache_journal_collect (block_sector_t *, uint8_t *copies);
+void buffer_cache_journal_end (void);
+void buffer_cache_journal_checkpoint (const block_sector_t *,
+                                      const uint8_t *copies, size_t cnt);
+size_t buffer_cache_journal_cnt (void);
 
 void buffer_cache_period (void *);
 
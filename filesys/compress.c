@@ -0,0 +1,218 @@
+#include "filesys/compress.h"
+#include <debug.h>
+#include <string.h>
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/vaddr.h"
+
+/* Transparent compression support.
+
+   A compressed file is stored as COMPRESS_CHUNK-byte chunks, each
+   compressed separately so that any part of the file can be read
+   or rewritten without touching the rest.  On disk a chunk starts
+   with a chunk_header and is followed by its compressed bytes,
+   or, for a chunk that does not compress, its plain bytes.
+
+   Recently used chunks are kept decompressed in a small cache so
+   that a run of small reads or writes within one chunk does not
+   decompress it again each time. */
+
+/* Ways a chunk is stored. */
+enum chunk_method
+  {
+    CHUNK_ZERO,                 /* All zeros; nothing stored. */
+    CHUNK_RAW,                  /* Stored uncompressed. */
+    CHUNK_LZ                    /* Compressed with lz_compress(). */
+  };
+
+/* Header at the start of a stored chunk.  A block of zeros, as
+   allocated for a file, reads as a CHUNK_ZERO chunk. */
+struct chunk_header
+  {
+    uint16_t size;              /* Bytes stored after the header. */
+    uint8_t method;             /* A chunk_method. */
+    uint8_t unused;
+  };
+
+/* Number of decompressed chunks cached. */
+#define COMPRESS_CACHE_SIZE 8
+
+/* A cached decompressed chunk. */
+struct compress_cache_entry
+  {
+    bool using;                 /* Holds a chunk? */
+    block_sector_t inumber;     /* Inode of the file. */
+    off_t chunk;                /* Index of the chunk in the file. */
+    int64_t access;             /* Access stamp, for LRU. */
+    uint8_t *data;              /* COMPRESS_CHUNK bytes. */
+  };
+
+static struct compress_cache_entry compress_cache[COMPRESS_CACHE_SIZE];
+static struct lock compress_cache_lock;
+static int64_t access_clock;
+
+/* Initializes the decompressed chunk cache. */
+void
+compress_init (void)
+{
+  uint8_t *pages;
+
+  ASSERT (COMPRESS_CHUNK % PGSIZE == 0);
+  lock_init (&compress_cache_lock);
+  pages = palloc_get_multiple (PAL_ASSERT, COMPRESS_CACHE_SIZE
+                                           * (COMPRESS_CHUNK / PGSIZE));
+  for (int i = 0; i < COMPRESS_CACHE_SIZE; i++)
+    {
+      compress_cache[i].using = false;
+      compress_cache[i].data = pages + i * COMPRESS_CHUNK;
+    }
+}
+
+/* Encodes the COMPRESS_CHUNK bytes of PLAIN into STORED, which
+   must have room for a chunk_header and COMPRESS_CHUNK bytes,
+   using WORK, COMPRESS_WORK_SIZE bytes of scratch memory.
+   Returns the number of bytes stored. */
+size_t
+compress_encode (const void *plain, void *stored, void *work)
+{
+  struct chunk_header *h = stored;
+  uint8_t *payload = (uint8_t *) (h + 1);
+  const uint8_t *p = plain;
+  size_t size;
+
+  memset (h, 0, sizeof *h);
+  for (size = 0; size < COMPRESS_CHUNK; size++)
+    if (p[size] != 0)
+      break;
+  if (size == COMPRESS_CHUNK)
+    {
+      h->method = CHUNK_ZERO;
+      return sizeof *h;
+    }
+
+  /* Keep the compressed form only if it is smaller. */
+  size = lz_compress (plain, COMPRESS_CHUNK, payload, COMPRESS_CHUNK - 1,
+                      work);
+  if (size > 0)
+    h->method = CHUNK_LZ;
+  else
+    {
+      h->method = CHUNK_RAW;
+      size = COMPRESS_CHUNK;
+      memcpy (payload, plain, size);
+    }
+  h->size = size;
+  return sizeof *h + size;
+}
+
+/* Returns the number of bytes in the chunk stored at STORED,
+   judging from its header, which is all that needs to be
+   there. */
+size_t
+compress_stored_size (const void *stored)
+{
+  const struct chunk_header *h = stored;
+  size_t size = h->method == CHUNK_ZERO ? 0 : h->size;
+  if (size > COMPRESS_CHUNK)
+    size = COMPRESS_CHUNK;
+  return sizeof *h + size;
+}
+
+/* Decodes the chunk stored at STORED into the COMPRESS_CHUNK
+   bytes of PLAIN.  Returns false, leaving PLAIN zeroed, if the
+   chunk is corrupt. */
+bool
+compress_decode (const void *stored, void *plain)
+{
+  const struct chunk_header *h = stored;
+  const uint8_t *payload = (const uint8_t *) (h + 1);
+
+  switch (h->method)
+    {
+    case CHUNK_ZERO:
+      memset (plain, 0, COMPRESS_CHUNK);
+      return true;
+    case CHUNK_RAW:
+      if (h->size != COMPRESS_CHUNK)
+        break;
+      memcpy (plain, payload, COMPRESS_CHUNK);
+      return true;
+    case CHUNK_LZ:
+      if (h->size < COMPRESS_CHUNK
+          && lz_decompress (payload, h->size, plain, COMPRESS_CHUNK))
+        return true;
+      break;
+    }
+  memset (plain, 0, COMPRESS_CHUNK);
+  return false;
+}
+
+/* Returns the cache entry for CHUNK of inode INUMBER, or a null
+   pointer if it is not cached. */
+static struct compress_cache_entry *
+compress_cache_lookup (block_sector_t inumber, off_t chunk)
+{
+  ASSERT (lock_held_by_current_thread (&compress_cache_lock));
+
+  for (int i = 0; i < COMPRESS_CACHE_SIZE; i++)
+    {
+      struct compress_cache_entry *e = &compress_cache[i];
+      if (e->using && e->inumber == inumber && e->chunk == chunk)
+        return e;
+    }
+  return NULL;
+}
+
+/* Copies CHUNK of inode INUMBER into PLAIN if it is cached.
+   Returns true if so, false if it is not cached. */
+bool
+compress_cache_get (block_sector_t inumber, off_t chunk, void *plain)
+{
+  struct compress_cache_entry *e;
+
+  lock_acquire (&compress_cache_lock);
+  e = compress_cache_lookup (inumber, chunk);
+  if (e != NULL)
+    {
+      memcpy (plain, e->data, COMPRESS_CHUNK);
+      e->access = ++access_clock;
+    }
+  lock_release (&compress_cache_lock);
+  return e != NULL;
+}
+
+/* Caches PLAIN as the contents of CHUNK of inode INUMBER,
+   replacing the least recently used chunk if necessary. */
+void
+compress_cache_put (block_sector_t inumber, off_t chunk, const void *plain)
+{
+  struct compress_cache_entry *e;
+
+  lock_acquire (&compress_cache_lock);
+  e = compress_cache_lookup (inumber, chunk);
+  if (e == NULL)
+    {
+      e = &compress_cache[0];
+      for (int i = 0; i < COMPRESS_CACHE_SIZE && e->using; i++)
+        if (!compress_cache[i].using
+            || compress_cache[i].access < e->access)
+          e = &compress_cache[i];
+      e->using = true;
+      e->inumber = inumber;
+      e->chunk = chunk;
+    }
+  memcpy (e->data, plain, COMPRESS_CHUNK);
+  e->access = ++access_clock;
+  lock_release (&compress_cache_lock);
+}
+
+/* Drops every cached chunk of inode INUMBER. */
+void
+compress_cache_invalidate (block_sector_t inumber)
+{
+  lock_acquire (&compress_cache_lock);
+  for (int i = 0; i < COMPRESS_CACHE_SIZE; i++)
+    if (compress_cache[i].inumber == inumber)
+      compress_cache[i].using = false;
+  lock_release (&compress_cache_lock);
+}
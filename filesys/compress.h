@@ -0,0 +1,27 @@
+#ifndef FILESYS_COMPRESS_H
+#define FILESYS_COMPRESS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <lz.h>
+#include "filesys/off_t.h"
+#include "devices/block.h"
+
+/* Bytes of file data compressed together in a compressed file. */
+#define COMPRESS_CHUNK 4096
+
+/* Bytes of scratch memory that compress_encode() needs. */
+#define COMPRESS_WORK_SIZE LZ_WORK_SIZE
+
+void compress_init (void);
+
+size_t compress_encode (const void *plain, void *stored, void *work);
+size_t compress_stored_size (const void *stored);
+bool compress_decode (const void *stored, void *plain);
+
+bool compress_cache_get (block_sector_t inumber, off_t chunk, void *plain);
+void compress_cache_put (block_sector_t inumber, off_t chunk,
+                         const void *plain);
+void compress_cache_invalidate (block_sector_t inumber);
+
+#endif /* filesys/compress.h */
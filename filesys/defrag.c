@@ -0,0 +1,68 @@
+#include "filesys/defrag.h"
+#include <debug.h>
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "filesys/inode.h"
+#include "devices/timer.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+
+/* Timer ticks between background defragmentation passes. */
+#define DEFRAG_INTERVAL (60 * TIMER_FREQ)
+
+static thread_func defrag_thread NO_RETURN;
+
+/* Starts a background thread that defragments fragmented files
+   whenever nothing else wants to run. */
+void
+defrag_init (void)
+{
+  thread_create ("defrag", PRI_MIN, defrag_thread, NULL);
+}
+
+/* Walks every inode in use, other than those of the free maps,
+   and moves the data of each one whose blocks are not consecutive
+   into a single run.  file_lock is held for one inode at a time,
+   so other file system users can get in between.
+   Returns the number of inodes moved. */
+size_t
+defrag_pass (void)
+{
+  block_sector_t inumber = 0;
+  size_t moved = 0;
+
+  for (;;)
+    {
+      lock_acquire (&file_lock);
+      if (!free_map_next_inode (&inumber))
+        {
+          lock_release (&file_lock);
+          break;
+        }
+      if (inumber != FREE_MAP_INODE && inumber != INODE_MAP_INODE
+          && inumber != REFCOUNT_INODE)
+        {
+          struct inode *inode = inode_open (inumber);
+          if (inode != NULL)
+            {
+              if (inode_fragments (inode) > 1 && inode_defragment (inode))
+                moved++;
+              inode_close (inode);
+            }
+        }
+      lock_release (&file_lock);
+      inumber++;
+    }
+  return moved;
+}
+
+/* Background defragmentation thread. */
+static void
+defrag_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      defrag_pass ();
+      timer_sleep (DEFRAG_INTERVAL);
+    }
+}
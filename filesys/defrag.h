@@ -0,0 +1,9 @@
+#ifndef FILESYS_DEFRAG_H
+#define FILESYS_DEFRAG_H
+
+#include <stddef.h>
+
+void defrag_init (void);
+size_t defrag_pass (void);
+
+#endif /* filesys/defrag.h */
@@ -14,16 +14,9 @@ struct dir
     off_t pos;                          /* Current position. */
   };
 
-/* A single directory entry. */
-struct dir_entry 
-  {
-    block_sector_t inode_sector;        /* Sector number of header. */
-    char name[NAME_MAX + 1];            /* Null terminated file name. */
-    bool in_use;                        /* In use or free? */
-  };
-
 /* Creates a directory with space for ENTRY_CNT entries in the
-   given SECTOR.  Returns true if successful, false on failure. */
+   inode numbered SECTOR.  Returns true if successful, false on
+   failure. */
 bool
 dir_create (block_sector_t sector, size_t entry_cnt)
 {
@@ -66,7 +59,7 @@ dir_open (struct inode *inode)
 struct dir *
 dir_open_root (void)
 {
-  return dir_open (inode_open (ROOT_DIR_SECTOR));
+  return dir_open (inode_open (ROOT_DIR_INODE));
 }
 
 /* Opens the directory of the input path and returns a struct
@@ -3,14 +3,9 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include "filesys/ondisk.h"
 #include "devices/block.h"
 
-/* Maximum length of a file name component.
-   This is the traditional UNIX maximum length.
-   After directories are implemented, this maximum length may be
-   retained, but much longer full path names must be allowed. */
-#define NAME_MAX 14
-
 struct inode;
 
 /* Opening and closing directories. */
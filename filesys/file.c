@@ -1,5 +1,6 @@
 #include "filesys/file.h"
 #include <debug.h>
+#include <uio.h>
 #include "filesys/inode.h"
 #include "threads/malloc.h"
 
@@ -9,6 +10,7 @@ struct file
     struct inode *inode;        /* File's inode. */
     off_t pos;                  /* Current position. */
     bool deny_write;            /* Has file_deny_write() been called? */
+    bool direct;                /* Bypass the buffer cache? */
   };
 
 /* Opens a file for the given INODE, of which it takes ownership,
@@ -23,6 +25,7 @@ file_open (struct inode *inode)
       file->inode = inode;
       file->pos = 0;
       file->deny_write = false;
+      file->direct = false;
       return file;
     }
   else
@@ -33,12 +36,16 @@ file_open (struct inode *inode)
     }
 }
 
-/* Opens and returns a new file for the same inode as FILE.
-   Returns a null pointer if unsuccessful. */
+/* Opens and returns a new file for the same inode as FILE, in
+   the same direct I/O mode.  Returns a null pointer if
+   unsuccessful. */
 struct file *
 file_reopen (struct file *file) 
 {
-  return file_open (inode_reopen (file->inode));
+  struct file *copy = file_open (inode_reopen (file->inode));
+  if (copy != NULL)
+    copy->direct = file->direct;
+  return copy;
 }
 
 /* Closes FILE. */
@@ -68,7 +75,7 @@ file_get_inode (struct file *file)
 off_t
 file_read (struct file *file, void *buffer, off_t size) 
 {
-  off_t bytes_read = inode_read_at (file->inode, buffer, size, file->pos);
+  off_t bytes_read = file_read_at (file, buffer, size, file->pos);
   file->pos += bytes_read;
   return bytes_read;
 }
@@ -81,6 +88,8 @@ file_read (struct file *file, void *buffer, off_t size)
 off_t
 file_read_at (struct file *file, void *buffer, off_t size, off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_read_direct (file->inode, buffer, size, file_ofs);
   return inode_read_at (file->inode, buffer, size, file_ofs);
 }
 
@@ -98,8 +107,7 @@ file_write (struct file *file, const void *buffer, off_t size)
   if (inode_is_dir (file->inode))
     return -1;
   
-  off_t bytes_written = inode_write_at 
-    (file->inode, buffer, size, file->pos);
+  off_t bytes_written = file_write_at (file, buffer, size, file->pos);
   file->pos += bytes_written;
   return bytes_written;
 }
@@ -115,9 +123,128 @@ off_t
 file_write_at (struct file *file, const void *buffer, off_t size,
                off_t file_ofs) 
 {
+  if (file->direct)
+    return inode_write_direct (file->inode, buffer, size, file_ofs);
   return inode_write_at (file->inode, buffer, size, file_ofs);
 }
 
+/* Reads into the IOVCNT buffers in IOV, in order, from FILE,
+   starting at the file's current position, as if by one
+   file_read() into their concatenation.
+   Returns the number of bytes actually read, which may be less
+   than their total size if end of file is reached.
+   Advances FILE's position by the number of bytes read. */
+off_t
+file_readv (struct file *file, const struct iovec *iov, int iovcnt)
+{
+  off_t bytes_read = 0;
+  int i;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      off_t n = file_read (file, iov[i].iov_base, iov[i].iov_len);
+      bytes_read += n;
+      if (n < (off_t) iov[i].iov_len)
+        break;
+    }
+  return bytes_read;
+}
+
+/* Writes the IOVCNT buffers in IOV, in order, to FILE, starting
+   at the file's current position, as if by one file_write() of
+   their concatenation.  The file is extended, if necessary, once
+   for the whole write.
+   Returns the number of bytes actually written, which is 0 if
+   writes to FILE are denied, or -1 if FILE is a directory.
+   Advances FILE's position by the number of bytes written. */
+off_t
+file_writev (struct file *file, const struct iovec *iov, int iovcnt)
+{
+  off_t total = 0, bytes_written = 0;
+  int i;
+
+  if (inode_is_dir (file->inode))
+    return -1;
+
+  for (i = 0; i < iovcnt; i++)
+    total += iov[i].iov_len;
+  if (total > 0 && !inode_extend (file->inode, file->pos,
+                                   file->pos + total))
+    return 0;
+
+  for (i = 0; i < iovcnt; i++)
+    {
+      off_t n = file_write (file, iov[i].iov_base, iov[i].iov_len);
+      bytes_written += n;
+      if (n < (off_t) iov[i].iov_len)
+        break;
+    }
+  return bytes_written;
+}
+
+/* Sets whether reads and writes through FILE bypass the buffer
+   cache.  Only whole file system blocks are transferred directly;
+   partial blocks still go through the cache. */
+void
+file_set_direct (struct file *file, bool direct)
+{
+  ASSERT (file != NULL);
+  file->direct = direct;
+}
+
+/* Writes FILE's dirty data to disk and waits for it, along with
+   its metadata, or, if DATA_ONLY is true, just the metadata
+   needed to read the data back. */
+void
+file_sync (struct file *file, bool data_only)
+{
+  ASSERT (file != NULL);
+  inode_sync (file->inode, data_only);
+}
+
+/* Applies ADVICE, one of the FADV_* values, about how the LEN
+   bytes of FILE starting at OFFSET will be accessed.  Returns
+   false if ADVICE is not a known value. */
+bool
+file_advise (struct file *file, int advice, off_t offset, off_t len)
+{
+  ASSERT (file != NULL);
+  return inode_advise (file->inode, advice, offset, len);
+}
+
+/* Gives FILE blocks for its first LENGTH bytes up front, without
+   clearing them or changing its length, for a caller that is
+   about to write all of them.  They hold no readable data until
+   written.  Returns true if successful, false if disk space is
+   short. */
+bool
+file_preallocate (struct file *file, off_t length)
+{
+  ASSERT (file != NULL);
+  return inode_preallocate (file->inode, length);
+}
+
+/* Moves FILE's data into consecutive blocks.  Returns true if
+   successful, false if there is not enough free space in one run
+   or memory is short. */
+bool
+file_defragment (struct file *file)
+{
+  ASSERT (file != NULL);
+  return inode_defragment (file->inode);
+}
+
+/* Makes FILE keep its data compressed if COMPRESSED is true, or
+   plainly otherwise.  Returns true if successful, false if FILE
+   is not an empty regular file or the file system's blocks are
+   too large for compression to save space. */
+bool
+file_set_compressed (struct file *file, bool compressed)
+{
+  ASSERT (file != NULL);
+  return inode_set_compressed (file->inode, compressed);
+}
+
 /* Prevents write operations on FILE's underlying inode
    until file_allow_write() is called or FILE is closed. */
 void
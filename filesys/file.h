@@ -1,9 +1,11 @@
 #ifndef FILESYS_FILE_H
 #define FILESYS_FILE_H
 
+#include <stdbool.h>
 #include "filesys/off_t.h"
 
 struct inode;
+struct iovec;
 
 /* Opening and closing files. */
 struct file *file_open (struct inode *);
@@ -16,6 +18,26 @@ off_t file_read (struct file *, void *, off_t);
 off_t file_read_at (struct file *, void *, off_t size, off_t start);
 off_t file_write (struct file *, const void *, off_t);
 off_t file_write_at (struct file *, const void *, off_t size, off_t start);
+off_t file_readv (struct file *, const struct iovec *, int iovcnt);
+off_t file_writev (struct file *, const struct iovec *, int iovcnt);
+
+/* Bypassing the buffer cache. */
+void file_set_direct (struct file *, bool);
+
+/* Durability. */
+void file_sync (struct file *, bool data_only);
+
+/* Access-pattern hints. */
+bool file_advise (struct file *, int advice, off_t offset, off_t len);
+
+/* Preallocation. */
+bool file_preallocate (struct file *, off_t length);
+
+/* Defragmentation. */
+bool file_defragment (struct file *);
+
+/* Compression. */
+bool file_set_compressed (struct file *, bool);
 
 /* Preventing writes. */
 void file_deny_write (struct file *);
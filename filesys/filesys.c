@@ -1,5 +1,7 @@
 #include "filesys/filesys.h"
 #include <debug.h>
+#include <round.h>
+#include <statfs.h>
 #include <stdio.h>
 #include <string.h>
 #include "threads/malloc.h"
@@ -8,40 +10,114 @@
 #include "filesys/inode.h"
 #include "filesys/directory.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
+#include "filesys/journal.h"
 
 /* Partition that contains the file system. */
 struct block *fs_device;
 
+/* Size of a file system block, in bytes and in device sectors. */
+size_t fs_block_size = BLOCK_SECTOR_SIZE;
+size_t fs_block_sectors = 1;
+
+/* Leave the file system unclean at shutdown? */
+bool fs_crash;
+
+/* In-memory copy of the superblock. */
+static struct super_block super;
+
 static void do_format (void);
+static void super_block_layout (void);
+static void super_block_read (void);
+static void super_block_write (bool clean);
+static bool block_size_valid (size_t);
 
 /* Initializes the file system module.
-   If FORMAT is true, reformats the file system. */
+   If FORMAT is true, reformats the file system with blocks of
+   BLOCK_SIZE bytes.  Otherwise, the block size recorded in the
+   superblock is used and BLOCK_SIZE is ignored. */
 void
-filesys_init (bool format) 
+filesys_init (bool format, size_t block_size) 
 {
   fs_device = block_get_role (BLOCK_FILESYS);
   if (fs_device == NULL)
     PANIC ("No file system device found, can't initialize file system.");
 
-  inode_init ();
-  free_map_init ();
+  if (format)
+    {
+      if (!block_size_valid (block_size))
+        PANIC ("Unsupported file system block size %zu.", block_size);
+      fs_block_size = block_size;
+      fs_block_sectors = fs_block_size / BLOCK_SECTOR_SIZE;
+      super_block_layout ();
+    }
+  else
+    {
+      super_block_read ();
+      fs_block_sectors = fs_block_size / BLOCK_SECTOR_SIZE;
+      if (!super.clean)
+        printf ("filesys: %s was not cleanly unmounted.\n",
+                block_name (fs_device));
+    }
+
+  inode_init (super.inode_table, super.inode_cnt);
+  free_map_init (super.data_start, super.inode_cnt);
   buffer_cache_init ();
+  compress_init ();
+  journal_init (super.journal_start, super.journal_cnt, format);
 
   if (format) 
     do_format ();
 
-  free_map_open ();
+  free_map_open (&super);
+  if (!format)
+    printf ("filesys: %zu blocks and %zu inodes free.\n",
+            free_map_free_blocks (), free_map_free_inodes ());
+
+  /* Until filesys_done(), a crash leaves the file system unclean. */
+  super_block_write (false);
 }
 
 /* Shuts down the file system module, writing any unwritten data
-   to disk. */
+   to disk, and then marks the file system clean.  If fs_crash is
+   true, writes nothing, as if the machine had crashed. */
 void
 filesys_done (void) 
 {
+  if (fs_crash)
+    {
+      printf ("Leaving file system as after a crash.\n");
+      return;
+    }
   free_map_close ();
+  journal_commit ();
+  journal_checkpoint ();
   buffer_cache_flush_all ();
+  super_block_write (true);
+}
+
+/* Stores a summary of the file system into *ST. */
+void
+filesys_statfs (struct statfs *st)
+{
+  st->block_size = fs_block_size;
+  st->block_cnt = filesys_block_cnt ();
+  st->free_blocks = free_map_free_blocks ();
+  st->inode_cnt = super.inode_cnt;
+  st->free_inodes = free_map_free_inodes ();
 }
 
+/* Returns the number of file system blocks.  An image built on
+   the host may fill less than the whole of fs_device, in which
+   case the superblock records its size. */
+block_sector_t
+filesys_block_cnt (void)
+{
+  if (super.block_cnt != 0)
+    return super.block_cnt;
+  return block_size (fs_device) / fs_block_sectors;
+}
+
 /* Creates a file named NAME with the given INITIAL_SIZE.
    Returns true if successful, false otherwise.
    Fails if a file named NAME already exists,
@@ -57,14 +133,16 @@ filesys_create (const char *name, off_t initial_size, bool is_dir)
   /* split path to fine directory and file name */
   split_path (name, directory, file_name);
 
+  journal_begin ();
   struct dir *dir = dir_open_path (directory);
   bool success = (dir != NULL
-                  && free_map_allocate (1, &inode_sector)
+                  && free_map_allocate_inode (&inode_sector)
                   && inode_create (inode_sector, initial_size, is_dir)
                   && dir_add (dir, file_name, inode_sector, is_dir));
   if (!success && inode_sector != 0) 
-    free_map_release (inode_sector, 1);
+    free_map_release_inode (inode_sector);
   dir_close (dir);
+  journal_end ();
   return success;
 }
 
@@ -123,20 +201,147 @@ filesys_remove (const char *name)
 
   /* split path to fine directory and file name */
   split_path (name, directory, file_name);
+  journal_begin ();
   struct dir *dir = dir_open_path (directory);
   bool success = dir != NULL && dir_remove (dir, file_name);
   dir_close (dir); 
+  journal_end ();
 
   return success;
 }
 
+/* Creates a file named NEW_NAME that is a clone of the regular
+   file named NAME: it has the same contents but, until one of
+   them is written, shares its blocks, so that cloning costs only
+   the new file's inode and indirect blocks.
+   Returns true if successful, false otherwise.
+   Fails if NAME does not exist or is a directory, if NEW_NAME
+   already exists, or if an internal allocation fails. */
+bool
+filesys_clone (const char *name, const char *new_name)
+{
+  block_sector_t inode_sector = 0;
+  int name_length = strlen (new_name);
+  char directory[name_length + 1];
+  char file_name[name_length + 1];
+  struct file *file;
+  struct dir *dir;
+  bool cloned = false, success;
+
+  file = filesys_open (name);
+  if (file == NULL || inode_is_dir (file_get_inode (file)))
+    {
+      file_close (file);
+      return false;
+    }
+
+  /* split path to fine directory and file name */
+  split_path (new_name, directory, file_name);
+
+  journal_begin ();
+  dir = dir_open_path (directory);
+  success = (dir != NULL
+             && free_map_allocate_inode (&inode_sector)
+             && (cloned = inode_clone (file_get_inode (file), inode_sector))
+             && dir_add (dir, file_name, inode_sector, false));
+  if (!success && cloned)
+    {
+      /* Dropping the clone drops its references, too. */
+      struct inode *inode = inode_open (inode_sector);
+      inode_remove (inode);
+      inode_close (inode);
+    }
+  else if (!success && inode_sector != 0)
+    free_map_release_inode (inode_sector);
+  dir_close (dir);
+  journal_end ();
+  file_close (file);
+  return success;
+}
+
+/* Returns true if SIZE is a supported file system block size:
+   a power of two between FS_BLOCK_SIZE_MIN and FS_BLOCK_SIZE_MAX. */
+static bool
+block_size_valid (size_t size)
+{
+  return (size >= FS_BLOCK_SIZE_MIN && size <= FS_BLOCK_SIZE_MAX
+          && (size & (size - 1)) == 0);
+}
+
+/* Lays out a new file system filling fs_device in the in-memory
+   superblock. */
+static void
+super_block_layout (void)
+{
+  block_sector_t block_cnt = block_size (fs_device) / fs_block_sectors;
+
+  ASSERT (sizeof super == BLOCK_SECTOR_SIZE);
+  if (!super_block_init (&super, block_cnt, fs_block_size))
+    PANIC ("%s is too small for a file system.", block_name (fs_device));
+}
+
+/* Reads the superblock directly from fs_device and sets the file
+   system block size from it.  Panics if the device does not
+   contain a file system. */
+static void
+super_block_read (void)
+{
+  block_read (fs_device, SUPER_BLOCK, &super);
+  if (super.magic != SUPER_MAGIC)
+    PANIC ("No file system found on %s (format with -f).",
+           block_name (fs_device));
+  if (!block_size_valid (super.block_size))
+    PANIC ("Bad file system block size %"PRIu32".", super.block_size);
+  fs_block_size = super.block_size;
+  if ((uint64_t) super.block_cnt * (fs_block_size / BLOCK_SECTOR_SIZE)
+      > block_size (fs_device))
+    PANIC ("File system of %"PRIu32" blocks does not fit on %s.",
+           super.block_cnt, block_name (fs_device));
+  if (super.version > SUPER_VERSION)
+    PANIC ("File system version %"PRIu32" is newer than this kernel.",
+           super.version);
+
+  /* An older superblock has no summary.  It is upgraded when it is
+     written back. */
+  if (super.version < SUPER_VERSION)
+    {
+      super.version = SUPER_VERSION;
+      super.clean = 0;
+    }
+}
+
+/* Marks the file system clean if CLEAN is true, along with the
+   free counts and allocation hints that a clean mount trusts, or
+   unclean otherwise, and writes the superblock to disk. */
+static void
+super_block_write (bool clean)
+{
+  super.clean = clean;
+  if (clean)
+    free_map_summarize (&super);
+  buffer_cache_write_at (SUPER_BLOCK, &super, 0, sizeof super,
+                         CACHE_NO_OWNER);
+  buffer_cache_flush_block (SUPER_BLOCK);
+}
+
 /* Formats the file system. */
 static void
 do_format (void)
 {
+  static char zeros[FS_BLOCK_SIZE_MAX];
+  block_sector_t block;
+
   printf ("Formatting file system...");
+
+  /* Write superblock and clear the inode table.  The journal,
+     which follows it, was already cleared by journal_init(). */
+  buffer_cache_write_at (SUPER_BLOCK, &super, 0, sizeof super,
+                         CACHE_NO_OWNER);
+  for (block = super.inode_table; block < super.journal_start; block++)
+    buffer_cache_write (block, zeros, CACHE_NO_OWNER);
+
   free_map_create ();
-  if (!dir_create (ROOT_DIR_SECTOR, 16))
+  if (!dir_create (ROOT_DIR_INODE, 16))
     PANIC ("root directory creation failed");
   free_map_close ();
   printf ("done.\n");
@@ -2,20 +2,37 @@
 #define FILESYS_FILESYS_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include "filesys/off_t.h"
+#include "filesys/ondisk.h"
+#include "devices/block.h"
 
-/* Sectors of system file inodes. */
-#define FREE_MAP_SECTOR 0       /* Free map file inode sector. */
-#define ROOT_DIR_SECTOR 1       /* Root directory file inode sector. */
+struct statfs;
+
+/* Within the file system, block_sector_t values number file
+   system blocks of fs_block_size bytes each, not device sectors.
+   Block N occupies device sectors N * fs_block_sectors through
+   (N + 1) * fs_block_sectors - 1. */
 
 /* Block device that contains the file system. */
 extern struct block *fs_device;
 
-void filesys_init (bool format);
+/* Size of a file system block in bytes and in device sectors. */
+extern size_t fs_block_size;
+extern size_t fs_block_sectors;
+
+/* If true, filesys_done() leaves the file system as a crash
+   would, so that recovery can be tested. */
+extern bool fs_crash;
+
+void filesys_init (bool format, size_t block_size);
 void filesys_done (void);
 bool filesys_create (const char *name, off_t initial_size, bool is_dir);
 struct file *filesys_open (const char *name);
 bool filesys_remove (const char *name);
+bool filesys_clone (const char *name, const char *new_name);
+block_sector_t filesys_block_cnt (void);
+void filesys_statfs (struct statfs *);
 
 /* split the path */
 void split_path (const char* path, char *dir, char *name);
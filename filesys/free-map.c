@@ -1,85 +1,465 @@
 #include "filesys/free-map.h"
 #include <bitmap.h>
 #include <debug.h>
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
 #include "filesys/file.h"
 #include "filesys/filesys.h"
 #include "filesys/inode.h"
+#include "filesys/journal.h"
+#include "filesys/ondisk.h"
+#include "threads/malloc.h"
 
 static struct file *free_map_file;   /* Free map file. */
-static struct bitmap *free_map;      /* Free map, one bit per sector. */
+static struct bitmap *free_map;      /* Free map, one bit per block. */
 
-/* Initializes the free map. */
+static struct file *inode_map_file;  /* Inode map file. */
+static struct bitmap *inode_map;     /* Inode map, one bit per inode. */
+
+/* Blocks shared between files by cloning carry a count of the
+   references to them beyond the first, one byte per block, kept
+   in the reference count file.  A block with a nonzero count is
+   not freed when released, just has its count dropped. */
+static struct file *refcount_file;   /* Reference count file. */
+static uint8_t *refcounts;           /* Extra references per block. */
+
+/* Changes to the free map are written to its file a few bytes at
+   a time, so that each touches only one or two blocks of metadata.
+   While a batch is open, the bits changed are only noted, as long
+   as they all fall in one block of the file, and written together
+   when the batch ends or a change falls in another block. */
+static int batch_depth;              /* Nesting depth of batches. */
+static size_t batch_start;           /* First bit changed in batch. */
+static size_t batch_end;             /* Bit after last bit changed. */
+
+/* Free counts, kept up to date so that they can be reported
+   without counting the maps, and allocation hints, below which
+   the maps have no free bit, so that searches need not start at
+   the beginning.  All are saved in the superblock by a clean
+   unmount. */
+static size_t free_block_cnt;        /* Free blocks. */
+static size_t free_inode_cnt;        /* Free inodes. */
+static size_t block_hint;            /* No free block below this. */
+static size_t inode_hint;            /* No free inode below this. */
+
+/* A block released inside a journal operation is marked free in
+   the free map at once, so that the transaction frees it, but is
+   not handed out again until that transaction has committed and
+   been checkpointed.  Until it commits, a crash leaves the block
+   in use by the metadata that pointed to it, so new data must not
+   land on it; until it is checkpointed, recovery may write an old
+   copy of it in place.  Such blocks are held in held_running
+   until the running transaction commits, then in held_committed
+   until it is checkpointed. */
+static struct bitmap *held_running;  /* Released in running txn. */
+static struct bitmap *held_committed; /* Released in committed txn. */
+static size_t held_running_cnt;      /* Bits set in held_running. */
+static size_t held_committed_cnt;    /* Bits set in held_committed. */
+
+static void refcount_write (block_sector_t);
+static bool free_map_write (size_t start, size_t cnt);
+static size_t free_map_scan (size_t cnt);
+
+/* Initializes the free map and the inode map.  Blocks before
+   DATA_START hold the superblock and inode table and are never
+   handed out; the inode table holds INODE_CNT inodes. */
 void
-free_map_init (void) 
+free_map_init (block_sector_t data_start, size_t inode_cnt) 
 {
-  free_map = bitmap_create (block_size (fs_device));
+  free_map = bitmap_create (filesys_block_cnt ());
   if (free_map == NULL)
     PANIC ("bitmap creation failed--file system device is too large");
-  bitmap_mark (free_map, FREE_MAP_SECTOR);
-  bitmap_mark (free_map, ROOT_DIR_SECTOR);
+  bitmap_set_multiple (free_map, 0, data_start, true);
+  held_running = bitmap_create (bitmap_size (free_map));
+  held_committed = bitmap_create (bitmap_size (free_map));
+  if (held_running == NULL || held_committed == NULL)
+    PANIC ("bitmap creation failed--file system device is too large");
+
+  inode_map = bitmap_create (inode_cnt);
+  if (inode_map == NULL)
+    PANIC ("bitmap creation failed--too many inodes");
+  bitmap_mark (inode_map, FREE_MAP_INODE);
+  bitmap_mark (inode_map, ROOT_DIR_INODE);
+  bitmap_mark (inode_map, INODE_MAP_INODE);
+  bitmap_mark (inode_map, REFCOUNT_INODE);
+
+  free_block_cnt = bitmap_size (free_map) - data_start;
+  free_inode_cnt = inode_cnt - (REFCOUNT_INODE + 1);
+  block_hint = data_start;
+  inode_hint = REFCOUNT_INODE + 1;
+
+  refcounts = malloc (filesys_block_cnt ());
+  if (refcounts == NULL)
+    PANIC ("reference count creation failed--file system device is too "
+           "large");
+  memset (refcounts, 0, filesys_block_cnt ());
 }
 
-/* Allocates CNT consecutive sectors from the free map and stores
+/* Allocates CNT consecutive blocks from the free map and stores
    the first into *SECTORP.
    Returns true if successful, false if not enough consecutive
-   sectors were available or if the free_map file could not be
+   blocks were available or if the free_map file could not be
    written. */
 bool
 free_map_allocate (size_t cnt, block_sector_t *sectorp)
 {
-  block_sector_t sector = bitmap_scan_and_flip (free_map, 0, cnt, false);
-  if (sector != BITMAP_ERROR
-      && free_map_file != NULL
-      && !bitmap_write (free_map, free_map_file))
+  block_sector_t sector = free_map_scan (cnt);
+  if (sector != BITMAP_ERROR)
+    bitmap_set_multiple (free_map, sector, cnt, true);
+  if (sector != BITMAP_ERROR && !free_map_write (sector, cnt))
     {
       bitmap_set_multiple (free_map, sector, cnt, false); 
       sector = BITMAP_ERROR;
     }
   if (sector != BITMAP_ERROR)
-    *sectorp = sector;
+    {
+      free_block_cnt -= cnt;
+      if (sector == block_hint)
+        block_hint = sector + cnt;
+      *sectorp = sector;
+    }
   return sector != BITMAP_ERROR;
 }
 
-/* Makes CNT sectors starting at SECTOR available for use. */
+/* Returns the first of CNT consecutive free blocks, none of them
+   held, at or after the allocation hint, or BITMAP_ERROR if there
+   are none. */
+static size_t
+free_map_scan (size_t cnt)
+{
+  size_t start = block_hint;
+
+  for (;;)
+    {
+      size_t sector = bitmap_scan (free_map, start, cnt, false);
+      if (sector == BITMAP_ERROR
+          || ((held_running_cnt == 0
+               || !bitmap_any (held_running, sector, cnt))
+              && (held_committed_cnt == 0
+                  || !bitmap_any (held_committed, sector, cnt))))
+        return sector;
+      start = sector + 1;
+    }
+}
+
+/* Makes CNT blocks starting at SECTOR available for use, except
+   that a block still shared with another file just loses one
+   reference.  Inside a journal operation, the blocks are held
+   until its transaction is checkpointed. */
 void
 free_map_release (block_sector_t sector, size_t cnt)
 {
+  bool hold = journal_active ();
+
   ASSERT (bitmap_all (free_map, sector, cnt));
-  bitmap_set_multiple (free_map, sector, cnt, false);
-  bitmap_write (free_map, free_map_file);
+  for (size_t i = 0; i < cnt; i++)
+    if (refcounts[sector + i] > 0)
+      {
+        refcounts[sector + i]--;
+        refcount_write (sector + i);
+      }
+    else
+      {
+        bitmap_reset (free_map, sector + i);
+        free_block_cnt++;
+        if (sector + i < block_hint)
+          block_hint = sector + i;
+        if (hold)
+          {
+            bitmap_mark (held_running, sector + i);
+            held_running_cnt++;
+          }
+      }
+  free_map_write (sector, cnt);
+}
+
+/* Called by the journal when the running transaction has been
+   committed, after the one before it was checkpointed: the blocks
+   released in it are held until it is checkpointed, too. */
+void
+free_map_commit (void)
+{
+  struct bitmap *empty = held_committed;
+
+  ASSERT (held_committed_cnt == 0);
+  held_committed = held_running;
+  held_committed_cnt = held_running_cnt;
+  held_running = empty;
+  held_running_cnt = 0;
+}
+
+/* Called by the journal when the committed transaction has been
+   checkpointed: the blocks released in it may be handed out
+   again. */
+void
+free_map_checkpoint (void)
+{
+  if (held_committed_cnt > 0)
+    {
+      bitmap_set_all (held_committed, false);
+      held_committed_cnt = 0;
+    }
+}
+
+/* Starts a batch of free map changes, such as allocating all the
+   blocks of a new file, so that each block of the free map file
+   is written once for the whole batch rather than once per
+   change.  Batches nest; each must be ended by
+   free_map_batch_end(). */
+void
+free_map_batch_begin (void)
+{
+  batch_depth++;
+}
+
+/* Ends a batch started by free_map_batch_begin(), writing the
+   changes noted in it if it is the outermost batch. */
+void
+free_map_batch_end (void)
+{
+  ASSERT (batch_depth > 0);
+  if (--batch_depth == 0)
+    free_map_batch_flush ();
+}
+
+/* Writes the changes noted in the open batch, if any, to the free
+   map file now, as before a journal operation goes on in a new
+   transaction, which must not commit blocks whose allocation is
+   not yet written.  The batch stays open. */
+bool
+free_map_batch_flush (void)
+{
+  size_t start = batch_start, cnt = batch_end - batch_start;
+
+  batch_start = batch_end = 0;
+  return bitmap_write_range (free_map, free_map_file, start, cnt);
+}
+
+/* Writes the CNT bits of the free map starting at START to its
+   file, if it is open, or, inside a batch, notes that they must
+   be written.  Returns false if a write fails. */
+static bool
+free_map_write (size_t start, size_t cnt)
+{
+  const size_t block_bits = fs_block_size * CHAR_BIT;
+  size_t end = start + cnt;
+
+  if (free_map_file == NULL)
+    return true;
+  if (batch_depth == 0)
+    return bitmap_write_range (free_map, free_map_file, start, cnt);
+
+  if (batch_start != batch_end)
+    {
+      size_t first = batch_start < start ? batch_start : start;
+      size_t last = batch_end > end ? batch_end : end;
+
+      /* Take in the noted bits unless that spans two blocks of
+         the file, in which case write them first. */
+      if (first / block_bits == (last - 1) / block_bits)
+        {
+          start = first;
+          end = last;
+        }
+      else if (!free_map_batch_flush ())
+        return false;
+    }
+  batch_start = start;
+  batch_end = end;
+  return true;
+}
+
+/* Adds a reference to block SECTOR, which is in use, so that it
+   can be shared by one more file.  Returns true if successful,
+   false if the block already has as many references as can be
+   counted. */
+bool
+free_map_share (block_sector_t sector)
+{
+  ASSERT (bitmap_test (free_map, sector));
+  if (refcounts[sector] == UINT8_MAX)
+    return false;
+  refcounts[sector]++;
+  refcount_write (sector);
+  return true;
+}
+
+/* Returns true if block SECTOR is shared by more than one file. */
+bool
+free_map_shared (block_sector_t sector)
+{
+  return refcounts[sector] > 0;
+}
+
+/* Writes the reference count of block SECTOR to the reference
+   count file. */
+static void
+refcount_write (block_sector_t sector)
+{
+  ASSERT (refcount_file != NULL);
+  file_write_at (refcount_file, &refcounts[sector], 1, sector);
+}
+
+/* Allocates a free inode and stores its number into *INUMBERP.
+   Returns true if successful, false if all inodes are in use or
+   if the inode map file could not be written. */
+bool
+free_map_allocate_inode (block_sector_t *inumberp)
+{
+  size_t inumber = bitmap_scan_and_flip (inode_map, inode_hint, 1, false);
+  if (inumber != BITMAP_ERROR
+      && inode_map_file != NULL
+      && !bitmap_write_range (inode_map, inode_map_file, inumber, 1))
+    {
+      bitmap_reset (inode_map, inumber);
+      inumber = BITMAP_ERROR;
+    }
+  if (inumber != BITMAP_ERROR)
+    {
+      free_inode_cnt--;
+      inode_hint = inumber + 1;
+      *inumberp = inumber;
+    }
+  return inumber != BITMAP_ERROR;
+}
+
+/* Makes inode INUMBER available for use. */
+void
+free_map_release_inode (block_sector_t inumber)
+{
+  ASSERT (bitmap_test (inode_map, inumber));
+  bitmap_reset (inode_map, inumber);
+  free_inode_cnt++;
+  if (inumber < inode_hint)
+    inode_hint = inumber;
+  bitmap_write_range (inode_map, inode_map_file, inumber, 1);
 }
 
-/* Opens the free map file and reads it from disk. */
+/* Finds the lowest-numbered inode in use that is numbered
+   *INUMBERP or higher and stores its number into *INUMBERP.
+   Returns true if successful, false if there is no such inode. */
+bool
+free_map_next_inode (block_sector_t *inumberp)
+{
+  size_t inumber;
+
+  if (*inumberp >= bitmap_size (inode_map))
+    return false;
+  inumber = bitmap_scan (inode_map, *inumberp, 1, true);
+  if (inumber != BITMAP_ERROR)
+    *inumberp = inumber;
+  return inumber != BITMAP_ERROR;
+}
+
+/* Opens the free map and inode map files and reads them from
+   disk.  If SUPER was written by a clean unmount, takes the free
+   counts and allocation hints from it; otherwise counts them. */
 void
-free_map_open (void) 
+free_map_open (const struct super_block *super) 
 {
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  free_map_file = file_open (inode_open (FREE_MAP_INODE));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_read (free_map, free_map_file))
     PANIC ("can't read free map");
+
+  inode_map_file = file_open (inode_open (INODE_MAP_INODE));
+  if (inode_map_file == NULL)
+    PANIC ("can't open inode map");
+  if (!bitmap_read (inode_map, inode_map_file))
+    PANIC ("can't read inode map");
+
+  refcount_file = file_open (inode_open (REFCOUNT_INODE));
+  if (refcount_file == NULL)
+    PANIC ("can't open reference counts");
+  if (file_read_at (refcount_file, refcounts, filesys_block_cnt (), 0)
+      != (off_t) filesys_block_cnt ())
+    PANIC ("can't read reference counts");
+
+  if (super->clean
+      && super->free_blocks <= bitmap_size (free_map)
+      && super->free_inodes <= bitmap_size (inode_map)
+      && super->block_hint <= bitmap_size (free_map)
+      && super->inode_hint <= bitmap_size (inode_map))
+    {
+      free_block_cnt = super->free_blocks;
+      free_inode_cnt = super->free_inodes;
+      block_hint = super->block_hint;
+      inode_hint = super->inode_hint;
+    }
+  else
+    {
+      free_block_cnt = bitmap_count (free_map, 0, bitmap_size (free_map),
+                                     false);
+      free_inode_cnt = bitmap_count (inode_map, 0, bitmap_size (inode_map),
+                                     false);
+      block_hint = inode_hint = 0;
+    }
 }
 
-/* Writes the free map to disk and closes the free map file. */
+/* Stores the free counts and allocation hints into SUPER. */
+void
+free_map_summarize (struct super_block *super)
+{
+  super->free_blocks = free_block_cnt;
+  super->free_inodes = free_inode_cnt;
+  super->block_hint = block_hint;
+  super->inode_hint = inode_hint;
+}
+
+/* Returns the number of free blocks. */
+size_t
+free_map_free_blocks (void)
+{
+  return free_block_cnt;
+}
+
+/* Returns the number of free inodes. */
+size_t
+free_map_free_inodes (void)
+{
+  return free_inode_cnt;
+}
+
+/* Writes the free map, inode map and reference counts to disk and
+   closes their files. */
 void
 free_map_close (void) 
 {
+  file_close (refcount_file);
+  file_close (inode_map_file);
   file_close (free_map_file);
 }
 
-/* Creates a new free map file on disk and writes the free map to
-   it. */
+/* Creates new free map, inode map and reference count files on
+   disk and writes the maps to them. */
 void
 free_map_create (void) 
 {
-  /* Create inode. */
-  if (!inode_create (FREE_MAP_SECTOR, bitmap_file_size (free_map), false))
+  /* Create inodes. */
+  if (!inode_create (FREE_MAP_INODE, bitmap_file_size (free_map), false))
     PANIC ("free map creation failed");
+  if (!inode_create (INODE_MAP_INODE, bitmap_file_size (inode_map), false))
+    PANIC ("inode map creation failed");
+  if (!inode_create (REFCOUNT_INODE, filesys_block_cnt (), false))
+    PANIC ("reference count creation failed");
 
-  /* Write bitmap to file. */
-  free_map_file = file_open (inode_open (FREE_MAP_SECTOR));
+  /* Write bitmaps to files. */
+  free_map_file = file_open (inode_open (FREE_MAP_INODE));
   if (free_map_file == NULL)
     PANIC ("can't open free map");
   if (!bitmap_write (free_map, free_map_file))
     PANIC ("can't write free map");
+
+  inode_map_file = file_open (inode_open (INODE_MAP_INODE));
+  if (inode_map_file == NULL)
+    PANIC ("can't open inode map");
+  if (!bitmap_write (inode_map, inode_map_file))
+    PANIC ("can't write inode map");
+
+  /* The reference count file starts out zeroed, as it should. */
+  refcount_file = file_open (inode_open (REFCOUNT_INODE));
+  if (refcount_file == NULL)
+    PANIC ("can't open reference counts");
 }
@@ -5,13 +5,29 @@
 #include <stddef.h>
 #include "devices/block.h"
 
-void free_map_init (void);
+struct super_block;
+
+void free_map_init (block_sector_t data_start, size_t inode_cnt);
 void free_map_read (void);
 void free_map_create (void);
-void free_map_open (void);
+void free_map_open (const struct super_block *);
 void free_map_close (void);
+void free_map_summarize (struct super_block *);
+size_t free_map_free_blocks (void);
+size_t free_map_free_inodes (void);
 
 bool free_map_allocate (size_t, block_sector_t *);
 void free_map_release (block_sector_t, size_t);
+bool free_map_share (block_sector_t);
+bool free_map_shared (block_sector_t);
+void free_map_batch_begin (void);
+void free_map_batch_end (void);
+bool free_map_batch_flush (void);
+void free_map_commit (void);
+void free_map_checkpoint (void);
+
+bool free_map_allocate_inode (block_sector_t *);
+void free_map_release_inode (block_sector_t);
+bool free_map_next_inode (block_sector_t *);
 
 #endif /* filesys/free-map.h */
@@ -1,71 +1,76 @@
 #include "filesys/inode.h"
 #include <list.h>
 #include <debug.h>
+#include <fadvise.h>
 #include <round.h>
 #include <string.h>
 #include "filesys/filesys.h"
 #include "filesys/free-map.h"
 #include "filesys/cache.h"
+#include "filesys/compress.h"
+#include "filesys/journal.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "threads/synch.h"
+#include "threads/vaddr.h"
 
-/* Identifies an inode. */
-#define INODE_MAGIC 0x494e4f44
-
-/* Number of direct blocks in an inode. */
-#define DIRECT_BLOCK 12
-/* Number of indirect blocks stored in a sector. */
+/* Number of indirect blocks stored in a block. */
 #define INDIRECT_BLOCK \
-  ((BLOCK_SECTOR_SIZE) / (sizeof (block_sector_t)))
+  (fs_block_size / (sizeof (block_sector_t)))
 /* Maximum number of sectors in an inode */
 #define MAXIMUM_SECTORS_IN_INODE \
   ((DIRECT_BLOCK) + (INDIRECT_BLOCK) + \
    (INDIRECT_BLOCK) * (INDIRECT_BLOCK))
 
-/* Return minimum. */
+/* Pages of kernel memory used to stage direct transfers. */
+#define DIRECT_STAGE_PAGES 8
+
+/* Blocks read ahead of a read, by default and for a file
+   advised to be read sequentially. */
+#define READ_AHEAD_NORMAL 1
+#define READ_AHEAD_SEQUENTIAL 8
+
+/* Blocks copied per batch of reads by inode_defragment(). */
+#define DEFRAG_BATCH 16
+
+/* Most blocks given to a file, or moved or shared, in one step of
+   an operation that goes on in a new journal transaction between
+   steps.  With the indirect blocks and the blocks of the free map
+   and reference counts that record them, a step must stay within
+   an operation's share of a transaction. */
+#define JOURNAL_STEP (2 * INDIRECT_BLOCK)
+
+/* Most blocks loaded by FADV_WILLNEED, half the buffer cache, so
+   that one hint cannot flush everything else out of it. */
+#define WILLNEED_MAX 32
+
+/* Blocks set aside for each chunk of a compressed file: enough for
+   the chunk stored uncompressed along with its header.  Files are
+   compressed only with blocks smaller than a chunk, since a chunk
+   could not take up fewer blocks than it does plainly otherwise. */
+#define CHUNK_SLOTS (COMPRESS_CHUNK / fs_block_size + 1)
+#define CHUNK_SLOTS_MAX (COMPRESS_CHUNK / BLOCK_SECTOR_SIZE + 1)
+
+/* Pages of kernel memory used to stage transfers to and from a
+   compressed file: one for the plain chunk, two for the stored
+   chunk, and one of scratch memory for the compressor. */
+#define COMPRESS_STAGE_PAGES 4
+
+/* Return minimum and maximum. */
 #define min(a, b) ((a < b) ? (a) : (b))
+#define max(a, b) ((a > b) ? (a) : (b))
 
 /* inode operation lock. */
 struct lock inode_extension_lock;
 
-/* On-disk inode.
-   Must be exactly BLOCK_SECTOR_SIZE bytes long. */
-struct inode_disk
-  {
-    /* Direct and indirect blocks. 
-       - DIRECT_BLOCK blocks
-       - 1 indirect block
-       - 1 double indirect block */
-    block_sector_t blocks[DIRECT_BLOCK + 2];
-    
-    /* inode metadata */
-    off_t length;                             /* File size in bytes. */
-    unsigned magic;                           /* Magic number. */
-
-    bool is_dir;                               /* whether it is a directory */
-    /* MODIFY THE FOLLOWING IF VARIABLES IN THIS STRUCTURE ARE MODIFIED */
-    /* To meet BLOCK_SECTOR_SIZE size requirement. */
-    char unused[BLOCK_SECTOR_SIZE
-                - sizeof (block_sector_t) * (DIRECT_BLOCK + 2)  /* blocks */
-                - sizeof (off_t)              /* length */
-                - sizeof (unsigned)           /* magic */
-                - sizeof (bool)               /* is_dir */
-               ];
-  };
-
-/* Indirect blocks stored in a sector. */
-struct inode_indirect_block_sector
-  {
-    /* Sectors */
-    block_sector_t blocks[INDIRECT_BLOCK];
-  };
+/* An indirect block, and a double indirect block, are arrays of
+   INDIRECT_BLOCK block numbers filling one file system block.
+   Because INDIRECT_BLOCK depends on the block size chosen at
+   format time, they are handled as plain block_sector_t arrays
+   allocated with fs_block_size bytes. */
 
-/* Double indirect blocks stored in a sector. */
-struct inode_double_indirect_block_sector
-  {
-    /* Sectors */
-    block_sector_t indirect_blocks[INDIRECT_BLOCK];
-  };
+/* Zero bytes to write into newly allocated blocks. */
+static char zeros[FS_BLOCK_SIZE_MAX];
 
 /* Three levels of blocks */
 static int
@@ -95,10 +100,6 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
   /* Return value */
   block_sector_t ret;
 
-  /* Memory to store the indirect block read from the disk */
-  struct inode_indirect_block_sector *iibs;
-  struct inode_double_indirect_block_sector *idibs;
-
   /* Calculate sector level */
   int sector_level = sector_calc_level (index);
 
@@ -109,15 +110,10 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
   /* Situation 2: If the index is in the indirect block. */
   if (sector_level == 2)
     {
-      /* Read the data from the indirect block sector. */
-      iibs = malloc (sizeof (struct inode_indirect_block_sector));
-      buffer_cache_read (idisk->blocks[DIRECT_BLOCK], iibs);
-
-      /* Fetch the sector to return. */
-      ret = iibs->blocks[index - DIRECT_BLOCK];
-
-      /* Free allocated memory and return. */
-      free (iibs);
+      /* Fetch the sector to return from the indirect block. */
+      buffer_cache_read_meta_at (idisk->blocks[DIRECT_BLOCK], &ret,
+                                 (index - DIRECT_BLOCK) * sizeof ret,
+                                 sizeof ret);
       return ret;
     }
 
@@ -132,20 +128,15 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
       ASSERT (index1 < (off_t)(INDIRECT_BLOCK));
       ASSERT (index2 < (off_t)(INDIRECT_BLOCK));
 
-      /* Read data from double indirect block sector from the disk. */
-      idibs = malloc (sizeof (struct inode_double_indirect_block_sector));
-      buffer_cache_read (idisk->blocks[DIRECT_BLOCK + 1], idibs);
-
-      /* Read data from the second-level indirect block sector. */
-      iibs = malloc (sizeof (struct inode_indirect_block_sector));
-      buffer_cache_read (idibs->indirect_blocks[index1], iibs);
-
-      /* Fetch the sector to return. */
-      ret = iibs->blocks[index2];
+      /* Fetch the second-level indirect block from the double
+         indirect block. */
+      block_sector_t iblock;
+      buffer_cache_read_meta_at (idisk->blocks[DIRECT_BLOCK + 1], &iblock,
+                                 index1 * sizeof iblock, sizeof iblock);
 
-      /* Free allocated memory and return. */
-      free (idibs);
-      free (iibs);
+      /* Fetch the sector to return from the indirect block. */
+      buffer_cache_read_meta_at (iblock, &ret, index2 * sizeof ret,
+                                 sizeof ret);
       return ret;
     }
   
@@ -153,32 +144,117 @@ index_to_sector (const struct inode_disk *idisk, off_t index)
   return (block_sector_t)(-1);
 }
 
+/* Makes position INDEX of the inode_disk IDISK refer to block
+   SECTOR, which must already be allocated along with the indirect
+   blocks leading to it.  Indirect blocks are written on behalf of
+   inode OWNER; IDISK itself is only changed in memory. */
+static void
+index_set_sector (struct inode_disk *idisk, off_t index,
+                  block_sector_t sector, block_sector_t owner)
+{
+  ASSERT (idisk != NULL);
+  ASSERT (index >= 0);
+  ASSERT (index < (int)(MAXIMUM_SECTORS_IN_INODE));
+
+  switch (sector_calc_level (index))
+    {
+    case 1:
+      idisk->blocks[index] = sector;
+      break;
+
+    case 2:
+      buffer_cache_write_meta_at (idisk->blocks[DIRECT_BLOCK], &sector,
+                                  (index - DIRECT_BLOCK) * sizeof sector,
+                                  sizeof sector, owner);
+      break;
+
+    case 3:
+      {
+        off_t index1 = 
+          (index - DIRECT_BLOCK - INDIRECT_BLOCK) / INDIRECT_BLOCK;
+        off_t index2 = 
+          (index - DIRECT_BLOCK - INDIRECT_BLOCK) % INDIRECT_BLOCK;
+
+        block_sector_t iblock;
+        buffer_cache_read_meta_at (idisk->blocks[DIRECT_BLOCK + 1], &iblock,
+                                   index1 * sizeof iblock, sizeof iblock);
+        buffer_cache_write_meta_at (iblock, &sector,
+                                    index2 * sizeof sector,
+                                    sizeof sector, owner);
+      }
+      break;
+    }
+}
+
 /* Returns the number of sectors to allocate for an inode SIZE
    bytes long. */
 static inline size_t
 bytes_to_sectors (off_t size)
 {
-  return DIV_ROUND_UP (size, BLOCK_SECTOR_SIZE);
+  return DIV_ROUND_UP (size, fs_block_size);
+}
+
+/* Returns the number of bytes of blocks that IDISK needs to hold
+   LENGTH bytes of data.  A compressed file reserves CHUNK_SLOTS
+   blocks for every chunk, enough for it not to compress at all. */
+static off_t
+inode_alloc_size (const struct inode_disk *idisk, off_t length)
+{
+  if (!idisk->compressed)
+    return length;
+  return (DIV_ROUND_UP (length, COMPRESS_CHUNK) * CHUNK_SLOTS
+          * fs_block_size);
 }
 
 /* Returns the sector index of a given byte SIZE. */
 static inline off_t
 bytes_to_index (off_t size)
 {
-  return size / BLOCK_SECTOR_SIZE;
+  return size / fs_block_size;
 }
 
 /* In-memory inode. */
 struct inode 
   {
     struct list_elem elem;              /* Element in inode list. */
-    block_sector_t sector;              /* Sector number of disk location. */
+    block_sector_t inumber;             /* Index in the inode table. */
     int open_cnt;                       /* Number of openers. */
     bool removed;                       /* True if deleted, false otherwise. */
     int deny_write_cnt;                 /* 0: writes ok, >0: deny writes. */
+    bool meta_dirty;                    /* Grown since last inode_sync()? */
+    int read_ahead;                     /* Blocks to read ahead. */
+    bool noreuse;                       /* Evict blocks once used? */
     struct inode_disk data;             /* Inode content. */
   };
 
+/* Returns the number of blocks allocated to INODE's data. */
+static off_t
+inode_block_cnt (const struct inode *inode)
+{
+  return bytes_to_sectors (inode_alloc_size (&inode->data,
+                                             inode->data.length));
+}
+
+/* Stores into *FIRST and *END the indexes of the first block of
+   INODE that holds any of the bytes from OFFSET up to END_OFS and
+   of the block after the last one.  For a compressed file these
+   are all the blocks of the chunks that hold those bytes. */
+static void
+inode_block_range (const struct inode *inode, off_t offset, off_t end_ofs,
+                   off_t *first, off_t *end)
+{
+  if (inode->data.compressed)
+    {
+      *first = offset / COMPRESS_CHUNK * CHUNK_SLOTS;
+      *end = DIV_ROUND_UP (end_ofs, COMPRESS_CHUNK) * CHUNK_SLOTS;
+    }
+  else
+    {
+      *first = bytes_to_index (offset);
+      *end = bytes_to_sectors (end_ofs);
+    }
+}
+
 /* Returns the block device sector that contains byte offset POS
    within INODE.
    Returns -1 if INODE does not contain data for a byte at offset
@@ -193,76 +269,129 @@ byte_to_sector (const struct inode *inode, off_t pos)
     return -1;
 }
 
+/* Returns true if INODE's contents are file system metadata,
+   which is journaled: a directory, one of the free maps, or the
+   block reference counts. */
+static bool
+inode_holds_metadata (const struct inode *inode)
+{
+  return (inode->data.is_dir || inode->inumber == FREE_MAP_INODE
+          || inode->inumber == INODE_MAP_INODE
+          || inode->inumber == REFCOUNT_INODE);
+}
+
 /* List of open inodes, so that opening a single inode twice
    returns the same `struct inode'. */
 static struct list open_inodes;
 
-/* Initializes the inode module. */
+/* Location and size of the inode table. */
+static block_sector_t inode_table;
+static size_t inode_cnt;
+
+/* Initializes the inode module.  The inode table starts at block
+   INODE_TABLE and holds INODE_CNT_ inodes. */
 void
-inode_init (void) 
+inode_init (block_sector_t inode_table_, size_t inode_cnt_) 
 {
   lock_init (&inode_extension_lock);
   list_init (&open_inodes);
+  inode_table = inode_table_;
+  inode_cnt = inode_cnt_;
+}
+
+/* Returns the inode table block that holds inode INUMBER. */
+static inline block_sector_t
+inode_table_block (block_sector_t inumber)
+{
+  ASSERT (inumber < inode_cnt);
+  return inode_table + inumber / (fs_block_size / INODE_DISK_SIZE);
+}
+
+/* Returns the byte offset of inode INUMBER within its inode table
+   block. */
+static inline size_t
+inode_table_ofs (block_sector_t inumber)
+{
+  return inumber % (fs_block_size / INODE_DISK_SIZE) * INODE_DISK_SIZE;
+}
+
+/* Writes the on-disk inode IDISK into the inode table slot of
+   INUMBER. */
+static void
+inode_disk_write (block_sector_t inumber, const struct inode_disk *idisk)
+{
+  buffer_cache_write_meta_at (inode_table_block (inumber), idisk,
+                              inode_table_ofs (inumber), sizeof *idisk,
+                              CACHE_NO_OWNER);
 }
 
 /* Allocate (or extend) sectors for indirect block IBLOCK so that
    it can contain SECTOR_CNT sectors. Sectors already allocated
-   are not modified. 
+   are not modified.  OWNER is the inode number.  New sectors are
+   filled with zeros if ZERO is true.
    Returns true if succeeds, false otherwise. */
 static bool
-inode_indirect_allocate (block_sector_t iblock, size_t sector_cnt)
+inode_indirect_allocate (block_sector_t iblock, size_t sector_cnt,
+                         block_sector_t owner, bool zero)
 {
   ASSERT (iblock > 0);
   ASSERT (sector_cnt <= INDIRECT_BLOCK);
 
-  /* Zero bytes to write. */
-  static char zeros[BLOCK_SECTOR_SIZE];
-
   /* Read indirect block data from block sector. */
-  struct inode_indirect_block_sector *iibs;
-  iibs = malloc (sizeof (struct inode_indirect_block_sector));
-  buffer_cache_read (iblock, iibs);
+  block_sector_t *iibs = malloc (fs_block_size);
+  if (iibs == NULL)
+    return false;
+  buffer_cache_read_meta (iblock, iibs);
 
   /* Allocate sectors and write to the disk. */
+  bool success = true, changed = false;
   for (unsigned int i = 0; i < sector_cnt; i++)
     {
       /* Skip if the sector is already allocated and allocate sector 
          for unallocated blocks. */
-      if (iibs->blocks[i] == 0)
+      if (iibs[i] == 0)
         {
           /* Allocate sector. */
-          if (!free_map_allocate (1, &(iibs->blocks[i])))
-            goto fail;
+          if (!free_map_allocate (1, &iibs[i]))
+            {
+              success = false;
+              break;
+            }
+          changed = true;
           /* Write all zeroes. */
-          buffer_cache_write (iibs->blocks[i], &zeros);
+          if (zero)
+            buffer_cache_write (iibs[i], zeros, owner);
         }
     }
   
-  /* Write the information back to the disk. */
-  buffer_cache_write (iblock, iibs);
+  /* Write the information back to the disk, including any sectors
+     allocated before a failure, so that they are freed along with
+     the inode.  An unchanged block is left alone, so that it does
+     not join the journal transaction. */
+  if (changed)
+    buffer_cache_write_meta (iblock, iibs, owner);
 
   free (iibs);
-  return true;
-
-fail:
-  free (iibs);
-  return false;
+  return success;
 }
 
 /* Allocate (or extend) sectors for double indirect block IBLOCK so
    that it can contain SECTOR_CNT sectors. Sectors already allocated
-   are not modified. 
+   are not modified.  OWNER is the inode number.  New data sectors
+   are filled with zeros if ZERO is true.
    Returns true if succeeds, false otherwise. */
 static bool
-inode_double_indirect_allocate (block_sector_t iblock, size_t sector_cnt)
+inode_double_indirect_allocate (block_sector_t iblock, size_t sector_cnt,
+                                block_sector_t owner, bool zero)
 {
   ASSERT (iblock > 0);
   ASSERT (sector_cnt <= INDIRECT_BLOCK * INDIRECT_BLOCK);
   
   /* Read indirect block data from block sector. */
-  struct inode_double_indirect_block_sector *idibs;
-  idibs = malloc (sizeof (struct inode_double_indirect_block_sector));
-  buffer_cache_read (iblock, idibs);
+  block_sector_t *idibs = malloc (fs_block_size);
+  if (idibs == NULL)
+    return false;
+  buffer_cache_read_meta (iblock, idibs);
 
   /* Remaining sectors to allocate. */
   size_t remaining_sectors = sector_cnt;
@@ -272,14 +401,20 @@ inode_double_indirect_allocate (block_sector_t iblock, size_t sector_cnt)
   int i = 0;
 
   /* Allocate sectors. */
+  bool success = true, changed = false;
   while (remaining_sectors > 0)
     {
       /* If indirect block does not exist then allocate one. */
-      if (idibs->indirect_blocks[i] == 0)
+      if (idibs[i] == 0)
         {
           /* Allocate sector to store sectors of indirect blocks. */
-          if (!free_map_allocate (1, &(idibs->indirect_blocks[i])))
-            goto fail;
+          if (!free_map_allocate (1, &idibs[i]))
+            {
+              success = false;
+              break;
+            }
+          changed = true;
+          buffer_cache_write_meta (idibs[i], zeros, owner);
         }
 
       /* Calculate indirect blocks to allocate in this loop. */
@@ -287,38 +422,39 @@ inode_double_indirect_allocate (block_sector_t iblock, size_t sector_cnt)
         min (remaining_sectors, INDIRECT_BLOCK);
 
       /* Allocate indirect blocks. */
-      inode_indirect_allocate 
-        (idibs->indirect_blocks[i], to_allocate_sectors);
+      if (!inode_indirect_allocate (idibs[i], to_allocate_sectors, owner,
+                                    zero))
+        {
+          success = false;
+          break;
+        }
 
       /* Deduct allocated blocks. */
       remaining_sectors -= to_allocate_sectors;
       i++;
     }
   
-  /* Write the information back to the disk. */
-  buffer_cache_write (iblock, idibs);
+  /* Write the information back to the disk, if it changed. */
+  if (changed)
+    buffer_cache_write_meta (iblock, idibs, owner);
 
   free (idibs);
-  return true;
-
-fail:
-  free (idibs);
-  return false;
+  return success;
 }
 
-/* Allocate (or extend) sectors for inode IDISK so that it can
-   contain file with SIZE bytes. Sectors already allocated are
-   not modified. 
+/* Allocate (or extend) sectors for inode IDISK, whose inode number
+   is OWNER, so that it can contain file with SIZE bytes. Sectors
+   already allocated are not modified.  New data sectors are
+   filled with zeros if ZERO is true; indirect blocks always are.
    Returns true if succeeds, false otherwise. */
 static bool
-inode_allocate (struct inode_disk *idisk, off_t size)
+inode_allocate (struct inode_disk *idisk, off_t size, block_sector_t owner,
+                bool zero)
 {
   ASSERT (idisk != NULL);
   ASSERT (size >= 0);
-  ASSERT (size < (off_t)(BLOCK_SECTOR_SIZE * MAXIMUM_SECTORS_IN_INODE));
-
-  /* Zero bytes to write. */
-  static char zeros[BLOCK_SECTOR_SIZE];
+  ASSERT ((uint64_t) size
+          < (uint64_t) fs_block_size * MAXIMUM_SECTORS_IN_INODE);
 
   /* Calculate the number of total sectors needed. */
   size_t total_sector_cnt = bytes_to_sectors (size);
@@ -337,7 +473,8 @@ inode_allocate (struct inode_disk *idisk, off_t size)
           if (!free_map_allocate (1, &(idisk->blocks[i])))
             return false;
           /* Write all zeroes if allocate success. */
-          buffer_cache_write (idisk->blocks[i], &zeros);
+          if (zero)
+            buffer_cache_write (idisk->blocks[i], zeros, owner);
         }
     }
   remaining_sectors -= sectors_to_allocate_direct;
@@ -350,12 +487,17 @@ inode_allocate (struct inode_disk *idisk, off_t size)
       /* Allocate sector to store indirect block if not yet 
          allocated. */
       if (idisk->blocks[DIRECT_BLOCK] == 0)
-        if (!free_map_allocate (1, &(idisk->blocks[DIRECT_BLOCK])))
-          return false;
+        {
+          if (!free_map_allocate (1, &(idisk->blocks[DIRECT_BLOCK])))
+            return false;
+          buffer_cache_write_meta (idisk->blocks[DIRECT_BLOCK], zeros,
+                                   owner);
+        }
       
       /* Allocate sectors for indirect blocks. */
       if (!inode_indirect_allocate 
-        (idisk->blocks[DIRECT_BLOCK], sectors_to_allocate_indirect))
+        (idisk->blocks[DIRECT_BLOCK], sectors_to_allocate_indirect, owner,
+         zero))
         return false;
     }
   remaining_sectors -= sectors_to_allocate_indirect;
@@ -368,13 +510,17 @@ inode_allocate (struct inode_disk *idisk, off_t size)
       /* Allocate sector to store double indirect block if 
          not yet allocated. */
       if (idisk->blocks[DIRECT_BLOCK + 1] == 0)
-        if (!free_map_allocate (1, &(idisk->blocks[DIRECT_BLOCK + 1])))
-          return false;
+        {
+          if (!free_map_allocate (1, &(idisk->blocks[DIRECT_BLOCK + 1])))
+            return false;
+          buffer_cache_write_meta (idisk->blocks[DIRECT_BLOCK + 1], zeros,
+                                   owner);
+        }
       
       /* Allocate sectors for double indirect blocks. */
       if (!inode_double_indirect_allocate 
         (idisk->blocks[DIRECT_BLOCK + 1], 
-        sectors_to_allocate_double_indirect))
+        sectors_to_allocate_double_indirect, owner, zero))
         return false;
     }
   remaining_sectors -= sectors_to_allocate_double_indirect;
@@ -385,6 +531,50 @@ inode_allocate (struct inode_disk *idisk, off_t size)
   return false;
 }
 
+/* Lets a long operation go on in a new journal transaction if the
+   running one is short of room, once the free map changes made so
+   far are written.  Gives up inode_extension_lock, if the running
+   thread holds it, meanwhile, so that the operations the journal
+   waits for can end. */
+static void
+inode_journal_restart (void)
+{
+  bool locked = lock_held_by_current_thread (&inode_extension_lock);
+
+  free_map_batch_flush ();
+  if (locked)
+    lock_release (&inode_extension_lock);
+  journal_restart ();
+  if (locked)
+    lock_acquire (&inode_extension_lock);
+}
+
+/* Like inode_allocate(), for IDISK, which has blocks for FROM
+   bytes already, but allocates at most JOURNAL_STEP blocks at a
+   time, writing IDISK into inode OWNER's slot of the inode table
+   after each step, and lets the journal go on in a new
+   transaction between steps.  A crash between steps leaves the
+   blocks allocated so far in the file, beyond its length, to be
+   put to use when it grows again. */
+static bool
+inode_allocate_steps (struct inode_disk *idisk, off_t from, off_t size,
+                      block_sector_t owner, bool zero)
+{
+  const off_t step = (off_t) JOURNAL_STEP * fs_block_size;
+
+  for (;;)
+    {
+      off_t target = size - from > step ? from + step : size;
+      bool success = inode_allocate (idisk, target, owner, zero);
+
+      inode_disk_write (owner, idisk);
+      if (!success || target == size)
+        return success;
+      from = target;
+      inode_journal_restart ();
+    }
+}
+
 /* Free all sectors contained in indirect block IBLOCK. */
 static void
 inode_indirect_free (block_sector_t iblock)
@@ -392,14 +582,15 @@ inode_indirect_free (block_sector_t iblock)
   ASSERT (iblock > 0);
 
   /* Read indirect block data from block sector. */
-  struct inode_indirect_block_sector *iibs;
-  iibs = malloc (sizeof (struct inode_indirect_block_sector));
-  buffer_cache_read (iblock, iibs);
+  block_sector_t *iibs = malloc (fs_block_size);
+  if (iibs == NULL)
+    PANIC ("couldn't allocate indirect block buffer");
+  buffer_cache_read_meta (iblock, iibs);
 
   /* Free all the blocks. */
   for (unsigned int i = 0; i < INDIRECT_BLOCK; i++)
-    if (iibs->blocks[i] != 0)
-      free_map_release (iibs->blocks[i], 1);
+    if (iibs[i] != 0)
+      free_map_release (iibs[i], 1);
 
   /* Free this sector. */
   free_map_release (iblock, 1);
@@ -414,14 +605,19 @@ inode_double_indirect_free (block_sector_t iblock)
   ASSERT (iblock > 0);
 
   /* Read indirect block data from block sector. */
-  struct inode_double_indirect_block_sector *idibs;
-  idibs = malloc (sizeof (struct inode_double_indirect_block_sector));
-  buffer_cache_read (iblock, idibs);
+  block_sector_t *idibs = malloc (fs_block_size);
+  if (idibs == NULL)
+    PANIC ("couldn't allocate indirect block buffer");
+  buffer_cache_read_meta (iblock, idibs);
 
-  /* Free all the indirect blocks. */
+  /* Free all the indirect blocks, in a new journal transaction
+     every so often. */
   for (unsigned int i = 0; i < INDIRECT_BLOCK; i++)
-    if (idibs->indirect_blocks[i] != 0)
-      inode_indirect_free (idibs->indirect_blocks[i]);
+    if (idibs[i] != 0)
+      {
+        inode_indirect_free (idibs[i]);
+        inode_journal_restart ();
+      }
 
   /* Free this sector. */
   free_map_release (iblock, 1);
@@ -450,8 +646,7 @@ inode_free (struct inode_disk *idisk)
 }
 
 /* Initializes an inode with LENGTH bytes of data and
-   writes the new inode to sector SECTOR on the file system
-   device.
+   writes the new inode to slot SECTOR of the inode table.
    Returns true if successful.
    Returns false if memory or disk allocation fails. */
 bool
@@ -463,29 +658,35 @@ inode_create (block_sector_t sector, off_t length, bool is_dir)
   ASSERT (length >= 0);
 
   /* If this assertion fails, the inode structure is not exactly
-     one sector in size, and you should fix that. */
-  ASSERT (sizeof *disk_inode == BLOCK_SECTOR_SIZE);
+     INODE_DISK_SIZE bytes in size, and you should fix that. */
+  ASSERT (sizeof *disk_inode == INODE_DISK_SIZE);
 
+  journal_begin ();
   disk_inode = calloc (1, sizeof *disk_inode);
   if (disk_inode != NULL)
     {
-      disk_inode->length = length;
       disk_inode->magic = INODE_MAGIC;
       disk_inode->is_dir = is_dir;
 
-      /* Try to allocate space for the given length. */
-      if (inode_allocate (disk_inode, length))
+      /* Try to allocate space for the given length, writing each
+         block of the free map once for all of it.  The inode is
+         written empty until then. */
+      free_map_batch_begin ();
+      success = inode_allocate_steps (disk_inode, 0, length, sector, true);
+      free_map_batch_end ();
+      if (success)
         {
           /* Write the new inode to the disk. */
-          buffer_cache_write (sector, disk_inode);
-          success = true; 
+          disk_inode->length = length;
+          inode_disk_write (sector, disk_inode);
         } 
       free (disk_inode);
     }
+  journal_end ();
   return success;
 }
 
-/* Reads an inode from SECTOR
+/* Reads inode number SECTOR from the inode table
    and returns a `struct inode' that contains it.
    Returns a null pointer if memory allocation fails. */
 struct inode *
@@ -499,7 +700,7 @@ inode_open (block_sector_t sector)
        e = list_next (e)) 
     {
       inode = list_entry (e, struct inode, elem);
-      if (inode->sector == sector) 
+      if (inode->inumber == sector) 
         {
           inode_reopen (inode);
           return inode; 
@@ -513,12 +714,16 @@ inode_open (block_sector_t sector)
 
   /* Initialize. */
   list_push_front (&open_inodes, &inode->elem);
-  inode->sector = sector;
+  inode->inumber = sector;
   inode->open_cnt = 1;
   inode->deny_write_cnt = 0;
   inode->removed = false;
+  inode->meta_dirty = false;
+  inode->read_ahead = READ_AHEAD_NORMAL;
+  inode->noreuse = false;
   
-  buffer_cache_read (inode->sector, &inode->data);
+  buffer_cache_read_meta_at (inode_table_block (sector), &inode->data,
+                             inode_table_ofs (sector), sizeof inode->data);
   return inode;
 }
 
@@ -535,7 +740,7 @@ inode_reopen (struct inode *inode)
 block_sector_t
 inode_get_inumber (const struct inode *inode)
 {
-  return inode->sector;
+  return inode->inumber;
 }
 
 /* Closes INODE and writes it to disk.
@@ -557,10 +762,16 @@ inode_close (struct inode *inode)
       /* Deallocate blocks if removed. */
       if (inode->removed) 
         {
-          /* Free the sector of this inode */
-          free_map_release (inode->sector, 1);
+          journal_begin ();
+          /* Free the inode table slot of this inode */
+          free_map_release_inode (inode->inumber);
           /* Free all allocated sectors. */
+          free_map_batch_begin ();
           inode_free (&(inode->data));
+          free_map_batch_end ();
+          journal_end ();
+          if (inode->data.compressed)
+            compress_cache_invalidate (inode->inumber);
         }
 
       free (inode); 
@@ -576,6 +787,129 @@ inode_remove (struct inode *inode)
   inode->removed = true;
 }
 
+/* Queues the blocks of INODE that follow the one holding byte
+   OFFSET - 1, the last byte just read, for read-ahead, as many as
+   INODE's advice calls for. */
+static void
+inode_read_ahead (struct inode *inode, off_t offset)
+{
+  block_sector_t sectors[READ_AHEAD_SEQUENTIAL];
+  off_t index = bytes_to_index (offset - 1) + 1;
+  off_t end = inode_block_cnt (inode);
+  int cnt = 0;
+
+  for (; cnt < inode->read_ahead && index < end; index++)
+    sectors[cnt++] = index_to_sector (&inode->data, index);
+  if (cnt > 0)
+    buffer_cache_read_ahead (sectors, cnt);
+}
+
+/* Loads chunk CHUNK of compressed INODE into PLAIN, which has
+   room for COMPRESS_CHUNK bytes, using STORED, which has room for
+   CHUNK_SLOTS blocks, to read it in.  Only as many blocks as the
+   chunk takes up stored are read, and not even those if the chunk
+   is in the decompressed chunk cache.  Returns true if successful,
+   false if the chunk is corrupt, in which case it is not cached. */
+static bool
+chunk_load (struct inode *inode, off_t chunk, uint8_t *plain,
+            uint8_t *stored)
+{
+  block_sector_t sectors[CHUNK_SLOTS_MAX];
+  off_t first = chunk * CHUNK_SLOTS;
+  size_t cnt;
+
+  if (compress_cache_get (inode->inumber, chunk, plain))
+    return true;
+
+  /* The header in the first block tells how many more to read. */
+  buffer_cache_read (index_to_sector (&inode->data, first), stored);
+  cnt = DIV_ROUND_UP (compress_stored_size (stored), fs_block_size);
+  for (size_t i = 1; i < cnt; i++)
+    sectors[i] = index_to_sector (&inode->data, first + i);
+  if (cnt > 1)
+    buffer_cache_prefetch (sectors + 1, cnt - 1);
+  for (size_t i = 1; i < cnt; i++)
+    buffer_cache_read (sectors[i], stored + i * fs_block_size);
+
+  if (!compress_decode (stored, plain))
+    return false;
+  compress_cache_put (inode->inumber, chunk, plain);
+  return true;
+}
+
+/* Compresses PLAIN, the COMPRESS_CHUNK bytes of chunk CHUNK of
+   compressed INODE, into STORED, which has room for CHUNK_SLOTS
+   blocks, using WORK as scratch memory, and writes out the blocks
+   that it takes up.  The chunk's other blocks are left as they
+   are, since the header says they are not part of it. */
+static void
+chunk_store (struct inode *inode, off_t chunk, const uint8_t *plain,
+             uint8_t *stored, void *work)
+{
+  off_t first = chunk * CHUNK_SLOTS;
+  size_t bytes = compress_encode (plain, stored, work);
+  size_t cnt = DIV_ROUND_UP (bytes, fs_block_size);
+
+  memset (stored + bytes, 0, cnt * fs_block_size - bytes);
+  for (size_t i = 0; i < cnt; i++)
+    buffer_cache_write (index_to_sector (&inode->data, first + i),
+                        stored + i * fs_block_size, inode->inumber);
+  compress_cache_put (inode->inumber, chunk, plain);
+}
+
+/* Transfers SIZE bytes between BUFFER and compressed INODE,
+   starting at OFFSET, reading if WRITE is false and writing
+   otherwise, a chunk at a time.  A chunk that is only partly
+   written is loaded first; one that is wholly overwritten is not.
+   The range is cut short at end of file, so a writer must extend
+   INODE first, and at a corrupt chunk that must be loaded.
+   Returns the number of bytes transferred, which is 0 if no
+   staging memory is available. */
+static off_t
+inode_transfer_compressed (struct inode *inode, uint8_t *buffer,
+                           off_t size, off_t offset, bool write)
+{
+  off_t length = inode_length (inode);
+  off_t done = 0;
+  uint8_t *plain, *stored, *work;
+
+  ASSERT (fs_block_size < COMPRESS_CHUNK);
+  ASSERT (COMPRESS_CHUNK <= PGSIZE && LZ_WORK_SIZE <= PGSIZE);
+
+  if (size <= 0 || offset >= length)
+    return 0;
+  if (size > length - offset)
+    size = length - offset;
+
+  plain = palloc_get_multiple (0, COMPRESS_STAGE_PAGES);
+  if (plain == NULL)
+    return 0;
+  stored = plain + PGSIZE;
+  work = stored + 2 * PGSIZE;
+
+  while (done < size)
+    {
+      off_t chunk = (offset + done) / COMPRESS_CHUNK;
+      off_t chunk_ofs = (offset + done) % COMPRESS_CHUNK;
+      off_t chunk_size = min (size - done, COMPRESS_CHUNK - chunk_ofs);
+
+      if ((!write || chunk_size < COMPRESS_CHUNK)
+          && !chunk_load (inode, chunk, plain, stored))
+        break;
+      if (write)
+        {
+          memcpy (plain + chunk_ofs, buffer + done, chunk_size);
+          chunk_store (inode, chunk, plain, stored, work);
+        }
+      else
+        memcpy (buffer + done, plain + chunk_ofs, chunk_size);
+      done += chunk_size;
+    }
+
+  palloc_free_multiple (plain, COMPRESS_STAGE_PAGES);
+  return done;
+}
+
 /* Reads SIZE bytes from INODE into BUFFER, starting at position OFFSET.
    Returns the number of bytes actually read, which may be less
    than SIZE if an error occurs or end of file is reached. */
@@ -584,7 +918,9 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
 {
   uint8_t *buffer = buffer_;
   off_t bytes_read = 0;
-  uint8_t *bounce = NULL;
+
+  if (inode->data.compressed)
+    return inode_transfer_compressed (inode, buffer, size, offset, false);
 
   while (size > 0) 
     {
@@ -593,11 +929,11 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       /* Stop reading if cannot find */
       if (sector_idx == (block_sector_t)(-1))
         break;
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      int sector_ofs = offset % fs_block_size;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int sector_left = fs_block_size - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually copy out of this sector. */
@@ -605,87 +941,246 @@ inode_read_at (struct inode *inode, void *buffer_, off_t size, off_t offset)
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Read full sector directly into caller's buffer. */
-          buffer_cache_read (sector_idx, buffer + bytes_read);
-        }
-      else 
-        {
-          /* Read sector into bounce buffer, then partially copy
-             into caller's buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-          buffer_cache_read (sector_idx, bounce);
-          memcpy (buffer + bytes_read, bounce + sector_ofs, chunk_size);
-        }
+      /* Copy straight out of the cached block into caller's
+         buffer. */
+      if (inode_holds_metadata (inode))
+        buffer_cache_read_meta_at (sector_idx, buffer + bytes_read,
+                                   sector_ofs, chunk_size);
+      else
+        buffer_cache_read_at (sector_idx, buffer + bytes_read,
+                              sector_ofs, chunk_size);
+      if (inode->noreuse
+          && (size_t) (sector_ofs + chunk_size) == fs_block_size)
+        buffer_cache_age (sector_idx);
       
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_read += chunk_size;
     }
-  free (bounce);
 
+  if (bytes_read > 0)
+    inode_read_ahead (inode, offset);
   return bytes_read;
 }
 
-/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
-   Returns the number of bytes actually written, which may be
-   less than SIZE if end of file is reached or an error occurs. */
-off_t
-inode_write_at (struct inode *inode, const void *buffer_, off_t size,
-                off_t offset) 
+/* Gives INODE blocks of its own, with the same contents, in place
+   of any blocks it shares with a clone among those that hold the
+   bytes from OFFSET up to END_OFS, whose blocks must lie within
+   the file.  Each copy is on disk before INODE points to it, as
+   in inode_defragment().  Returns true if successful, false if
+   disk or memory is short, in which case some shared blocks may
+   be left. */
+static bool
+inode_unshare (struct inode *inode, off_t offset, off_t end_ofs)
 {
-  const uint8_t *buffer = buffer_;
-  off_t bytes_written = 0;
-  uint8_t *bounce = NULL;
+  uint8_t *buffer = NULL;
+  off_t first, end;
+  bool success = true;
+
+  if (!inode->data.cloned || offset >= end_ofs)
+    return true;
+
+  inode_block_range (inode, offset, end_ofs, &first, &end);
+  for (; first < end && success; first++)
+    {
+      block_sector_t old = index_to_sector (&inode->data, first);
+      block_sector_t new;
+
+      if (!free_map_shared (old))
+        continue;
+      if (buffer == NULL && (buffer = malloc (fs_block_size)) == NULL)
+        return false;
+
+      journal_begin ();
+      lock_acquire (&inode_extension_lock);
+      success = free_map_allocate (1, &new);
+      if (success)
+        {
+          buffer_cache_read (old, buffer);
+          buffer_cache_write (new, buffer, inode->inumber);
+          buffer_cache_flush_block (new);
+          index_set_sector (&inode->data, first, new, inode->inumber);
+          if (first < DIRECT_BLOCK)
+            inode_disk_write (inode->inumber, &inode->data);
+          free_map_release (old, 1);
+          inode->meta_dirty = true;
+        }
+      lock_release (&inode_extension_lock);
+      journal_end ();
+    }
+  free (buffer);
+  return success;
+}
+
+/* Writes zeros over the bytes of INODE from OFFSET up to END_OFS,
+   all of whose blocks must be allocated. */
+static void
+inode_clear (struct inode *inode, off_t offset, off_t end_ofs)
+{
+  while (offset < end_ofs)
+    {
+      block_sector_t sector
+        = index_to_sector (&inode->data, bytes_to_index (offset));
+      int block_ofs = offset % fs_block_size;
+      off_t chunk = min (end_ofs - offset,
+                         (off_t) fs_block_size - block_ofs);
+
+      if (inode_holds_metadata (inode))
+        buffer_cache_write_meta_at (sector, zeros, block_ofs, chunk,
+                                    inode->inumber);
+      else
+        buffer_cache_write_at (sector, zeros, block_ofs, chunk,
+                               inode->inumber);
+      offset += chunk;
+    }
+}
+
+/* Extends INODE, if it is shorter, to LENGTH bytes, of which the
+   caller is about to write those from OFFSET on.  New blocks are
+   filled with zeros.  Blocks that INODE already had past its end,
+   from inode_preallocate() or a crash in the middle of growing
+   it, hold whatever they held before, so the bytes in them from
+   the old end of file up to OFFSET, which the caller does not
+   write, are cleared before the new length is set.
+   Returns true if successful, false if allocation fails or writes
+   to INODE are denied. */
+bool
+inode_extend (struct inode *inode, off_t offset, off_t length)
+{
+  off_t end = inode->data.length;
 
   if (inode->deny_write_cnt)
-    return 0;
+    return false;
+
+  /* The block that holds the end of INODE may be shared with a
+     clone, and its bytes past the end may be cleared below. */
+  if (!inode->data.compressed && end % fs_block_size != 0
+      && offset > end && length > end
+      && !inode_unshare (inode, end, end + 1))
+    return false;
 
   /* Extend file if write after EOF, i.e. cannot find sector in inode. */
-  /* Last byte to write: OFFSET + SIZE - 1
-     Refer to the comment of this function. */
-  if (byte_to_sector (inode, offset + size - 1) == (block_sector_t)(-1))
+  /* Last byte to write: LENGTH - 1 */
+  if (byte_to_sector (inode, length - 1) == (block_sector_t)(-1))
     {
       /* Acquire the lock. */
+      journal_begin ();
       lock_acquire (&inode_extension_lock);
 
       /* Check again */
-      if (byte_to_sector (inode, offset + size - 1) == (block_sector_t)(-1))
+      if (byte_to_sector (inode, length - 1) == (block_sector_t)(-1))
         {
-          /* Allocate enough space of file. */
-          if (!inode_allocate (&(inode->data), offset + size))
+          /* Allocate enough space of file, in steps if it is
+             much. */
+          off_t alloc_size = inode_alloc_size (&inode->data, length);
+          off_t from = inode_alloc_size (&inode->data, inode->data.length);
+          bool success;
+
+          free_map_batch_begin ();
+          success = ((uint64_t) alloc_size
+                     < (uint64_t) fs_block_size * MAXIMUM_SECTORS_IN_INODE
+                     && inode_allocate_steps (&inode->data, from,
+                                              alloc_size, inode->inumber,
+                                              true));
+          free_map_batch_end ();
+          if (!success)
             {
               lock_release (&inode_extension_lock);
-              return 0;
+              journal_end ();
+              return false;
             }
 
-          /* Update file metadata. */
-          inode->data.length = offset + size;
+          /* A compressed file's chunks past its end were cleared
+             when they were allocated. */
+          if (!inode->data.compressed)
+            inode_clear (inode, inode->data.length,
+                         min (max (offset, inode->data.length), length));
+
+          /* Update file metadata, unless another thread grew the
+             file further while this one waited for the journal. */
+          if (length > inode->data.length)
+            inode->data.length = length;
+          inode->meta_dirty = true;
 
           /* Write the updated inode to the disk. */
-          buffer_cache_write (inode->sector, &(inode->data));
+          inode_disk_write (inode->inumber, &(inode->data));
         }
 
       /* Release the lock */
       lock_release (&inode_extension_lock);
+      journal_end ();
     }
+  return true;
+}
+
+/* Gives INODE blocks for its first LENGTH bytes, if it does not
+   have them yet, without clearing them or changing its length.
+   Until writes extend INODE over them they lie past its end, so
+   whatever they held before cannot be read, and inode_extend()
+   clears any part of them that a write skips over.  This spares a
+   caller that is about to write them all the cost of clearing
+   them first, and lays them out together.  A compressed file's
+   blocks are cleared all the same, since their chunk headers must
+   be valid.
+   Returns true if successful, false if allocation fails or writes
+   to INODE are denied. */
+bool
+inode_preallocate (struct inode *inode, off_t length)
+{
+  off_t alloc_size = inode_alloc_size (&inode->data, length);
+  bool success;
+
+  if (inode->deny_write_cnt
+      || (uint64_t) alloc_size
+         >= (uint64_t) fs_block_size * MAXIMUM_SECTORS_IN_INODE)
+    return false;
+
+  journal_begin ();
+  lock_acquire (&inode_extension_lock);
+  free_map_batch_begin ();
+  success = inode_allocate_steps (&inode->data,
+                                  inode_alloc_size (&inode->data,
+                                                    inode->data.length),
+                                  alloc_size, inode->inumber,
+                                  inode->data.compressed);
+  free_map_batch_end ();
+  inode->meta_dirty = true;
+  lock_release (&inode_extension_lock);
+  journal_end ();
+  return success;
+}
+
+/* Writes SIZE bytes from BUFFER into INODE, starting at OFFSET.
+   Returns the number of bytes actually written, which may be
+   less than SIZE if end of file is reached or an error occurs. */
+off_t
+inode_write_at (struct inode *inode, const void *buffer_, off_t size,
+                off_t offset) 
+{
+  const uint8_t *buffer = buffer_;
+  off_t bytes_written = 0;
+
+  if (inode->deny_write_cnt)
+    return 0;
+
+  if (!inode_extend (inode, offset, offset + size)
+      || !inode_unshare (inode, offset, offset + size))
+    return 0;
+
+  if (inode->data.compressed)
+    return inode_transfer_compressed (inode, (uint8_t *) buffer, size,
+                                      offset, true);
 
   while (size > 0) 
     {
       /* Sector to write, starting byte offset within sector. */
       block_sector_t sector_idx = byte_to_sector (inode, offset);
-      int sector_ofs = offset % BLOCK_SECTOR_SIZE;
+      int sector_ofs = offset % fs_block_size;
 
       /* Bytes left in inode, bytes left in sector, lesser of the two. */
       off_t inode_left = inode_length (inode) - offset;
-      int sector_left = BLOCK_SECTOR_SIZE - sector_ofs;
+      int sector_left = fs_block_size - sector_ofs;
       int min_left = inode_left < sector_left ? inode_left : sector_left;
 
       /* Number of bytes to actually write into this sector. */
@@ -693,42 +1188,504 @@ inode_write_at (struct inode *inode, const void *buffer_, off_t size,
       if (chunk_size <= 0)
         break;
 
-      if (sector_ofs == 0 && chunk_size == BLOCK_SECTOR_SIZE)
-        {
-          /* Write full sector directly to disk. */
-          buffer_cache_write (sector_idx, (void*) (buffer + bytes_written));
-        }
-      else 
-        {
-          /* We need a bounce buffer. */
-          if (bounce == NULL) 
-            {
-              bounce = malloc (BLOCK_SECTOR_SIZE);
-              if (bounce == NULL)
-                break;
-            }
-
-          /* If the sector contains data before or after the chunk
-             we're writing, then we need to read in the sector
-             first.  Otherwise we start with a sector of all zeros. */
-          if (sector_ofs > 0 || chunk_size < sector_left) 
-            buffer_cache_read (sector_idx, bounce);
-          else
-            memset (bounce, 0, BLOCK_SECTOR_SIZE);
-          memcpy (bounce + sector_ofs, buffer + bytes_written, chunk_size);
-          buffer_cache_write (sector_idx, bounce);
-        }
+      /* Copy straight into the cached block.  Bytes of the block
+         outside the chunk keep their old contents. */
+      if (inode_holds_metadata (inode))
+        buffer_cache_write_meta_at (sector_idx, buffer + bytes_written,
+                                    sector_ofs, chunk_size, inode->inumber);
+      else
+        buffer_cache_write_at (sector_idx, buffer + bytes_written,
+                               sector_ofs, chunk_size, inode->inumber);
+      if (inode->noreuse
+          && (size_t) (sector_ofs + chunk_size) == fs_block_size)
+        buffer_cache_age (sector_idx);
 
       /* Advance. */
       size -= chunk_size;
       offset += chunk_size;
       bytes_written += chunk_size;
     }
-  free (bounce);
 
   return bytes_written;
 }
 
+/* Applies ADVICE, one of the FADV_* values, to INODE.
+   FADV_WILLNEED and FADV_DONTNEED act right away on the LEN bytes
+   starting at OFFSET, or on the rest of the file if LEN is 0:
+   the first loads their blocks into the buffer cache, at most
+   WILLNEED_MAX of them, and the second writes back and drops
+   them.  The others describe how the whole file will be accessed
+   from now on.  Returns false if ADVICE is not a known value. */
+bool
+inode_advise (struct inode *inode, int advice, off_t offset, off_t len)
+{
+  off_t first, end;
+
+  switch (advice)
+    {
+    case FADV_NORMAL:
+      inode->read_ahead = READ_AHEAD_NORMAL;
+      inode->noreuse = false;
+      return true;
+    case FADV_SEQUENTIAL:
+      inode->read_ahead = READ_AHEAD_SEQUENTIAL;
+      return true;
+    case FADV_RANDOM:
+      inode->read_ahead = 0;
+      return true;
+    case FADV_NOREUSE:
+      inode->noreuse = true;
+      return true;
+    case FADV_WILLNEED:
+    case FADV_DONTNEED:
+      break;
+    default:
+      return false;
+    }
+
+  /* Blocks of the file that the range touches. */
+  end = inode_length (inode);
+  if (len > 0 && offset + len < end)
+    end = offset + len;
+  if (offset < 0 || offset >= end)
+    return true;
+  if (advice == FADV_DONTNEED && inode->data.compressed)
+    compress_cache_invalidate (inode->inumber);
+  inode_block_range (inode, offset, end, &first, &end);
+
+  if (advice == FADV_WILLNEED)
+    {
+      block_sector_t sectors[WILLNEED_MAX];
+      int cnt = 0;
+
+      for (; first < end && cnt < WILLNEED_MAX; first++)
+        sectors[cnt++] = index_to_sector (&inode->data, first);
+      buffer_cache_prefetch (sectors, cnt);
+    }
+  else
+    for (; first < end; first++)
+      buffer_cache_drop (index_to_sector (&inode->data, first));
+  return true;
+}
+
+/* Returns the number of runs of consecutive blocks that hold
+   INODE's data, 1 for a contiguous file and 0 for an empty one. */
+int
+inode_fragments (struct inode *inode)
+{
+  off_t cnt = inode_block_cnt (inode);
+  block_sector_t prev = 0;
+  int fragments = 0;
+
+  for (off_t i = 0; i < cnt; i++)
+    {
+      block_sector_t sector = index_to_sector (&inode->data, i);
+      if (i == 0 || sector != prev + 1)
+        fragments++;
+      prev = sector;
+    }
+  return fragments;
+}
+
+/* Moves INODE's data into one run of consecutive blocks, if it is
+   not in one already, while INODE may stay open.  The data is
+   copied through the buffer cache and written to disk before the
+   block pointers are switched over, and the new pointers are
+   written before the old blocks are released, so that a crash at
+   any point leaves the file readable.  Indirect blocks stay where
+   they are.  The caller must keep INODE from being read or written
+   meanwhile, which holding file_lock does, and must not be inside
+   a journal operation.
+   Returns true if INODE's data ends up contiguous, false if no
+   large enough run of free blocks exists or memory is short. */
+bool
+inode_defragment (struct inode *inode)
+{
+  off_t cnt = inode_block_cnt (inode);
+  block_sector_t *old;
+  block_sector_t first;
+  uint8_t *buffer;
+  bool success = false;
+
+  if (inode_fragments (inode) <= 1)
+    return true;
+
+  old = malloc (cnt * sizeof *old);
+  buffer = malloc (fs_block_size);
+  journal_begin ();
+  lock_acquire (&inode_extension_lock);
+  if (old == NULL || buffer == NULL || !free_map_allocate (cnt, &first))
+    goto done;
+
+  /* Copy the data into the new run, reading each batch of old
+     blocks together, and put it on disk.  A directory's blocks
+     stay in the metadata pool, and so are journaled, one
+     transaction's worth at a time. */
+  for (off_t i = 0; i < cnt; i++)
+    old[i] = index_to_sector (&inode->data, i);
+  for (off_t i = 0; i < cnt; i++)
+    {
+      if (i % DEFRAG_BATCH == 0)
+        buffer_cache_prefetch (old + i, min (cnt - i, DEFRAG_BATCH));
+      if (inode_holds_metadata (inode))
+        {
+          buffer_cache_read_meta (old[i], buffer);
+          buffer_cache_write_meta (first + i, buffer, inode->inumber);
+          inode_journal_restart ();
+        }
+      else
+        {
+          buffer_cache_read (old[i], buffer);
+          buffer_cache_write (first + i, buffer, inode->inumber);
+        }
+    }
+  buffer_cache_flush_owner (inode->inumber);
+
+  /* Switch the block pointers over and put them on disk.  Both
+     copies hold the data, so a crash between steps is harmless. */
+  for (off_t i = 0; i < cnt; i++)
+    {
+      if (i > 0 && i % JOURNAL_STEP == 0)
+        inode_journal_restart ();
+      index_set_sector (&inode->data, i, first + i, inode->inumber);
+    }
+  inode_disk_write (inode->inumber, &inode->data);
+  buffer_cache_flush_owner (inode->inumber);
+  buffer_cache_flush_block (inode_table_block (inode->inumber));
+
+  /* With a journal, the new pointers are journaled rather than
+     flushed, so commit them and write them in place before the old
+     blocks become free. */
+  lock_release (&inode_extension_lock);
+  journal_end ();
+  journal_commit ();
+  journal_checkpoint ();
+  journal_begin ();
+  lock_acquire (&inode_extension_lock);
+
+  /* Release the old blocks, dropping any cached copies unwritten so
+     that they cannot later land on a block reused by another
+     file. */
+  free_map_batch_begin ();
+  for (off_t i = 0; i < cnt; i++)
+    {
+      if (i > 0 && i % JOURNAL_STEP == 0)
+        inode_journal_restart ();
+      buffer_cache_sync (old[i], 1, true);
+      free_map_release (old[i], 1);
+    }
+  free_map_batch_end ();
+  success = true;
+
+ done:
+  lock_release (&inode_extension_lock);
+  journal_end ();
+  free (buffer);
+  free (old);
+  return success;
+}
+
+/* Clears the entries of indirect block IBLOCK, whose first entry
+   is for block index FIRST, for block indexes CNT and beyond. */
+static void
+indirect_truncate (block_sector_t *iblock, off_t first, off_t cnt)
+{
+  for (off_t i = max (cnt - first, 0); i < (off_t) INDIRECT_BLOCK; i++)
+    iblock[i] = 0;
+}
+
+/* Creates inode number INUMBER as a clone of INODE: a regular file
+   with the same length and contents that shares INODE's data
+   blocks, each of which gains a reference.  Only the indirect
+   blocks are copied.  Shared blocks are copied on write, by
+   inode_unshare(), so that the two files then go their own ways.
+   The caller must keep INODE from being written meanwhile, which
+   holding file_lock does.
+   Returns true if successful, false if INODE is metadata, some
+   block cannot take another reference, or disk or memory is
+   short. */
+bool
+inode_clone (struct inode *inode, block_sector_t inumber)
+{
+  off_t cnt = inode_block_cnt (inode);
+  size_t fresh_cnt = 0, fresh_max;
+  struct inode_disk *idisk;
+  block_sector_t *fresh, *dbl;
+  uint8_t *buffer;
+  off_t shared = 0;
+  bool success = false;
+
+  if (inode_holds_metadata (inode))
+    return false;
+
+  /* Shared blocks are never written again, so they had better be
+     on disk: a dirty cached copy would be written back only on
+     behalf of INODE. */
+  buffer_cache_flush_owner (inode->inumber);
+
+  /* At most the indirect block, the double indirect block and
+     the indirect blocks below it are copied. */
+  fresh_max = 2 + INDIRECT_BLOCK;
+  idisk = calloc (1, sizeof *idisk);
+  fresh = malloc (fresh_max * sizeof *fresh);
+  dbl = malloc (fs_block_size);
+  buffer = malloc (fs_block_size);
+  journal_begin ();
+  lock_acquire (&inode_extension_lock);
+  if (idisk == NULL || fresh == NULL || dbl == NULL || buffer == NULL)
+    goto done;
+
+  /* Take the references first, since that can fail.  A crash
+     between steps of a large clone leaks the references and blocks
+     taken so far, but nothing worse. */
+  for (; shared < cnt; shared++)
+    {
+      if (shared > 0 && shared % JOURNAL_STEP == 0)
+        inode_journal_restart ();
+      if (!free_map_share (index_to_sector (&inode->data, shared)))
+        goto done;
+    }
+
+  /* Copy the direct pointers and the indirect blocks, leaving out
+     blocks past the end of INODE, which are not shared. */
+  *idisk = inode->data;
+  idisk->cloned = true;
+  for (off_t i = cnt; i < DIRECT_BLOCK; i++)
+    idisk->blocks[i] = 0;
+  for (int level = 0; level < 2; level++)
+    {
+      block_sector_t *slot = &idisk->blocks[DIRECT_BLOCK + level];
+      off_t first = DIRECT_BLOCK + level * INDIRECT_BLOCK;
+      if (cnt <= first)
+        *slot = 0;
+      if (*slot == 0)
+        continue;
+      if (!free_map_allocate (1, &fresh[fresh_cnt]))
+        goto done;
+      buffer_cache_read_meta (*slot, buffer);
+      *slot = fresh[fresh_cnt++];
+      if (level == 0)
+        {
+          indirect_truncate ((block_sector_t *) buffer, first, cnt);
+          buffer_cache_write_meta (*slot, buffer, inumber);
+          continue;
+        }
+
+      /* Copy the indirect blocks under the double indirect block,
+         then the double indirect block with pointers to the
+         copies. */
+      memcpy (dbl, buffer, fs_block_size);
+      indirect_truncate (dbl, 0, ((cnt - first + INDIRECT_BLOCK - 1)
+                                  / INDIRECT_BLOCK));
+      for (size_t i = 0; i < INDIRECT_BLOCK && dbl[i] != 0; i++)
+        {
+          if (!free_map_allocate (1, &fresh[fresh_cnt]))
+            goto done;
+          buffer_cache_read_meta (dbl[i], buffer);
+          indirect_truncate ((block_sector_t *) buffer,
+                             first + i * INDIRECT_BLOCK, cnt);
+          dbl[i] = fresh[fresh_cnt++];
+          buffer_cache_write_meta (dbl[i], buffer, inumber);
+          inode_journal_restart ();
+        }
+      buffer_cache_write_meta (*slot, dbl, inumber);
+    }
+  inode_disk_write (inumber, idisk);
+
+  /* From now on INODE's blocks may be shared, too. */
+  if (!inode->data.cloned)
+    {
+      inode->data.cloned = true;
+      inode_disk_write (inode->inumber, &inode->data);
+    }
+  success = true;
+
+ done:
+  if (!success)
+    {
+      while (fresh_cnt > 0)
+        free_map_release (fresh[--fresh_cnt], 1);
+      while (shared > 0)
+        free_map_release (index_to_sector (&inode->data, --shared), 1);
+    }
+  lock_release (&inode_extension_lock);
+  journal_end ();
+  free (buffer);
+  free (dbl);
+  free (fresh);
+  free (idisk);
+  return success;
+}
+
+/* Transfers SIZE bytes between BUFFER and INODE, starting at
+   OFFSET, without going through the buffer cache, reading if
+   WRITE is false and writing otherwise.  OFFSET and SIZE must be
+   multiples of fs_block_size, and the range must lie within the
+   file.  Data is staged through kernel pages, one run of
+   physically consecutive blocks per device request.
+   Returns false, having transferred nothing, if no staging
+   memory is available. */
+static bool
+inode_transfer_direct (struct inode *inode, uint8_t *buffer, off_t size,
+                       off_t offset, bool write)
+{
+  size_t stage_blocks = DIRECT_STAGE_PAGES * PGSIZE / fs_block_size;
+  uint8_t *stage;
+
+  ASSERT (offset % fs_block_size == 0 && size % fs_block_size == 0);
+  ASSERT (offset + size <= inode_length (inode));
+
+  stage = palloc_get_multiple (0, DIRECT_STAGE_PAGES);
+  if (stage == NULL)
+    return false;
+
+  while (size > 0)
+    {
+      block_sector_t first = byte_to_sector (inode, offset);
+      size_t cnt = 1;
+      size_t bytes;
+
+      while (cnt < stage_blocks && (off_t) (cnt * fs_block_size) < size
+             && (byte_to_sector (inode, offset + cnt * fs_block_size)
+                 == first + cnt))
+        cnt++;
+      bytes = cnt * fs_block_size;
+
+      /* Keep the cache coherent with the disk. */
+      buffer_cache_sync (first, cnt, write);
+      if (write)
+        {
+          memcpy (stage, buffer, bytes);
+          block_write_multiple (fs_device, first * fs_block_sectors,
+                                cnt * fs_block_sectors, stage);
+        }
+      else
+        {
+          block_read_multiple (fs_device, first * fs_block_sectors,
+                               cnt * fs_block_sectors, stage);
+          memcpy (buffer, stage, bytes);
+        }
+
+      buffer += bytes;
+      offset += bytes;
+      size -= bytes;
+    }
+
+  palloc_free_multiple (stage, DIRECT_STAGE_PAGES);
+  return true;
+}
+
+/* Like inode_read_at(), but reads the whole blocks in the range
+   straight from the block device, bypassing the buffer cache, so
+   that streaming a large file neither evicts other cached blocks
+   nor fills the cache with data that will not be read again.
+   Partial blocks at either end still go through the cache. */
+off_t
+inode_read_direct (struct inode *inode, void *buffer_, off_t size,
+                   off_t offset)
+{
+  uint8_t *buffer = buffer_;
+  off_t length = inode_length (inode);
+  off_t head, body;
+
+  if (inode->data.compressed)
+    return inode_read_at (inode, buffer, size, offset);
+  if (size <= 0 || offset >= length)
+    return 0;
+  if (size > length - offset)
+    size = length - offset;
+
+  head = min ((off_t) ROUND_UP (offset, fs_block_size) - offset, size);
+  body = ROUND_DOWN (size - head, (off_t) fs_block_size);
+  inode_read_at (inode, buffer, head, offset);
+  if (body > 0
+      && !inode_transfer_direct (inode, buffer + head, body, offset + head,
+                                 false))
+    body = 0;
+  return (head + body
+          + inode_read_at (inode, buffer + head + body, size - head - body,
+                           offset + head + body));
+}
+
+/* Like inode_write_at(), but writes the whole blocks in the range
+   straight to the block device, bypassing the buffer cache.
+   Partial blocks at either end still go through the cache. */
+off_t
+inode_write_direct (struct inode *inode, const void *buffer_, off_t size,
+                    off_t offset)
+{
+  uint8_t *buffer = (uint8_t *) buffer_;
+  off_t head, body;
+
+  if (inode->data.compressed)
+    return inode_write_at (inode, buffer, size, offset);
+  if (inode->deny_write_cnt || size <= 0)
+    return 0;
+  if (!inode_extend (inode, offset, offset + size)
+      || !inode_unshare (inode, offset, offset + size))
+    return 0;
+
+  head = min ((off_t) ROUND_UP (offset, fs_block_size) - offset, size);
+  body = ROUND_DOWN (size - head, (off_t) fs_block_size);
+  inode_write_at (inode, buffer, head, offset);
+  if (body > 0
+      && !inode_transfer_direct (inode, buffer + head, body, offset + head,
+                                 true))
+    body = 0;
+  return (head + body
+          + inode_write_at (inode, buffer + head + body, size - head - body,
+                            offset + head + body));
+}
+
+/* Writes INODE's dirty blocks to disk and waits for them.  Also
+   writes the inode table block holding INODE, unless DATA_ONLY is
+   true and INODE has not grown since the last sync, and, if it
+   has grown, the free maps that record its new blocks.  The data
+   goes to disk before the metadata journal is committed, so that
+   the committed metadata never points to blocks not yet written;
+   the commit makes journaled metadata durable in the log, and
+   whatever is not journaled is flushed after it. */
+void
+inode_sync (struct inode *inode, bool data_only)
+{
+  buffer_cache_flush_owner (inode->inumber);
+  journal_commit ();
+  if (!data_only || inode->meta_dirty)
+    buffer_cache_flush_block (inode_table_block (inode->inumber));
+  if (inode->meta_dirty)
+    {
+      buffer_cache_flush_owner (FREE_MAP_INODE);
+      buffer_cache_flush_owner (INODE_MAP_INODE);
+      buffer_cache_flush_owner (REFCOUNT_INODE);
+      inode->meta_dirty = false;
+    }
+}
+
+/* Makes INODE keep its data compressed if COMPRESSED is true, or
+   plainly if it is false.  Only an empty regular file with no
+   blocks can be switched, since blocks already allocated, even
+   past its end, are laid out one way or the other, and only with
+   file system blocks smaller than COMPRESS_CHUNK bytes, since a
+   chunk saves no blocks otherwise.
+   Returns true if successful, false if INODE cannot be
+   switched. */
+bool
+inode_set_compressed (struct inode *inode, bool compressed)
+{
+  if (inode->data.compressed == compressed)
+    return true;
+  if (inode_holds_metadata (inode) || inode->data.length > 0
+      || inode->data.blocks[0] != 0
+      || (compressed && fs_block_size >= COMPRESS_CHUNK))
+    return false;
+
+  journal_begin ();
+  inode->data.compressed = compressed;
+  inode_disk_write (inode->inumber, &inode->data);
+  journal_end ();
+  return true;
+}
+
 /* Disables writes to INODE.
    May be called at most once per inode opener. */
 void
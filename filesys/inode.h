@@ -3,11 +3,12 @@
 
 #include <stdbool.h>
 #include "filesys/off_t.h"
+#include "filesys/ondisk.h"
 #include "devices/block.h"
 
 struct bitmap;
 
-void inode_init (void);
+void inode_init (block_sector_t inode_table, size_t inode_cnt);
 bool inode_create (block_sector_t, off_t, bool);
 struct inode *inode_open (block_sector_t);
 struct inode *inode_reopen (struct inode *);
@@ -16,6 +17,17 @@ void inode_close (struct inode *);
 void inode_remove (struct inode *);
 off_t inode_read_at (struct inode *, void *, off_t size, off_t offset);
 off_t inode_write_at (struct inode *, const void *, off_t size, off_t offset);
+bool inode_extend (struct inode *, off_t offset, off_t length);
+bool inode_preallocate (struct inode *, off_t length);
+off_t inode_read_direct (struct inode *, void *, off_t size, off_t offset);
+off_t inode_write_direct (struct inode *, const void *, off_t size,
+                          off_t offset);
+void inode_sync (struct inode *, bool data_only);
+bool inode_advise (struct inode *, int advice, off_t offset, off_t len);
+int inode_fragments (struct inode *);
+bool inode_defragment (struct inode *);
+bool inode_set_compressed (struct inode *, bool compressed);
+bool inode_clone (struct inode *, block_sector_t inumber);
 void inode_deny_write (struct inode *);
 void inode_allow_write (struct inode *);
 off_t inode_length (const struct inode *);
@@ -0,0 +1,437 @@
+#include "filesys/journal.h"
+#include <debug.h>
+#include <hash.h>
+#include <inttypes.h>
+#include <round.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/filesys.h"
+#include "filesys/free-map.h"
+#include "devices/timer.h"
+#include "threads/palloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Metadata write-ahead journal.
+
+   Metadata blocks, that is, the inode table, indirect blocks,
+   directories and the free maps, are written through the buffer
+   cache with buffer_cache_write_meta().  Inside an operation
+   bracketed by journal_begin() and journal_end(), such a write
+   adds its block to the running transaction, which pins it in the
+   cache: it is neither evicted nor written in place.
+
+   Every JOURNAL_INTERVAL ticks, or sooner when the transaction is
+   filling up, the journal thread waits until no operation is in
+   progress and commits every operation since the last commit as
+   one transaction: a single sequential write of a descriptor
+   block listing the blocks' home locations, copies of the
+   blocks, and a commit block holding a checksum of the copies.
+   The blocks then leave the transaction, so that operations may
+   go on at once, but the log must keep the transaction until
+   they are all in place.  Putting them there (the checkpoint) and
+   advancing the header past the transaction, which frees the log
+   for the next one, is left to the journal thread, or to the next
+   commit if that comes first.  One transaction's room in the log
+   is thus enough: the running transaction lives in the cache
+   until it commits.
+
+   The log holds at most JOURNAL_TXN_MAX blocks, so each operation
+   may add at most JOURNAL_OP_MAX blocks to the transaction, for
+   which room is set aside when it begins, committing early if
+   need be.  An operation that may write more, such as growing or
+   deleting a large file, calls journal_restart() between steps
+   that each leave the file system consistent, to go on in a new
+   transaction when the running one is short of room.  A crash can
+   then keep the steps done so far without the rest, which those
+   operations arrange to leak blocks at worst.
+
+   A block freed by an operation is not handed out again until
+   the transaction that frees it has been committed and
+   checkpointed (see free_map_release()), so that neither the
+   metadata that pointed to it, should a crash undo the operation,
+   nor a copy of it in the log, should recovery replay it, can
+   meet new data there.
+
+   After a crash, journal_init() finds a transaction in the log
+   whose sequence number matches the header and whose checksum is
+   intact, and writes its blocks in place again.  Operations are
+   thus all on disk or not at all.  File data is not journaled. */
+
+/* Timer ticks between group commits. */
+#define JOURNAL_INTERVAL (TIMER_FREQ / 10)
+
+/* Most metadata blocks one operation may add to the running
+   transaction before it ends or calls journal_restart(). */
+#define JOURNAL_OP_MAX 16
+
+/* Magic numbers of journal blocks. */
+#define JOURNAL_HEADER_MAGIC 0x4a484452
+#define JOURNAL_DESCRIPTOR_MAGIC 0x4a445343
+#define JOURNAL_COMMIT_MAGIC 0x4a434d54
+
+/* Journal header, at the start of the journal's first block. */
+struct journal_header
+  {
+    unsigned magic;                     /* JOURNAL_HEADER_MAGIC. */
+    uint32_t sequence;                  /* Next transaction to replay. */
+  };
+
+/* Descriptor block, first block of a transaction in the log. */
+struct journal_descriptor
+  {
+    unsigned magic;                     /* JOURNAL_DESCRIPTOR_MAGIC. */
+    uint32_t sequence;                  /* Transaction sequence number. */
+    uint32_t cnt;                       /* Number of blocks that follow. */
+    block_sector_t sectors[JOURNAL_TXN_MAX]; /* Their home blocks. */
+  };
+
+/* Commit block, last block of a transaction in the log. */
+struct journal_commit
+  {
+    unsigned magic;                     /* JOURNAL_COMMIT_MAGIC. */
+    uint32_t sequence;                  /* Transaction sequence number. */
+    uint32_t checksum;                  /* hash_bytes() of the blocks. */
+  };
+
+/* Whether the file system has a journal, and where it is. */
+static bool journal_enabled;
+static block_sector_t journal_start;
+
+/* Sequence number of the next transaction. */
+static uint32_t sequence;
+
+/* Transaction staging area: descriptor, blocks, commit block.
+   Keeps the last committed transaction until it is checkpointed. */
+static uint8_t *stage;
+
+/* Buffer for the journal header block. */
+static uint8_t *header;
+
+/* Operations in progress, counting nested operations once.
+   Protected by journal_lock, which a commit holds throughout so
+   that no operation begins meanwhile.  Each thread counts its own
+   nesting depth in journal_depth. */
+static struct lock journal_lock;
+static struct condition ops_done;
+static int active_ops;
+
+/* Whether the transaction in the stage, which the log holds, has
+   yet to be checkpointed.  Protected by checkpoint_lock, as are
+   the stage and SEQUENCE.  A commit acquires checkpoint_lock
+   after journal_lock. */
+static struct lock checkpoint_lock;
+static bool checkpoint_pending;
+
+static thread_func journal_thread NO_RETURN;
+static void journal_reserve (void);
+static void journal_commit_locked (void);
+static void journal_checkpoint_locked (void);
+static void journal_recover (void);
+static void journal_write_header (void);
+
+/* Initializes the journal occupying CNT blocks starting at block
+   START, or leaves journaling disabled if CNT is 0.  If FORMAT is
+   true, clears the log; otherwise, first replays any committed
+   transaction left in the log by a crash, and must then be called
+   before anything else reads the file system through the buffer
+   cache. */
+void
+journal_init (block_sector_t start, size_t cnt, bool format)
+{
+  if (cnt == 0)
+    return;
+  if (cnt < JOURNAL_BLOCKS)
+    PANIC ("journal of %zu blocks is too small", cnt);
+  ASSERT (sizeof (struct journal_descriptor) <= fs_block_size);
+
+  journal_start = start;
+  lock_init (&journal_lock);
+  cond_init (&ops_done);
+  active_ops = 0;
+  lock_init (&checkpoint_lock);
+  checkpoint_pending = false;
+  stage = palloc_get_multiple (PAL_ASSERT | PAL_ZERO,
+                               DIV_ROUND_UP ((JOURNAL_TXN_MAX + 2)
+                                             * fs_block_size, PGSIZE));
+  header = palloc_get_page (PAL_ASSERT | PAL_ZERO);
+
+  sequence = 1;
+  if (format)
+    {
+      /* Clear the log, so that a transaction left there by an
+         earlier file system is not replayed into this one. */
+      block_write_multiple (fs_device,
+                            (journal_start + 1) * fs_block_sectors,
+                            (JOURNAL_TXN_MAX + 2) * fs_block_sectors,
+                            stage);
+    }
+  else
+    {
+      struct journal_header *h = (struct journal_header *) stage;
+      block_read_multiple (fs_device, journal_start * fs_block_sectors,
+                           fs_block_sectors, stage);
+      if (h->magic == JOURNAL_HEADER_MAGIC)
+        {
+          sequence = h->sequence;
+          journal_recover ();
+        }
+    }
+  journal_write_header ();
+
+  journal_enabled = true;
+  thread_create ("journal", PRI_DEFAULT, journal_thread, NULL);
+}
+
+/* Begins a metadata operation.  Its metadata writes join the
+   running transaction, which is not committed until every
+   operation in it has called journal_end().  Operations may
+   nest; an outermost one first waits until the transaction has
+   room for it. */
+void
+journal_begin (void)
+{
+  if (!journal_enabled || thread_current ()->journal_depth++ > 0)
+    return;
+  lock_acquire (&journal_lock);
+  journal_reserve ();
+  lock_release (&journal_lock);
+}
+
+/* Ends a metadata operation begun with journal_begin().  Commits
+   the running transaction right away if it is half full and no
+   other operation is in progress. */
+void
+journal_end (void)
+{
+  struct thread *t = thread_current ();
+
+  if (!journal_enabled)
+    return;
+  ASSERT (t->journal_depth > 0);
+  if (--t->journal_depth > 0)
+    return;
+
+  lock_acquire (&journal_lock);
+  ASSERT (active_ops > 0);
+  if (--active_ops == 0)
+    {
+      cond_broadcast (&ops_done, &journal_lock);
+      if (buffer_cache_journal_cnt () >= JOURNAL_TXN_MAX / 2)
+        journal_commit_locked ();
+    }
+  lock_release (&journal_lock);
+}
+
+/* Lets the running thread's operation, nested or not, go on in a
+   new transaction if the running one lacks room for another
+   JOURNAL_OP_MAX blocks from it.  Must be called at a point where
+   the file system is consistent, holding no lock that another
+   operation might wait for. */
+void
+journal_restart (void)
+{
+  if (!journal_enabled)
+    return;
+  ASSERT (thread_current ()->journal_depth > 0);
+
+  lock_acquire (&journal_lock);
+  if (buffer_cache_journal_cnt () + active_ops * JOURNAL_OP_MAX
+      > JOURNAL_TXN_MAX)
+    {
+      if (--active_ops == 0)
+        cond_broadcast (&ops_done, &journal_lock);
+      journal_reserve ();
+    }
+  lock_release (&journal_lock);
+}
+
+/* Returns true if metadata written now by the running thread
+   belongs to a transaction, false if it should be written in
+   place as usual. */
+bool
+journal_active (void)
+{
+  return journal_enabled && thread_current ()->journal_depth > 0;
+}
+
+/* Waits until the running transaction has room for JOURNAL_OP_MAX
+   blocks from each operation in progress and from one more, which
+   it then counts as in progress.  Commits the transaction instead
+   of waiting if no operation is in progress.  Must be called with
+   journal_lock held. */
+static void
+journal_reserve (void)
+{
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+
+  while (buffer_cache_journal_cnt () + (active_ops + 1) * JOURNAL_OP_MAX
+         > JOURNAL_TXN_MAX)
+    {
+      if (active_ops == 0)
+        journal_commit_locked ();
+      else
+        cond_wait (&ops_done, &journal_lock);
+    }
+  active_ops++;
+}
+
+/* Commits the running transaction to the log, waiting for
+   operations in progress to end first.  Its blocks are put in
+   place later, by journal_checkpoint().  Must not be called
+   inside an operation. */
+void
+journal_commit (void)
+{
+  if (!journal_enabled)
+    return;
+  ASSERT (thread_current ()->journal_depth == 0);
+
+  lock_acquire (&journal_lock);
+  while (active_ops > 0)
+    cond_wait (&ops_done, &journal_lock);
+  journal_commit_locked ();
+  lock_release (&journal_lock);
+}
+
+/* Puts the blocks of the last committed transaction in place, if
+   that has not been done yet, and frees the log. */
+void
+journal_checkpoint (void)
+{
+  if (!journal_enabled)
+    return;
+
+  lock_acquire (&checkpoint_lock);
+  if (checkpoint_pending)
+    journal_checkpoint_locked ();
+  lock_release (&checkpoint_lock);
+}
+
+/* Commits the running transaction to the log, after finishing
+   the checkpoint of the previous one, whose place in the log it
+   takes.  Must be called with journal_lock held and no operation
+   in progress. */
+static void
+journal_commit_locked (void)
+{
+  struct journal_descriptor *d = (struct journal_descriptor *) stage;
+  uint8_t *blocks = stage + fs_block_size;
+  size_t cnt;
+
+  ASSERT (lock_held_by_current_thread (&journal_lock));
+  ASSERT (active_ops == 0);
+
+  if (buffer_cache_journal_cnt () == 0)
+    return;
+
+  lock_acquire (&checkpoint_lock);
+  if (checkpoint_pending)
+    journal_checkpoint_locked ();
+
+  memset (d, 0, fs_block_size);
+  cnt = buffer_cache_journal_collect (d->sectors, blocks);
+  if (cnt > 0)
+    {
+      struct journal_commit *c = (struct journal_commit *)
+        (blocks + cnt * fs_block_size);
+
+      d->magic = JOURNAL_DESCRIPTOR_MAGIC;
+      d->sequence = sequence;
+      d->cnt = cnt;
+      memset (c, 0, fs_block_size);
+      c->magic = JOURNAL_COMMIT_MAGIC;
+      c->sequence = sequence;
+      c->checksum = hash_bytes (blocks, cnt * fs_block_size);
+
+      /* One sequential write for the whole transaction. */
+      block_write_multiple (fs_device,
+                            (journal_start + 1) * fs_block_sectors,
+                            (cnt + 2) * fs_block_sectors, stage);
+
+      /* Now the blocks may go home, in any order, and operations
+         may change them again. */
+      buffer_cache_journal_end ();
+      free_map_commit ();
+      checkpoint_pending = true;
+    }
+  lock_release (&checkpoint_lock);
+}
+
+/* Puts the blocks of the transaction in the stage in place and
+   advances the header past it.  Must be called with
+   checkpoint_lock held. */
+static void
+journal_checkpoint_locked (void)
+{
+  struct journal_descriptor *d = (struct journal_descriptor *) stage;
+
+  ASSERT (lock_held_by_current_thread (&checkpoint_lock));
+  ASSERT (checkpoint_pending);
+
+  buffer_cache_journal_checkpoint (d->sectors, stage + fs_block_size,
+                                   d->cnt);
+  sequence++;
+  journal_write_header ();
+  free_map_checkpoint ();
+  checkpoint_pending = false;
+}
+
+/* Replays the transaction in the log if it is the one the header
+   expects and it was committed completely. */
+static void
+journal_recover (void)
+{
+  struct journal_descriptor *d = (struct journal_descriptor *) stage;
+  uint8_t *blocks = stage + fs_block_size;
+  struct journal_commit *c;
+
+  block_read_multiple (fs_device, (journal_start + 1) * fs_block_sectors,
+                       fs_block_sectors, stage);
+  if (d->magic != JOURNAL_DESCRIPTOR_MAGIC || d->sequence != sequence
+      || d->cnt == 0 || d->cnt > JOURNAL_TXN_MAX)
+    return;
+
+  block_read_multiple (fs_device, (journal_start + 2) * fs_block_sectors,
+                       (d->cnt + 1) * fs_block_sectors, blocks);
+  c = (struct journal_commit *) (blocks + d->cnt * fs_block_size);
+  if (c->magic != JOURNAL_COMMIT_MAGIC || c->sequence != sequence
+      || c->checksum != hash_bytes (blocks, d->cnt * fs_block_size))
+    return;
+
+  for (size_t i = 0; i < d->cnt; i++)
+    block_write_multiple (fs_device, d->sectors[i] * fs_block_sectors,
+                          fs_block_sectors, blocks + i * fs_block_size);
+  printf ("journal: replayed %"PRIu32" blocks.\n", d->cnt);
+  sequence++;
+}
+
+/* Writes the journal header, recording that transactions before
+   SEQUENCE need no replay. */
+static void
+journal_write_header (void)
+{
+  struct journal_header *h = (struct journal_header *) header;
+
+  memset (header, 0, fs_block_size);
+  h->magic = JOURNAL_HEADER_MAGIC;
+  h->sequence = sequence;
+  block_write_multiple (fs_device, journal_start * fs_block_sectors,
+                        fs_block_sectors, header);
+}
+
+/* Journal thread.  Group-commits whatever operations have
+   completed since the last commit, then checkpoints the
+   transaction, off the path of the operations that follow. */
+static void
+journal_thread (void *aux UNUSED)
+{
+  for (;;)
+    {
+      timer_sleep (JOURNAL_INTERVAL);
+      journal_commit ();
+      journal_checkpoint ();
+    }
+}
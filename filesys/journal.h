@@ -0,0 +1,17 @@
+#ifndef FILESYS_JOURNAL_H
+#define FILESYS_JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "filesys/ondisk.h"
+#include "devices/block.h"
+
+void journal_init (block_sector_t start, size_t cnt, bool format);
+void journal_begin (void);
+void journal_end (void);
+void journal_restart (void);
+bool journal_active (void);
+void journal_commit (void);
+void journal_checkpoint (void);
+
+#endif /* filesys/journal.h */
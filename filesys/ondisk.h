@@ -0,0 +1,174 @@
+#ifndef FILESYS_ONDISK_H
+#define FILESYS_ONDISK_H
+
+/* On-disk format of the file system.
+
+   Besides the kernel, this header is compiled on the host by
+   utils/pintos-mkfs, which builds file system images directly, so
+   it must not depend on any other kernel header.  Block numbers
+   are plain uint32_t here, the same type as block_sector_t. */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Size of a device sector in bytes, the same as
+   BLOCK_SECTOR_SIZE. */
+#define DISK_SECTOR_SIZE 512
+
+/* Supported file system block sizes, in bytes. */
+#define FS_BLOCK_SIZE_MIN DISK_SECTOR_SIZE
+#define FS_BLOCK_SIZE_MAX 4096
+
+/* Block of the superblock.  The inode table follows it. */
+#define SUPER_BLOCK 0
+
+/* Identifies a superblock. */
+#define SUPER_MAGIC 0x50465342
+
+/* Version of the format described here.  Superblocks older than
+   version 1 end at block_cnt and are never marked clean. */
+#define SUPER_VERSION 1
+
+/* Bytes of file system space per inode in a new file system. */
+#define INODE_RATIO 4096
+
+/* Minimum number of inodes in a new file system. */
+#define INODE_CNT_MIN 16
+
+/* Inode numbers of system files.  Inode numbers index the inode
+   table; they are not block numbers. */
+#define FREE_MAP_INODE 0        /* Free block map file inode. */
+#define ROOT_DIR_INODE 1        /* Root directory file inode. */
+#define INODE_MAP_INODE 2       /* Free inode map file inode. */
+#define REFCOUNT_INODE 3        /* Block reference count file inode. */
+
+/* Most metadata blocks in one journal transaction. */
+#define JOURNAL_TXN_MAX 32
+
+/* Blocks in the on-disk journal: a header, then one transaction's
+   descriptor block, metadata blocks, and commit block.  A journal
+   whose header block is all zeros holds nothing to replay. */
+#define JOURNAL_BLOCKS (JOURNAL_TXN_MAX + 3)
+
+/* On-disk superblock.
+   Lives at the start of block SUPER_BLOCK.  Must be exactly
+   DISK_SECTOR_SIZE bytes long, so that it can be read before the
+   file system block size is known.
+
+   While the file system is mounted, CLEAN is 0.  Unmounting
+   cleanly stores the free counts and allocation hints and sets
+   CLEAN, so that the next mount may trust them rather than count
+   the free maps; after a crash they must be counted again. */
+struct super_block
+  {
+    uint32_t magic;                     /* Magic number. */
+    uint32_t block_size;                /* Bytes per file system block. */
+    uint32_t inode_cnt;                 /* Number of inodes. */
+    uint32_t inode_table;               /* First block of inode table. */
+    uint32_t data_start;                /* First block after metadata. */
+    uint32_t journal_start;             /* First block of journal. */
+    uint32_t journal_cnt;               /* Journal blocks, 0 if none. */
+    uint32_t block_cnt;                 /* Blocks in file system, or 0
+                                           for the whole device. */
+    uint32_t version;                   /* Format version. */
+    uint32_t clean;                     /* Cleanly unmounted? */
+    uint32_t free_blocks;               /* Free blocks, if clean. */
+    uint32_t free_inodes;               /* Free inodes, if clean. */
+    uint32_t block_hint;                /* No free block below this. */
+    uint32_t inode_hint;                /* No free inode below this. */
+    uint8_t unused[DISK_SECTOR_SIZE - 14 * sizeof (uint32_t)];
+  };
+
+/* Size of an on-disk inode in bytes.  Several inodes are packed
+   into each block of the inode table. */
+#define INODE_DISK_SIZE 128
+
+/* Identifies an inode. */
+#define INODE_MAGIC 0x494e4f44
+
+/* Number of direct blocks in an inode. */
+#define DIRECT_BLOCK 12
+
+/* On-disk inode.
+   Must be exactly INODE_DISK_SIZE bytes long.  Inode number N is
+   stored in the inode table at byte N * INODE_DISK_SIZE.
+
+   An indirect block, and a double indirect block, are arrays of
+   block numbers filling one file system block.  A block number of
+   0 means that the block is not allocated. */
+struct inode_disk
+  {
+    /* Direct and indirect blocks.
+       - DIRECT_BLOCK blocks
+       - 1 indirect block
+       - 1 double indirect block */
+    uint32_t blocks[DIRECT_BLOCK + 2];
+
+    /* inode metadata */
+    int32_t length;                           /* File size in bytes. */
+    uint32_t magic;                           /* Magic number. */
+
+    bool is_dir;                               /* whether it is a directory */
+    bool compressed;                          /* Stored in chunks? */
+    bool cloned;                              /* May share blocks? */
+    /* MODIFY THE FOLLOWING IF VARIABLES IN THIS STRUCTURE ARE MODIFIED */
+    /* To meet INODE_DISK_SIZE size requirement. */
+    char unused[INODE_DISK_SIZE
+                - sizeof (uint32_t) * (DIRECT_BLOCK + 2)  /* blocks */
+                - sizeof (int32_t)            /* length */
+                - sizeof (uint32_t)           /* magic */
+                - sizeof (bool)               /* is_dir */
+                - sizeof (bool)               /* compressed */
+                - sizeof (bool)               /* cloned */
+               ];
+  };
+
+/* Maximum length of a file name component.
+   This is the traditional UNIX maximum length.
+   After directories are implemented, this maximum length may be
+   retained, but much longer full path names must be allowed. */
+#define NAME_MAX 14
+
+/* A single directory entry.  The first entry of every directory
+   names no file; its inode_sector is the inode number of the
+   parent directory, and the root directory is its own parent. */
+struct dir_entry
+  {
+    uint32_t inode_sector;              /* Inode number of header. */
+    char name[NAME_MAX + 1];            /* Null terminated file name. */
+    bool in_use;                        /* In use or free? */
+  };
+
+/* Lays out a new file system of BLOCK_CNT blocks of BLOCK_SIZE
+   bytes each in SUPER: the superblock, then a contiguous inode
+   table with one inode per INODE_RATIO bytes of space, then the
+   metadata journal, then data blocks.  Returns false if BLOCK_CNT
+   is too small to leave room for any data. */
+static inline bool
+super_block_init (struct super_block *super, uint32_t block_cnt,
+                  uint32_t block_size)
+{
+  uint32_t inodes_per_block = block_size / INODE_DISK_SIZE;
+  uint32_t inode_cnt, table_blocks;
+
+  inode_cnt = (uint64_t) block_cnt * block_size / INODE_RATIO;
+  if (inode_cnt < INODE_CNT_MIN)
+    inode_cnt = INODE_CNT_MIN;
+  table_blocks = (inode_cnt + inodes_per_block - 1) / inodes_per_block;
+  if ((uint64_t) SUPER_BLOCK + 1 + table_blocks + JOURNAL_BLOCKS
+      >= block_cnt)
+    return false;
+
+  *super = (struct super_block) { .magic = SUPER_MAGIC,
+                                  .version = SUPER_VERSION };
+  super->block_size = block_size;
+  super->inode_cnt = table_blocks * inodes_per_block;
+  super->inode_table = SUPER_BLOCK + 1;
+  super->journal_start = super->inode_table + table_blocks;
+  super->journal_cnt = JOURNAL_BLOCKS;
+  super->data_start = super->journal_start + super->journal_cnt;
+  super->block_cnt = block_cnt;
+  return true;
+}
+
+#endif /* filesys/ondisk.h */
@@ -0,0 +1,31 @@
+#ifndef __LIB_AIO_H
+#define __LIB_AIO_H
+
+#include <stddef.h>
+
+/* Operations for aio_op. */
+#define AIO_READ 0              /* Read from the file into aio_buf. */
+#define AIO_WRITE 1             /* Write aio_buf to the file. */
+
+/* One asynchronous read or write, passed to aio_submit() and
+   handed back by aio_reap() once it has completed.  The control
+   block and its buffer must stay valid and untouched until then. */
+struct aiocb
+  {
+    int aio_fd;                 /* Open file descriptor. */
+    int aio_op;                 /* AIO_READ or AIO_WRITE. */
+    void *aio_buf;              /* Data buffer. */
+    size_t aio_nbytes;          /* Length of transfer in bytes. */
+    unsigned aio_offset;        /* File offset of transfer. */
+    int aio_result;             /* Bytes transferred, or -1; set by
+                                   aio_reap(). */
+  };
+
+/* Maximum number of requests a process may have submitted but not
+   yet reaped. */
+#define AIO_MAX 32
+
+/* Maximum length of one request. */
+#define AIO_MAX_NBYTES 65536
+
+#endif /* lib/aio.h */
@@ -0,0 +1,27 @@
+#ifndef __LIB_BLKSTAT_H
+#define __LIB_BLKSTAT_H
+
+#include <stdint.h>
+
+/* Number of latency histogram buckets.  Bucket I counts requests
+   that took from 2**I to 2**(I+1) - 1 CPU cycles, as measured
+   with the time-stamp counter, except that the last bucket also
+   counts anything slower. */
+#define BLKSTAT_BUCKETS 32
+
+/* I/O statistics for a block device, as reported by the kernel's
+   block layer and the blkstat() system call. */
+struct blkstat
+  {
+    uint64_t read_reqs;                 /* Read requests submitted. */
+    uint64_t write_reqs;                /* Write requests submitted. */
+    uint64_t read_bytes;                /* Bytes read. */
+    uint64_t write_bytes;               /* Bytes written. */
+    uint64_t merge_cnt;                 /* Requests merged into others. */
+    uint32_t in_flight;                 /* Requests not yet completed. */
+    uint32_t max_in_flight;             /* Most ever in flight at once. */
+    uint64_t read_hist[BLKSTAT_BUCKETS];        /* Read latencies. */
+    uint64_t write_hist[BLKSTAT_BUCKETS];       /* Write latencies. */
+  };
+
+#endif /* lib/blkstat.h */
@@ -0,0 +1,12 @@
+#ifndef __LIB_FADVISE_H
+#define __LIB_FADVISE_H
+
+/* Access-pattern advice for fadvise(). */
+#define FADV_NORMAL 0           /* No particular pattern. */
+#define FADV_SEQUENTIAL 1       /* Read in order: read ahead further. */
+#define FADV_RANDOM 2           /* Read out of order: no read-ahead. */
+#define FADV_WILLNEED 3         /* Range will be read soon: load it. */
+#define FADV_DONTNEED 4         /* Range will not be read: drop it. */
+#define FADV_NOREUSE 5          /* Data is used once: evict it first. */
+
+#endif /* lib/fadvise.h */
@@ -0,0 +1,199 @@
+/* LZ77-family compression.
+
+   The compressed form is a series of sequences, each of which is
+   a token byte, literals, and a match:
+
+     - The token's high 4 bits are the number of literals and its
+       low 4 bits the match length less LZ_MIN_MATCH.  A value of
+       15 in either is followed by extra length bytes that are
+       added to it, up to and including the first byte that is
+       not 255.
+
+     - The literals are copied to the output as they are.
+
+     - The match is a 2-byte little-endian offset back into the
+       output, from 1 to 65535, followed by any extra match length
+       bytes.  Matched bytes may overlap the bytes they produce.
+
+   The last sequence ends after its literals and has no match. */
+
+#include "lz.h"
+#include <string.h>
+#include "../debug.h"
+
+/* Shortest match worth encoding. */
+#define LZ_MIN_MATCH 4
+
+/* Farthest back a match may reach. */
+#define LZ_MAX_OFFSET 65535
+
+/* Returns the match table slot for the 4 bytes at P. */
+static inline unsigned
+hash4 (const uint8_t *p)
+{
+  uint32_t v;
+  memcpy (&v, p, sizeof v);
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Stores the extra bytes for length LEN, already reduced by 15,
+   at OP.  Returns the end of what was stored, or a null pointer
+   if it would not fit before END. */
+static uint8_t *
+put_length (uint8_t *op, uint8_t *end, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    {
+      if (op >= end)
+        return NULL;
+      *op++ = 255;
+    }
+  if (op >= end)
+    return NULL;
+  *op++ = len;
+  return op;
+}
+
+/* Stores a sequence of the LIT_CNT literals at LIT and a match of
+   MATCH_LEN bytes at OFFSET, or no match if MATCH_LEN is 0, at OP.
+   Returns the end of what was stored, or a null pointer if it
+   would not fit before END. */
+static uint8_t *
+put_sequence (uint8_t *op, uint8_t *end, const uint8_t *lit,
+              size_t lit_cnt, size_t offset, size_t match_len)
+{
+  uint8_t *token;
+
+  if (op >= end)
+    return NULL;
+  token = op++;
+  *token = (lit_cnt < 15 ? lit_cnt : 15) << 4;
+  if (lit_cnt >= 15 && (op = put_length (op, end, lit_cnt - 15)) == NULL)
+    return NULL;
+  if ((size_t) (end - op) < lit_cnt)
+    return NULL;
+  memcpy (op, lit, lit_cnt);
+  op += lit_cnt;
+  if (match_len == 0)
+    return op;
+
+  match_len -= LZ_MIN_MATCH;
+  *token |= match_len < 15 ? match_len : 15;
+  if (end - op < 2)
+    return NULL;
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+  if (match_len >= 15 && (op = put_length (op, end, match_len - 15)) == NULL)
+    return NULL;
+  return op;
+}
+
+/* Compresses the SRC_LEN bytes at SRC, which may be at most
+   LZ_MAX_INPUT, into DST, using WORK, LZ_WORK_SIZE bytes of
+   scratch memory.  Returns the compressed size, or 0 if it would
+   exceed DST_CAP bytes. */
+size_t
+lz_compress (const void *src_, size_t src_len, void *dst_,
+             size_t dst_cap, void *work)
+{
+  const uint8_t *src = src_;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst, *end = dst + dst_cap;
+  uint16_t *table = work;
+  size_t anchor = 0, ip = 0;
+
+  ASSERT (src_len <= LZ_MAX_INPUT);
+
+  /* Table entries hold a position plus 1, so that 0 means none. */
+  memset (table, 0, LZ_WORK_SIZE);
+  while (ip + LZ_MIN_MATCH <= src_len)
+    {
+      unsigned h = hash4 (src + ip);
+      size_t cand = table[h];
+      table[h] = ip + 1;
+
+      if (cand != 0 && ip - (cand - 1) <= LZ_MAX_OFFSET
+          && !memcmp (src + cand - 1, src + ip, LZ_MIN_MATCH))
+        {
+          size_t match = cand - 1;
+          size_t len = LZ_MIN_MATCH;
+          while (ip + len < src_len && src[match + len] == src[ip + len])
+            len++;
+
+          op = put_sequence (op, end, src + anchor, ip - anchor,
+                             ip - match, len);
+          if (op == NULL)
+            return 0;
+          ip += len;
+          anchor = ip;
+        }
+      else
+        ip++;
+    }
+
+  op = put_sequence (op, end, src + anchor, src_len - anchor, 0, 0);
+  return op != NULL ? (size_t) (op - dst) : 0;
+}
+
+/* Reads extra length bytes at *IP, before END, adding them to
+   *LEN.  Returns false if the input ends first. */
+static bool
+get_length (const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+  uint8_t b;
+  do
+    {
+      if (*ip >= end)
+        return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+  return true;
+}
+
+/* Decompresses the SRC_LEN bytes at SRC into DST, which must come
+   to exactly DST_LEN bytes.  Returns true if successful, false if
+   the input is malformed. */
+bool
+lz_decompress (const void *src_, size_t src_len, void *dst_,
+               size_t dst_len)
+{
+  const uint8_t *ip = src_, *iend = ip + src_len;
+  uint8_t *dst = dst_;
+  uint8_t *op = dst, *oend = dst + dst_len;
+
+  while (ip < iend)
+    {
+      unsigned token = *ip++;
+      size_t len, offset;
+
+      /* Literals. */
+      len = token >> 4;
+      if (len == 15 && !get_length (&ip, iend, &len))
+        return false;
+      if ((size_t) (iend - ip) < len || (size_t) (oend - op) < len)
+        return false;
+      memcpy (op, ip, len);
+      op += len;
+      ip += len;
+      if (ip == iend)
+        break;
+
+      /* Match. */
+      if (iend - ip < 2)
+        return false;
+      offset = ip[0] | (ip[1] << 8);
+      ip += 2;
+      len = token & 15;
+      if (len == 15 && !get_length (&ip, iend, &len))
+        return false;
+      len += LZ_MIN_MATCH;
+      if (offset == 0 || offset > (size_t) (op - dst)
+          || (size_t) (oend - op) < len)
+        return false;
+      for (const uint8_t *m = op - offset; len > 0; len--)
+        *op++ = *m++;
+    }
+  return op == oend;
+}
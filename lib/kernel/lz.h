@@ -0,0 +1,24 @@
+#ifndef __LIB_KERNEL_LZ_H
+#define __LIB_KERNEL_LZ_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* LZ77-family compression, in the style of LZ4. */
+
+/* log2 of the number of entries in the compressor's match table. */
+#define LZ_HASH_BITS 11
+
+/* Bytes of scratch memory that lz_compress() needs. */
+#define LZ_WORK_SIZE ((1 << LZ_HASH_BITS) * sizeof (uint16_t))
+
+/* Longest input lz_compress() accepts. */
+#define LZ_MAX_INPUT 65535
+
+size_t lz_compress (const void *src, size_t src_len, void *dst,
+                    size_t dst_cap, void *work);
+bool lz_decompress (const void *src, size_t src_len, void *dst,
+                    size_t dst_len);
+
+#endif /* lib/kernel/lz.h */
@@ -0,0 +1,18 @@
+#ifndef __LIB_STATFS_H
+#define __LIB_STATFS_H
+
+#include <stdint.h>
+
+/* Summary of the file system, as reported by the statfs() system
+   call.  The kernel keeps the free counts up to date as blocks and
+   inodes are allocated and freed, so it need not count them. */
+struct statfs
+  {
+    uint32_t block_size;                /* Bytes per block. */
+    uint32_t block_cnt;                 /* Blocks in the file system. */
+    uint32_t free_blocks;               /* Blocks not in use. */
+    uint32_t inode_cnt;                 /* Inodes in the file system. */
+    uint32_t free_inodes;               /* Inodes not in use. */
+  };
+
+#endif /* lib/statfs.h */
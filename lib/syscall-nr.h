@@ -28,7 +28,27 @@ enum
     SYS_MKDIR,                  /* Create a directory. */
     SYS_READDIR,                /* Reads a directory entry. */
     SYS_ISDIR,                  /* Tests if a fd represents a directory. */
-    SYS_INUMBER                 /* Returns the inode number for a fd. */
+    SYS_INUMBER,                /* Returns the inode number for a fd. */
+
+    /* Extensions. */
+    SYS_BLKSTAT,                /* Reports block device statistics. */
+    SYS_DIRECTIO,               /* Bypasses the buffer cache for a fd. */
+    SYS_FSYNC,                  /* Writes a file's data and metadata. */
+    SYS_FDATASYNC,              /* Writes a file's data. */
+    SYS_PREAD,                  /* Reads from a given file offset. */
+    SYS_PWRITE,                 /* Writes at a given file offset. */
+    SYS_READV,                  /* Reads into several buffers. */
+    SYS_WRITEV,                 /* Writes from several buffers. */
+    SYS_SENDFILE,               /* Copies between fds in the kernel. */
+    SYS_AIO_SUBMIT,             /* Queues asynchronous reads and writes. */
+    SYS_AIO_REAP,               /* Collects finished asynchronous I/O. */
+    SYS_FADVISE,                /* Advises on a file's access pattern. */
+    SYS_DEFRAG,                 /* Makes a file's blocks consecutive. */
+    SYS_COMPRESS,               /* Turns on compression for a file. */
+    SYS_CLONE,                  /* Clones a file, sharing its blocks. */
+    SYS_STATFS,                 /* Reports file system free space. */
+
+    SYS_CNT                     /* Number of system calls. */
   };
 
 #endif /* lib/syscall-nr.h */
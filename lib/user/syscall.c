@@ -61,6 +61,25 @@
           retval;                                               \
         })
 
+/* Invokes syscall NUMBER, passing arguments ARG0, ARG1, ARG2,
+   and ARG3, and returns the return value as an `int'. */
+#define syscall4(NUMBER, ARG0, ARG1, ARG2, ARG3)                \
+        ({                                                      \
+          int retval;                                           \
+          asm volatile                                          \
+            ("pushl %[arg3]; pushl %[arg2]; pushl %[arg1]; "    \
+             "pushl %[arg0]; "                                  \
+             "pushl %[number]; int $0x30; addl $20, %%esp"      \
+               : "=a" (retval)                                  \
+               : [number] "i" (NUMBER),                         \
+                 [arg0] "r" (ARG0),                             \
+                 [arg1] "r" (ARG1),                             \
+                 [arg2] "r" (ARG2),                             \
+                 [arg3] "r" (ARG3)                              \
+               : "memory");                                     \
+          retval;                                               \
+        })
+
 void
 halt (void) 
 {
@@ -182,3 +201,99 @@ inumber (int fd)
 {
   return syscall1 (SYS_INUMBER, fd);
 }
+
+bool
+blkstat (const char *device, struct blkstat *st)
+{
+  return syscall2 (SYS_BLKSTAT, device, st);
+}
+
+bool
+directio (int fd, bool enable)
+{
+  return syscall2 (SYS_DIRECTIO, fd, (int) enable);
+}
+
+bool
+fsync (int fd)
+{
+  return syscall1 (SYS_FSYNC, fd);
+}
+
+bool
+fdatasync (int fd)
+{
+  return syscall1 (SYS_FDATASYNC, fd);
+}
+
+int
+pread (int fd, void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PREAD, fd, buffer, size, offset);
+}
+
+int
+pwrite (int fd, const void *buffer, unsigned size, unsigned offset)
+{
+  return syscall4 (SYS_PWRITE, fd, buffer, size, offset);
+}
+
+int
+readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_READV, fd, iov, iovcnt);
+}
+
+int
+writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  return syscall3 (SYS_WRITEV, fd, iov, iovcnt);
+}
+
+int
+sendfile (int out_fd, int in_fd, unsigned length)
+{
+  return syscall3 (SYS_SENDFILE, out_fd, in_fd, length);
+}
+
+int
+aio_submit (struct aiocb *cbs[], int cnt)
+{
+  return syscall2 (SYS_AIO_SUBMIT, cbs, cnt);
+}
+
+int
+aio_reap (struct aiocb *done[], int max, bool wait)
+{
+  return syscall3 (SYS_AIO_REAP, done, max, (int) wait);
+}
+
+bool
+fadvise (int fd, unsigned offset, unsigned len, int advice)
+{
+  return syscall4 (SYS_FADVISE, fd, offset, len, advice);
+}
+
+bool
+defrag (int fd)
+{
+  return syscall1 (SYS_DEFRAG, fd);
+}
+
+bool
+compress (int fd, bool enable)
+{
+  return syscall2 (SYS_COMPRESS, fd, (int) enable);
+}
+
+bool
+clone (const char *file, const char *new_file)
+{
+  return syscall2 (SYS_CLONE, file, new_file);
+}
+
+bool
+statfs (struct statfs *st)
+{
+  return syscall1 (SYS_STATFS, st);
+}
@@ -3,6 +3,11 @@
 
 #include <stdbool.h>
 #include <debug.h>
+#include <aio.h>
+#include <blkstat.h>
+#include <fadvise.h>
+#include <statfs.h>
+#include <uio.h>
 
 /* Process identifier. */
 typedef int pid_t;
@@ -45,4 +50,22 @@ bool readdir (int fd, char name[READDIR_MAX_LEN + 1]);
 bool isdir (int fd);
 int inumber (int fd);
 
+/* Extensions. */
+bool blkstat (const char *device, struct blkstat *);
+bool directio (int fd, bool enable);
+bool fsync (int fd);
+bool fdatasync (int fd);
+int pread (int fd, void *buffer, unsigned length, unsigned offset);
+int pwrite (int fd, const void *buffer, unsigned length, unsigned offset);
+int readv (int fd, const struct iovec *, int iovcnt);
+int writev (int fd, const struct iovec *, int iovcnt);
+int sendfile (int out_fd, int in_fd, unsigned length);
+int aio_submit (struct aiocb *cbs[], int cnt);
+int aio_reap (struct aiocb *done[], int max, bool wait);
+bool fadvise (int fd, unsigned offset, unsigned len, int advice);
+bool defrag (int fd);
+bool compress (int fd, bool enable);
+bool clone (const char *file, const char *new_file);
+bool statfs (struct statfs *);
+
 #endif /* lib/user/syscall.h */
@@ -0,0 +1,35 @@
+/* Submits asynchronous writes and exits without reaping them.
+   The kernel must finish them before the process goes away, as
+   the persistence test checks, and must not crash meanwhile. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PARTS 4
+#define PART_SIZE 3000
+static char buf[PARTS * PART_SIZE];
+
+void
+test_main (void)
+{
+  static struct aiocb cbs[PARTS];
+  struct aiocb *list[PARTS];
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  for (int i = 0; i < PARTS; i++)
+    {
+      cbs[i] = (struct aiocb) { .aio_fd = fd, .aio_op = AIO_WRITE,
+                                .aio_buf = buf + i * PART_SIZE,
+                                .aio_nbytes = PART_SIZE,
+                                .aio_offset = i * PART_SIZE };
+      list[i] = &cbs[i];
+    }
+  CHECK (aio_submit (list, PARTS) == PARTS, "submit writes");
+  msg ("exit without reaping");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-exit) begin
+(aio-exit) create "data"
+(aio-exit) open "data"
+(aio-exit) submit writes
+(aio-exit) exit without reaping
+(aio-exit) end
+EOF
+pass;
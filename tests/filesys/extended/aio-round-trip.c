@@ -0,0 +1,71 @@
+/* Writes a file with two asynchronous writes, each longer than a
+   page, reaps them, reads the file back with asynchronous reads
+   into separate buffers, and checks what each reports and
+   reads. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define PART_SIZE 5000
+#define FILE_SIZE (2 * PART_SIZE)
+static char buf[FILE_SIZE];
+static char data[FILE_SIZE];
+
+/* Submits the two requests in CBS and waits for both. */
+static void
+submit_and_reap (struct aiocb cbs[2], const char *what)
+{
+  struct aiocb *list[2] = { &cbs[0], &cbs[1] };
+  struct aiocb *done[2];
+  int reaped = 0;
+
+  CHECK (aio_submit (list, 2) == 2, "submit %s", what);
+  while (reaped < 2)
+    {
+      int n = aio_reap (done + reaped, 2 - reaped, true);
+      if (n < 1)
+        fail ("aio_reap returned %d", n);
+      reaped += n;
+    }
+  msg ("reaped %s", what);
+  for (int i = 0; i < 2; i++)
+    if (cbs[i].aio_result != PART_SIZE)
+      fail ("request %d of %s transferred %d bytes", i, what,
+            cbs[i].aio_result);
+  if (!((done[0] == &cbs[0] && done[1] == &cbs[1])
+        || (done[0] == &cbs[1] && done[1] == &cbs[0])))
+    fail ("aio_reap returned the wrong control blocks");
+}
+
+void
+test_main (void)
+{
+  struct aiocb cbs[2];
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  for (int i = 0; i < 2; i++)
+    cbs[i] = (struct aiocb) { .aio_fd = fd, .aio_op = AIO_WRITE,
+                              .aio_buf = buf + i * PART_SIZE,
+                              .aio_nbytes = PART_SIZE,
+                              .aio_offset = i * PART_SIZE };
+  submit_and_reap (cbs, "writes");
+
+  for (int i = 0; i < 2; i++)
+    cbs[i] = (struct aiocb) { .aio_fd = fd, .aio_op = AIO_READ,
+                              .aio_buf = data + i * PART_SIZE,
+                              .aio_nbytes = PART_SIZE,
+                              .aio_offset = i * PART_SIZE };
+  submit_and_reap (cbs, "reads");
+  compare_bytes (data, buf, sizeof data, 0, "data");
+
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", buf, sizeof buf);
+}
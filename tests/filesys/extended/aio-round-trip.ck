@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(aio-round-trip) begin
+(aio-round-trip) create "data"
+(aio-round-trip) open "data"
+(aio-round-trip) submit writes
+(aio-round-trip) reaped writes
+(aio-round-trip) submit reads
+(aio-round-trip) reaped reads
+(aio-round-trip) close "data"
+(aio-round-trip) open "data" for verification
+(aio-round-trip) verified contents of "data"
+(aio-round-trip) close "data"
+(aio-round-trip) end
+EOF
+pass;
@@ -0,0 +1,12 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($a) = random_bytes (9000);
+my ($patch) = random_bytes (100);
+my ($b) = $a;
+substr ($b, 5000, 100) = $patch;
+$a .= random_bytes (600);
+check_archive ({"a" => [$a], "b" => [$b]});
+pass;
@@ -0,0 +1,54 @@
+/* Clones a file that reaches into its indirect block, writes
+   into the clone and appends to the original, and checks after
+   each step that the other file is unchanged. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 9000
+#define PATCH_OFS 5000
+static char buf_a[FILE_SIZE + 600];
+static char buf_b[FILE_SIZE];
+static char patch[100];
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_bytes (buf_a, FILE_SIZE);
+  random_bytes (patch, sizeof patch);
+  random_bytes (buf_a + FILE_SIZE, sizeof buf_a - FILE_SIZE);
+  memcpy (buf_b, buf_a, FILE_SIZE);
+  memcpy (buf_b + PATCH_OFS, patch, sizeof patch);
+
+  CHECK (create ("a", 0), "create \"a\"");
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  CHECK (write (fd, buf_a, FILE_SIZE) == FILE_SIZE, "write \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+
+  CHECK (clone ("a", "b"), "clone \"a\" as \"b\"");
+  check_file ("b", buf_a, FILE_SIZE);
+
+  CHECK ((fd = open ("b")) > 1, "open \"b\"");
+  seek (fd, PATCH_OFS);
+  CHECK (write (fd, patch, sizeof patch) == (int) sizeof patch,
+         "write into \"b\"");
+  msg ("close \"b\"");
+  close (fd);
+  check_file ("a", buf_a, FILE_SIZE);
+  check_file ("b", buf_b, FILE_SIZE);
+
+  CHECK ((fd = open ("a")) > 1, "open \"a\"");
+  seek (fd, FILE_SIZE);
+  CHECK (write (fd, buf_a + FILE_SIZE, sizeof buf_a - FILE_SIZE)
+         == (int) (sizeof buf_a - FILE_SIZE), "append to \"a\"");
+  msg ("close \"a\"");
+  close (fd);
+  check_file ("a", buf_a, sizeof buf_a);
+  check_file ("b", buf_b, FILE_SIZE);
+}
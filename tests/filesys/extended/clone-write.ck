@@ -0,0 +1,35 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(clone-write) begin
+(clone-write) create "a"
+(clone-write) open "a"
+(clone-write) write "a"
+(clone-write) close "a"
+(clone-write) clone "a" as "b"
+(clone-write) open "b" for verification
+(clone-write) verified contents of "b"
+(clone-write) close "b"
+(clone-write) open "b"
+(clone-write) write into "b"
+(clone-write) close "b"
+(clone-write) open "a" for verification
+(clone-write) verified contents of "a"
+(clone-write) close "a"
+(clone-write) open "b" for verification
+(clone-write) verified contents of "b"
+(clone-write) close "b"
+(clone-write) open "a"
+(clone-write) append to "a"
+(clone-write) close "a"
+(clone-write) open "a" for verification
+(clone-write) verified contents of "a"
+(clone-write) close "a"
+(clone-write) open "b" for verification
+(clone-write) verified contents of "b"
+(clone-write) close "b"
+(clone-write) end
+EOF
+pass;
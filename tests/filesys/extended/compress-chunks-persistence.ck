@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($buf) = join ('', map (chr (ord ('a') + int ($_ / 7) % 26),
+                          0 .. 12999));
+substr ($buf, 4000, 300) = random_bytes (300);
+check_archive ({"data" => [$buf]});
+pass;
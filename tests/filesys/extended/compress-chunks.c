@@ -0,0 +1,49 @@
+/* Writes a compressed file in pieces that straddle its chunks,
+   overwrites part of it across a chunk boundary, and checks its
+   contents. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 13000
+#define PIECE 1000
+#define PATCH_OFS 4000
+static char buf[FILE_SIZE];
+static char patch[300];
+
+void
+test_main (void)
+{
+  size_t ofs;
+  int fd;
+
+  for (ofs = 0; ofs < FILE_SIZE; ofs++)
+    buf[ofs] = 'a' + ofs / 7 % 26;
+  random_bytes (patch, sizeof patch);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (compress (fd, true), "compress \"data\"");
+
+  msg ("writing \"data\"");
+  for (ofs = 0; ofs < FILE_SIZE; ofs += PIECE)
+    {
+      size_t size = FILE_SIZE - ofs < PIECE ? FILE_SIZE - ofs : PIECE;
+      if (write (fd, buf + ofs, size) != (int) size)
+        fail ("write %zu bytes at offset %zu in \"data\" failed",
+              size, ofs);
+    }
+  seek (fd, PATCH_OFS);
+  CHECK (write (fd, patch, sizeof patch) == (int) sizeof patch,
+         "overwrite \"data\" across a chunk boundary");
+  memcpy (buf + PATCH_OFS, patch, sizeof patch);
+  CHECK (!compress (fd, false),
+         "uncompress nonempty \"data\" (must return false)");
+
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", buf, sizeof buf);
+}
@@ -0,0 +1,19 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(compress-chunks) begin
+(compress-chunks) create "data"
+(compress-chunks) open "data"
+(compress-chunks) compress "data"
+(compress-chunks) writing "data"
+(compress-chunks) overwrite "data" across a chunk boundary
+(compress-chunks) uncompress nonempty "data" (must return false)
+(compress-chunks) close "data"
+(compress-chunks) open "data" for verification
+(compress-chunks) verified contents of "data"
+(compress-chunks) close "data"
+(compress-chunks) end
+EOF
+pass;
@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($buf) = random_bytes (12000);
+my ($patch) = random_bytes (7000);
+substr ($buf, 1500, 7000) = $patch;
+check_archive ({"data" => [$buf]});
+pass;
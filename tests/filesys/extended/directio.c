@@ -0,0 +1,48 @@
+/* Writes a file through the buffer cache, then turns on direct
+   I/O and reads and overwrites ranges that start and end in the
+   middle of blocks, and checks after turning direct I/O off again
+   that the cache and the disk agree on the contents. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 12000
+static char buf[FILE_SIZE];
+static char patch[7000];
+static char expected[FILE_SIZE];
+static char data[FILE_SIZE];
+
+void
+test_main (void)
+{
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  random_bytes (patch, sizeof patch);
+  memcpy (expected, buf, sizeof buf);
+  memcpy (expected + 1500, patch, sizeof patch);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == FILE_SIZE, "write \"data\"");
+  CHECK (directio (fd, true), "turn on direct I/O");
+
+  seek (fd, 100);
+  CHECK (read (fd, data, 9000) == 9000, "read \"data\" at offset 100");
+  compare_bytes (data, buf + 100, 9000, 100, "data");
+
+  seek (fd, 1500);
+  CHECK (write (fd, patch, sizeof patch) == (int) sizeof patch,
+         "write \"data\" at offset 1500");
+  seek (fd, 0);
+  CHECK (read (fd, data, sizeof data) == FILE_SIZE, "read all of \"data\"");
+  compare_bytes (data, expected, sizeof data, 0, "data");
+
+  CHECK (directio (fd, false), "turn off direct I/O");
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", expected, sizeof expected);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(directio) begin
+(directio) create "data"
+(directio) open "data"
+(directio) write "data"
+(directio) turn on direct I/O
+(directio) read "data" at offset 100
+(directio) write "data" at offset 1500
+(directio) read all of "data"
+(directio) turn off direct I/O
+(directio) close "data"
+(directio) open "data" for verification
+(directio) verified contents of "data"
+(directio) close "data"
+(directio) end
+EOF
+pass;
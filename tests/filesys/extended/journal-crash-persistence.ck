@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($a) = random_bytes (6000);
+random_bytes (3000);
+my ($c) = random_bytes (4500);
+check_archive ({"a" => [$a], "c" => [$c]});
+pass;
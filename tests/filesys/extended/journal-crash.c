@@ -0,0 +1,57 @@
+/* Writes and syncs two files, deletes a third that was synced
+   before, and ends with the file system not unmounted, as if the
+   machine had crashed: the kernel runs with -crash.  The
+   persistence test checks that recovery keeps what was synced,
+   including the deletion, and nothing else. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static char buf_a[6000];
+static char buf_b[3000];
+static char buf_c[4500];
+
+/* Syncs FILE_NAME, which the test did not write. */
+static void
+sync_file (const char *file_name)
+{
+  int fd;
+
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (fsync (fd), "fsync \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+static void
+write_and_sync (const char *file_name, const char *buf, size_t size)
+{
+  int fd;
+
+  CHECK (create (file_name, 0), "create \"%s\"", file_name);
+  CHECK ((fd = open (file_name)) > 1, "open \"%s\"", file_name);
+  CHECK (write (fd, buf, size) == (int) size, "write \"%s\"", file_name);
+  CHECK (fsync (fd), "fsync \"%s\"", file_name);
+  msg ("close \"%s\"", file_name);
+  close (fd);
+}
+
+void
+test_main (void)
+{
+  random_bytes (buf_a, sizeof buf_a);
+  random_bytes (buf_b, sizeof buf_b);
+  random_bytes (buf_c, sizeof buf_c);
+
+  /* The files put on the disk before the test started must
+     survive for the persistence test, too. */
+  sync_file ("journal-crash");
+  sync_file ("tar");
+  write_and_sync ("a", buf_a, sizeof buf_a);
+  write_and_sync ("gone", buf_b, sizeof buf_b);
+  CHECK (remove ("gone"), "remove \"gone\"");
+  write_and_sync ("c", buf_c, sizeof buf_c);
+  check_file ("a", buf_a, sizeof buf_a);
+}
@@ -0,0 +1,34 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(journal-crash) begin
+(journal-crash) open "journal-crash"
+(journal-crash) fsync "journal-crash"
+(journal-crash) close "journal-crash"
+(journal-crash) open "tar"
+(journal-crash) fsync "tar"
+(journal-crash) close "tar"
+(journal-crash) create "a"
+(journal-crash) open "a"
+(journal-crash) write "a"
+(journal-crash) fsync "a"
+(journal-crash) close "a"
+(journal-crash) create "gone"
+(journal-crash) open "gone"
+(journal-crash) write "gone"
+(journal-crash) fsync "gone"
+(journal-crash) close "gone"
+(journal-crash) remove "gone"
+(journal-crash) create "c"
+(journal-crash) open "c"
+(journal-crash) write "c"
+(journal-crash) fsync "c"
+(journal-crash) close "c"
+(journal-crash) open "a" for verification
+(journal-crash) verified contents of "a"
+(journal-crash) close "a"
+(journal-crash) end
+EOF
+pass;
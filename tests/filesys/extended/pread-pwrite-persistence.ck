@@ -0,0 +1,10 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($buf) = random_bytes (6000);
+my ($patch) = random_bytes (700);
+substr ($buf, 1000, 700) = $patch;
+check_archive ({"data" => [$buf . $patch]});
+pass;
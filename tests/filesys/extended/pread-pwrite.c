@@ -0,0 +1,62 @@
+/* Reads and writes a file with pread() and pwrite() and checks
+   that neither uses nor moves the file position, and that
+   pwrite() past the end of the file grows it. */
+
+#include <random.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 6000
+static char buf[FILE_SIZE];
+static char patch[700];
+static char expected[FILE_SIZE + sizeof patch];
+
+static void
+check_tell (int fd, long ofs)
+{
+  long pos = tell (fd);
+  if (pos != ofs)
+    fail ("file position moved: should be %ld, actually %ld", ofs, pos);
+}
+
+void
+test_main (void)
+{
+  char data[sizeof patch];
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  random_bytes (patch, sizeof patch);
+  memcpy (expected, buf, sizeof buf);
+  memcpy (expected + 1000, patch, sizeof patch);
+  memcpy (expected + FILE_SIZE, patch, sizeof patch);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, sizeof buf) == FILE_SIZE, "write \"data\"");
+  seek (fd, 123);
+
+  CHECK (pwrite (fd, patch, sizeof patch, 1000) == (int) sizeof patch,
+         "pwrite \"data\" at offset 1000");
+  check_tell (fd, 123);
+  CHECK (pwrite (fd, patch, sizeof patch, FILE_SIZE)
+         == (int) sizeof patch, "pwrite \"data\" at end of file");
+  check_tell (fd, 123);
+
+  CHECK (pread (fd, data, sizeof data, 1000) == (int) sizeof data,
+         "pread \"data\" at offset 1000");
+  check_tell (fd, 123);
+  compare_bytes (data, patch, sizeof data, 1000, "data");
+  CHECK (pread (fd, data, sizeof data, FILE_SIZE + 100)
+         == (int) sizeof data - 100, "pread \"data\" across end of file");
+  check_tell (fd, 123);
+
+  CHECK (read (fd, data, 10) == 10, "read \"data\" at file position");
+  compare_bytes (data, buf + 123, 10, 123, "data");
+
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", expected, sizeof expected);
+}
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(pread-pwrite) begin
+(pread-pwrite) create "data"
+(pread-pwrite) open "data"
+(pread-pwrite) write "data"
+(pread-pwrite) pwrite "data" at offset 1000
+(pread-pwrite) pwrite "data" at end of file
+(pread-pwrite) pread "data" at offset 1000
+(pread-pwrite) pread "data" across end of file
+(pread-pwrite) read "data" at file position
+(pread-pwrite) close "data"
+(pread-pwrite) open "data" for verification
+(pread-pwrite) verified contents of "data"
+(pread-pwrite) close "data"
+(pread-pwrite) end
+EOF
+pass;
@@ -0,0 +1,48 @@
+/* Writes a file with writev() from buffers whose boundaries fall
+   at odd places within blocks, reads it back with readv() into
+   buffers split elsewhere, and checks that the file position
+   advances by the total each time. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 2100
+static char buf[FILE_SIZE];
+static char data[FILE_SIZE];
+
+static void
+check_tell (int fd, long ofs)
+{
+  long pos = tell (fd);
+  if (pos != ofs)
+    fail ("file position not updated properly: should be %ld, "
+          "actually %ld", ofs, pos);
+}
+
+void
+test_main (void)
+{
+  struct iovec out[] = { { buf, 100 }, { buf + 100, 700 },
+                         { buf + 800, 1300 } };
+  struct iovec in[] = { { data, 1000 }, { data + 1000, 1 },
+                        { data + 1001, 1099 } };
+  int fd;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+
+  CHECK (writev (fd, out, 3) == FILE_SIZE, "writev \"data\"");
+  check_tell (fd, FILE_SIZE);
+
+  seek (fd, 0);
+  CHECK (readv (fd, in, 3) == FILE_SIZE, "readv \"data\"");
+  check_tell (fd, FILE_SIZE);
+  compare_bytes (data, buf, sizeof data, 0, "data");
+
+  msg ("close \"data\"");
+  close (fd);
+  check_file ("data", buf, sizeof buf);
+}
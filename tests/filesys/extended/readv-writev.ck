@@ -0,0 +1,17 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(readv-writev) begin
+(readv-writev) create "data"
+(readv-writev) open "data"
+(readv-writev) writev "data"
+(readv-writev) readv "data"
+(readv-writev) close "data"
+(readv-writev) open "data" for verification
+(readv-writev) verified contents of "data"
+(readv-writev) close "data"
+(readv-writev) end
+EOF
+pass;
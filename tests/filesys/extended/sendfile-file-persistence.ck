@@ -0,0 +1,8 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+use tests::random;
+my ($buf) = random_bytes (9000);
+check_archive ({"src" => [$buf], "dst" => [substr ($buf, 1000)]});
+pass;
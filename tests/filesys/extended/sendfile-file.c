@@ -0,0 +1,49 @@
+/* Copies most of a file into another with sendfile(), starting
+   from a position that is not page-aligned, and checks the count
+   it returns, both files' positions, and the copy. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+#define FILE_SIZE 9000
+#define START 1000
+static char buf[FILE_SIZE];
+
+static void
+check_tell (const char *file_name, int fd, long ofs)
+{
+  long pos = tell (fd);
+  if (pos != ofs)
+    fail ("position in \"%s\" should be %ld, actually %ld",
+          file_name, ofs, pos);
+}
+
+void
+test_main (void)
+{
+  int src, dst;
+
+  random_bytes (buf, sizeof buf);
+  CHECK (create ("src", 0), "create \"src\"");
+  CHECK (create ("dst", 0), "create \"dst\"");
+  CHECK ((src = open ("src")) > 1, "open \"src\"");
+  CHECK ((dst = open ("dst")) > 1, "open \"dst\"");
+  CHECK (write (src, buf, sizeof buf) == FILE_SIZE, "write \"src\"");
+
+  seek (src, START);
+  CHECK (sendfile (dst, src, FILE_SIZE) == FILE_SIZE - START,
+         "sendfile \"src\" to \"dst\"");
+  check_tell ("src", src, FILE_SIZE);
+  check_tell ("dst", dst, FILE_SIZE - START);
+  CHECK (sendfile (dst, src, FILE_SIZE) == 0,
+         "sendfile at end of \"src\"");
+
+  msg ("close \"src\"");
+  close (src);
+  msg ("close \"dst\"");
+  close (dst);
+  check_file ("src", buf, sizeof buf);
+  check_file ("dst", buf + START, sizeof buf - START);
+}
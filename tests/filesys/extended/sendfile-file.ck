@@ -0,0 +1,24 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sendfile-file) begin
+(sendfile-file) create "src"
+(sendfile-file) create "dst"
+(sendfile-file) open "src"
+(sendfile-file) open "dst"
+(sendfile-file) write "src"
+(sendfile-file) sendfile "src" to "dst"
+(sendfile-file) sendfile at end of "src"
+(sendfile-file) close "src"
+(sendfile-file) close "dst"
+(sendfile-file) open "src" for verification
+(sendfile-file) verified contents of "src"
+(sendfile-file) close "src"
+(sendfile-file) open "dst" for verification
+(sendfile-file) verified contents of "dst"
+(sendfile-file) close "dst"
+(sendfile-file) end
+EOF
+pass;
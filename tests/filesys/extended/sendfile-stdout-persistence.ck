@@ -0,0 +1,6 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_archive ({"text" => ["sendfile copied this line to the console\n"]});
+pass;
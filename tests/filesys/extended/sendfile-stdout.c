@@ -0,0 +1,27 @@
+/* Copies a file to the console with sendfile() and checks the
+   count it returns. */
+
+#include <stdio.h>
+#include <string.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+static const char text[] = "sendfile copied this line to the console\n";
+
+void
+test_main (void)
+{
+  int size = strlen (text);
+  int fd;
+
+  CHECK (create ("text", 0), "create \"text\"");
+  CHECK ((fd = open ("text")) > 1, "open \"text\"");
+  CHECK (write (fd, text, size) == size, "write \"text\"");
+  seek (fd, 0);
+  msg ("sendfile \"text\" to the console");
+  if (sendfile (STDOUT_FILENO, fd, size + 100) != size)
+    fail ("sendfile \"text\" to the console");
+  msg ("close \"text\"");
+  close (fd);
+}
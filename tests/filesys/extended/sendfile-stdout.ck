@@ -0,0 +1,15 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(sendfile-stdout) begin
+(sendfile-stdout) create "text"
+(sendfile-stdout) open "text"
+(sendfile-stdout) write "text"
+(sendfile-stdout) sendfile "text" to the console
+sendfile copied this line to the console
+(sendfile-stdout) close "text"
+(sendfile-stdout) end
+EOF
+pass;
@@ -0,0 +1,21 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+# The free counts recorded at the clean unmount after the test must
+# be those found on mounting the file system again.
+our ($test, @prereq_tests);
+my ($blocks) = map (/^\(statfs-counts\) free blocks: (\d+)$/,
+		    read_text_file ("$prereq_tests[0].output"));
+defined $blocks or fail "Test run did not report free blocks.\n";
+my (@output) = read_text_file ("$test.output");
+fail "File system was not cleanly unmounted.\n"
+  if grep (/was not cleanly unmounted/, @output);
+my ($mounted) = map (/^filesys: (\d+) blocks and \d+ inodes free\.$/,
+		     @output);
+defined $mounted or fail "Remount did not report free blocks.\n";
+fail "Free blocks should be $blocks after remount, actually $mounted.\n"
+  if $mounted != $blocks;
+check_archive ({});
+pass;
@@ -0,0 +1,48 @@
+/* Checks that statfs() counts the blocks and the inode of a new
+   file as in use once it is written, and as free again once it is
+   removed. */
+
+#include <random.h>
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+/* Blocks written, few enough to need no indirect block. */
+#define BLOCK_CNT 8
+static char buf[BLOCK_CNT * 4096];
+
+static void
+check_free (const struct statfs *st, unsigned blocks, unsigned inodes)
+{
+  if (st->free_blocks != blocks)
+    fail ("free blocks should be %u, actually %u",
+          blocks, (unsigned) st->free_blocks);
+  if (st->free_inodes != inodes)
+    fail ("free inodes should be %u, actually %u",
+          inodes, (unsigned) st->free_inodes);
+}
+
+void
+test_main (void)
+{
+  struct statfs before, st;
+  int size;
+  int fd;
+
+  CHECK (statfs (&before), "statfs");
+  size = BLOCK_CNT * before.block_size;
+  random_bytes (buf, size);
+
+  CHECK (create ("data", 0), "create \"data\"");
+  CHECK ((fd = open ("data")) > 1, "open \"data\"");
+  CHECK (write (fd, buf, size) == size, "write \"data\"");
+  msg ("close \"data\"");
+  close (fd);
+  CHECK (statfs (&st), "statfs after write");
+  check_free (&st, before.free_blocks - BLOCK_CNT, before.free_inodes - 1);
+
+  CHECK (remove ("data"), "remove \"data\"");
+  CHECK (statfs (&st), "statfs after remove");
+  check_free (&st, before.free_blocks, before.free_inodes);
+  msg ("free blocks: %u", (unsigned) st.free_blocks);
+}
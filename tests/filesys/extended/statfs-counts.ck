@@ -0,0 +1,26 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+
+our ($test);
+my (@output) = read_text_file ("$test.output");
+common_checks ("run", @output);
+
+# The number of free blocks depends on the block size.
+s/^\(statfs-counts\) free blocks: \d+$/(statfs-counts) free blocks: #/
+  foreach @output;
+compare_output ("run", IGNORE_EXIT_CODES => 1, \@output, [<<'EOF']);
+(statfs-counts) begin
+(statfs-counts) statfs
+(statfs-counts) create "data"
+(statfs-counts) open "data"
+(statfs-counts) write "data"
+(statfs-counts) close "data"
+(statfs-counts) statfs after write
+(statfs-counts) remove "data"
+(statfs-counts) statfs after remove
+(statfs-counts) free blocks: #
+(statfs-counts) end
+EOF
+pass;
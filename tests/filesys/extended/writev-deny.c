@@ -0,0 +1,23 @@
+/* Tries to writev() past the end of the running executable, to
+   which writes are denied, and checks that nothing is written
+   and that the executable does not grow. */
+
+#include <syscall.h>
+#include "tests/lib.h"
+#include "tests/main.h"
+
+void
+test_main (void)
+{
+  char buffer[600];
+  struct iovec iov[] = { { buffer, 100 }, { buffer + 100, 500 } };
+  int handle, size;
+
+  CHECK ((handle = open ("writev-deny")) > 1, "open \"writev-deny\"");
+  size = filesize (handle);
+  CHECK (read (handle, buffer, sizeof buffer) == (int) sizeof buffer,
+         "read \"writev-deny\"");
+  seek (handle, size);
+  CHECK (writev (handle, iov, 2) == 0, "try to writev \"writev-deny\"");
+  CHECK (filesize (handle) == size, "size of \"writev-deny\" unchanged");
+}
@@ -0,0 +1,13 @@
+# -*- perl -*-
+use strict;
+use warnings;
+use tests::tests;
+check_expected (IGNORE_EXIT_CODES => 1, [<<'EOF']);
+(writev-deny) begin
+(writev-deny) open "writev-deny"
+(writev-deny) read "writev-deny"
+(writev-deny) try to writev "writev-deny"
+(writev-deny) size of "writev-deny" unchanged
+(writev-deny) end
+EOF
+pass;
@@ -34,6 +34,10 @@
 #ifdef FILESYS
 #include "devices/block.h"
 #include "devices/ide.h"
+#include "devices/ramdisk.h"
+#include "devices/stripe.h"
+#include "devices/virtio-blk.h"
+#include "filesys/defrag.h"
 #include "filesys/filesys.h"
 #include "filesys/fsutil.h"
 #endif
@@ -45,10 +49,26 @@ uint32_t *init_page_dir;
 /* -f: Format the file system? */
 static bool format_filesys;
 
+/* -bs: File system block size to use when formatting. */
+static size_t format_block_size = BLOCK_SECTOR_SIZE;
+
 /* -filesys, -scratch, -swap: Names of block devices to use,
    overriding the defaults. */
 static const char *filesys_bdev_name;
 static const char *scratch_bdev_name;
+
+/* -stripe, -chunk: Block devices to stripe together into "md0",
+   and the number of sectors in each chunk. */
+static char *stripe_members;
+static size_t stripe_chunk_sectors = 16;
+
+/* -ramdisk: Type and size in kB of a RAM disk to create as "rd0",
+   if RAMDISK_KB is nonzero. */
+static enum block_type ramdisk_type;
+static size_t ramdisk_kb;
+
+/* -defrag: Defragment files in the background? */
+static bool defrag_files;
 #ifdef VM
 static const char *swap_bdev_name;
 #endif
@@ -68,6 +88,7 @@ static void usage (void);
 #ifdef FILESYS
 static void locate_block_devices (void);
 static void locate_block_device (enum block_type, const char *name);
+static void parse_ramdisk (char *value);
 #endif
 
 int main (void) NO_RETURN;
@@ -123,8 +144,15 @@ main (void)
 #ifdef FILESYS
   /* Initialize file system. */
   ide_init ();
+  virtio_blk_init ();
+  if (stripe_members != NULL)
+    stripe_init (stripe_members, stripe_chunk_sectors);
+  if (ramdisk_kb != 0)
+    ramdisk_init (ramdisk_type, ramdisk_kb);
   locate_block_devices ();
-  filesys_init (format_filesys);
+  filesys_init (format_filesys, format_block_size);
+  if (defrag_files)
+    defrag_init ();
 #endif
 
   printf ("Boot complete.\n");
@@ -243,10 +271,26 @@ parse_options (char **argv)
 #ifdef FILESYS
       else if (!strcmp (name, "-f"))
         format_filesys = true;
+      else if (!strcmp (name, "-bs"))
+        format_block_size = atoi (value);
       else if (!strcmp (name, "-filesys"))
         filesys_bdev_name = value;
       else if (!strcmp (name, "-scratch"))
         scratch_bdev_name = value;
+      else if (!strcmp (name, "-stripe"))
+        {
+          stripe_members = value;
+          if (filesys_bdev_name == NULL)
+            filesys_bdev_name = "md0";
+        }
+      else if (!strcmp (name, "-chunk"))
+        stripe_chunk_sectors = atoi (value);
+      else if (!strcmp (name, "-ramdisk"))
+        parse_ramdisk (value);
+      else if (!strcmp (name, "-defrag"))
+        defrag_files = true;
+      else if (!strcmp (name, "-crash"))
+        fs_crash = true;
 #ifdef VM
       else if (!strcmp (name, "-swap"))
         swap_bdev_name = value;
@@ -371,8 +415,14 @@ usage (void)
           "  -r                 Reboot after actions.\n"
 #ifdef FILESYS
           "  -f                 Format file system device during startup.\n"
+          "  -bs=BYTES          Format with BYTES-byte blocks (512...4096).\n"
           "  -filesys=BDEV      Use BDEV for file system instead of default.\n"
           "  -scratch=BDEV      Use BDEV for scratch instead of default.\n"
+          "  -stripe=BDEV,...   Stripe BDEVs into md0 and use it for file system.\n"
+          "  -chunk=SECTORS     Stripe in chunks of SECTORS sectors (default 16).\n"
+          "  -ramdisk=TYPE,KB   Create KB-kB RAM disk rd0 of TYPE, e.g. scratch.\n"
+          "  -defrag            Defragment files in the background.\n"
+          "  -crash             Power off without unmounting file system.\n"
 #ifdef VM
           "  -swap=BDEV         Use BDEV for swap instead of default.\n"
 #endif
@@ -387,6 +437,39 @@ usage (void)
 }
 
 #ifdef FILESYS
+/* Parses VALUE, the argument to -ramdisk, which has the form
+   TYPE,KB, where TYPE is a block type name such as "scratch" or
+   "swap". */
+static void
+parse_ramdisk (char *value)
+{
+  char *save_ptr;
+  char *type = value != NULL ? strtok_r (value, ",", &save_ptr) : NULL;
+  char *kb = type != NULL ? strtok_r (NULL, "", &save_ptr) : NULL;
+  enum block_type t;
+
+  if (kb == NULL)
+    PANIC ("-ramdisk requires TYPE,KB");
+  for (t = 0; t < BLOCK_CNT; t++)
+    if (!strcmp (type, block_type_name (t)))
+      break;
+  if (t == BLOCK_CNT)
+    PANIC ("unknown block type `%s'", type);
+
+  ramdisk_type = t;
+  ramdisk_kb = atoi (kb);
+
+  /* The RAM disk takes its role unless another device is named. */
+  if (t == BLOCK_FILESYS && filesys_bdev_name == NULL)
+    filesys_bdev_name = "rd0";
+  else if (t == BLOCK_SCRATCH && scratch_bdev_name == NULL)
+    scratch_bdev_name = "rd0";
+#ifdef VM
+  else if (t == BLOCK_SWAP && swap_bdev_name == NULL)
+    swap_bdev_name = "rd0";
+#endif
+}
+
 /* Figure out what block devices to cast in the various Pintos roles. */
 static void
 locate_block_devices (void)
@@ -486,6 +486,7 @@ init_thread (struct thread *t, const char *name, int priority)
   t->is_waited = false;
   t->is_waiting = false;
   t->executing_file = NULL;
+  t->aio = NULL;
   t->exit_status = -1;
 
   /* directory initialized to be NULL */
@@ -120,6 +120,8 @@ struct thread
     struct list opened_files;           /* List of opened files */
     struct file *executing_file;        /* Pointer to the executable of the 
                                            current thread */
+    struct aio_context *aio;            /* Asynchronous I/O state, or
+                                           NULL (userprog/aio.c). */
 #endif
 
     /* Owned by thread.c. */
@@ -146,6 +148,9 @@ struct thread
     struct thread* parent_thread;
 
     struct dir* directory;
+    int journal_depth;                  /* Nesting depth of journal
+                                           operations
+                                           (filesys/journal.c). */
   };
 
 /* If false (default), use round-robin scheduler.
@@ -0,0 +1,306 @@
+#include "userprog/aio.h"
+#include <debug.h>
+#include <list.h>
+#include <stdio.h>
+#include <string.h>
+#include "filesys/cache.h"
+#include "filesys/file.h"
+#include "threads/malloc.h"
+#include "threads/synch.h"
+#include "threads/thread.h"
+#include "threads/vaddr.h"
+
+/* Asynchronous I/O.
+
+   A process submits reads and writes with the aio_submit system
+   call and goes on running while a small pool of kernel worker
+   threads carries them out with file_read_at() and
+   file_write_at().  Finished
+   requests wait on the process's done list until it collects
+   them with the aio_reap system call.
+
+   Workers never touch user memory, since they run without the
+   process's page directory.  Instead each request has a kernel
+   buffer: data to be written is copied into it at submission, and
+   data read is copied out of it at reaping, both in the context
+   of the submitting process.  Each request also works through its
+   own reopened file, so that closing the descriptor meanwhile
+   does not pull the file out from under a worker.
+
+   Like every other file system user, a worker holds file_lock,
+   which guards the free maps and keeps defragmentation and
+   cloning from moving a file's blocks under a reader or writer.
+   It takes the lock for one AIO_STEP-byte piece of a request at a
+   time, though, so that system calls can get in between the
+   pieces of a long transfer. */
+
+/* Number of worker threads. */
+#define AIO_WORKERS 4
+
+/* Most bytes a worker transfers at a time holding file_lock. */
+#define AIO_STEP PGSIZE
+
+/* Per-process asynchronous I/O state. */
+struct aio_context
+  {
+    struct lock lock;           /* Protects the members below. */
+    struct condition done_cond; /* Signaled when a request finishes. */
+    struct list done;           /* Finished, unreaped requests. */
+    int submitted;              /* Requests submitted, not reaped. */
+  };
+
+/* One submitted request. */
+struct aio_request
+  {
+    struct list_elem elem;      /* Element in queue or done list. */
+    struct aio_context *ctx;    /* Submitting process's context. */
+    struct aiocb *ucb;          /* User control block. */
+    struct file *file;          /* Private reopened file. */
+    bool write;                 /* Write rather than read? */
+    void *ubuf;                 /* User buffer. */
+    void *kbuf;                 /* Kernel staging buffer. */
+    size_t length;              /* Transfer length in bytes. */
+    off_t offset;               /* File offset. */
+    int result;                 /* Bytes transferred. */
+  };
+
+/* Requests waiting for a worker. */
+static struct list queue;
+static struct lock queue_lock;
+static struct condition queue_cond;
+static bool workers_started;
+
+static thread_func aio_worker NO_RETURN;
+static void release_request (struct aio_request *);
+
+/* Initializes the asynchronous I/O queue.  The workers are
+   started on first use, since this runs before threading does. */
+void
+aio_init (void)
+{
+  list_init (&queue);
+  lock_init (&queue_lock);
+  cond_init (&queue_cond);
+  workers_started = false;
+}
+
+/* Starts the worker threads, if that has not been done yet.
+   Must be called with queue_lock held. */
+static void
+start_workers (void)
+{
+  ASSERT (lock_held_by_current_thread (&queue_lock));
+
+  if (workers_started)
+    return;
+  for (int i = 0; i < AIO_WORKERS; i++)
+    {
+      char name[16];
+      snprintf (name, sizeof name, "aio%d", i);
+      thread_create (name, PRI_DEFAULT, aio_worker, NULL);
+    }
+  workers_started = true;
+}
+
+/* Returns the running process's context, creating it if it does
+   not exist yet.  Returns a null pointer if memory is short. */
+static struct aio_context *
+get_context (void)
+{
+  struct thread *cur = thread_current ();
+  if (cur->aio == NULL)
+    {
+      struct aio_context *ctx = malloc (sizeof *ctx);
+      if (ctx == NULL)
+        return NULL;
+      lock_init (&ctx->lock);
+      cond_init (&ctx->done_cond);
+      list_init (&ctx->done);
+      ctx->submitted = 0;
+      cur->aio = ctx;
+    }
+  return cur->aio;
+}
+
+/* Queues the request described by CB, a kernel copy of the user
+   control block UCB, against FILE, the file open as CB's
+   descriptor.  The caller has validated CB's buffer and must hold
+   file_lock.  Returns true if successful, false if CB is
+   malformed, the process already has AIO_MAX requests
+   outstanding, or memory is short. */
+bool
+aio_queue_request (struct aiocb *ucb, const struct aiocb *cb,
+                   struct file *file)
+{
+  struct aio_context *ctx;
+  struct aio_request *r;
+
+  ASSERT (lock_held_by_current_thread (&file_lock));
+
+  if ((cb->aio_op != AIO_READ && cb->aio_op != AIO_WRITE)
+      || cb->aio_nbytes > AIO_MAX_NBYTES)
+    return false;
+  ctx = get_context ();
+  if (ctx == NULL || ctx->submitted >= AIO_MAX)
+    return false;
+
+  r = malloc (sizeof *r);
+  if (r == NULL)
+    return false;
+  r->ctx = ctx;
+  r->ucb = ucb;
+  r->write = cb->aio_op == AIO_WRITE;
+  r->ubuf = cb->aio_buf;
+  r->length = cb->aio_nbytes;
+  r->offset = cb->aio_offset;
+  r->result = -1;
+  r->kbuf = malloc (r->length > 0 ? r->length : 1);
+  r->file = file_reopen (file);
+  if (r->kbuf == NULL || r->file == NULL)
+    {
+      file_close (r->file);
+      free (r->kbuf);
+      free (r);
+      return false;
+    }
+  if (r->write)
+    memcpy (r->kbuf, r->ubuf, r->length);
+
+  lock_acquire (&ctx->lock);
+  ctx->submitted++;
+  lock_release (&ctx->lock);
+
+  lock_acquire (&queue_lock);
+  start_workers ();
+  list_push_back (&queue, &r->elem);
+  cond_signal (&queue_cond, &queue_lock);
+  lock_release (&queue_lock);
+  return true;
+}
+
+/* Collects up to MAX finished requests of the running process,
+   storing their user control blocks into DONE, which the caller
+   has validated, after filling in each one's aio_result and, for
+   reads, copying the data into its buffer.  If WAIT is true and
+   no request has finished but some are outstanding, first waits
+   until one finishes.  Returns the number of requests collected. */
+int
+aio_collect (struct aiocb **done, int max, bool wait)
+{
+  struct aio_context *ctx = thread_current ()->aio;
+  struct list reaped;
+  int cnt = 0;
+
+  if (ctx == NULL || max <= 0)
+    return 0;
+
+  /* Take the requests off the done list first, so that ctx->lock
+     is not held while file_lock is taken to close their files. */
+  list_init (&reaped);
+  lock_acquire (&ctx->lock);
+  if (wait)
+    while (list_empty (&ctx->done) && ctx->submitted > 0)
+      cond_wait (&ctx->done_cond, &ctx->lock);
+  while (cnt < max && !list_empty (&ctx->done))
+    {
+      list_push_back (&reaped, list_pop_front (&ctx->done));
+      ctx->submitted--;
+      cnt++;
+    }
+  lock_release (&ctx->lock);
+
+  for (int i = 0; i < cnt; i++)
+    {
+      struct aio_request *r = list_entry (list_pop_front (&reaped),
+                                          struct aio_request, elem);
+      if (!r->write && r->result > 0)
+        memcpy (r->ubuf, r->kbuf, r->result);
+      r->ucb->aio_result = r->result;
+      done[i] = r->ucb;
+      release_request (r);
+    }
+  return cnt;
+}
+
+/* Waits for the running process's outstanding requests to finish
+   and frees them, along with the process's context.  Called when
+   the process exits. */
+void
+aio_exit (void)
+{
+  struct thread *cur = thread_current ();
+  struct aio_context *ctx = cur->aio;
+
+  if (ctx == NULL)
+    return;
+
+  lock_acquire (&ctx->lock);
+  while ((int) list_size (&ctx->done) < ctx->submitted)
+    cond_wait (&ctx->done_cond, &ctx->lock);
+  lock_release (&ctx->lock);
+
+  while (!list_empty (&ctx->done))
+    release_request (list_entry (list_pop_front (&ctx->done),
+                                 struct aio_request, elem));
+  cur->aio = NULL;
+  free (ctx);
+}
+
+/* Closes R's file and frees R. */
+static void
+release_request (struct aio_request *r)
+{
+  lock_acquire (&file_lock);
+  file_close (r->file);
+  lock_release (&file_lock);
+  free (r->kbuf);
+  free (r);
+}
+
+/* Worker thread.  Carries out queued requests one at a time, a
+   piece at a time, and moves each to its process's done list. */
+static void
+aio_worker (void *aux UNUSED)
+{
+  for (;;)
+    {
+      struct aio_request *r;
+      struct aio_context *ctx;
+
+      lock_acquire (&queue_lock);
+      while (list_empty (&queue))
+        cond_wait (&queue_cond, &queue_lock);
+      r = list_entry (list_pop_front (&queue), struct aio_request, elem);
+      lock_release (&queue_lock);
+
+      r->result = 0;
+      while ((size_t) r->result < r->length)
+        {
+          uint8_t *kbuf = (uint8_t *) r->kbuf + r->result;
+          off_t offset = r->offset + r->result;
+          off_t step = r->length - r->result;
+          off_t done;
+
+          if (step > AIO_STEP)
+            step = AIO_STEP;
+          lock_acquire (&file_lock);
+          if (r->write)
+            done = file_write_at (r->file, kbuf, step, offset);
+          else
+            done = file_read_at (r->file, kbuf, step, offset);
+          lock_release (&file_lock);
+          if (r->write)
+            buffer_cache_balance_dirty ();
+
+          r->result += done;
+          if (done < step)
+            break;
+        }
+
+      ctx = r->ctx;
+      lock_acquire (&ctx->lock);
+      list_push_back (&ctx->done, &r->elem);
+      cond_broadcast (&ctx->done_cond, &ctx->lock);
+      lock_release (&ctx->lock);
+    }
+}
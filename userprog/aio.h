@@ -0,0 +1,15 @@
+#ifndef USERPROG_AIO_H
+#define USERPROG_AIO_H
+
+#include <aio.h>
+#include <stdbool.h>
+
+struct file;
+
+void aio_init (void);
+bool aio_queue_request (struct aiocb *, const struct aiocb *,
+                        struct file *);
+int aio_collect (struct aiocb **, int max, bool wait);
+void aio_exit (void);
+
+#endif /* userprog/aio.h */
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include "threads/malloc.h"
+#include "userprog/aio.h"
 #include "userprog/gdt.h"
 #include "userprog/pagedir.h"
 #include "userprog/tss.h"
@@ -242,6 +243,10 @@ void process_exit (void)
   uint32_t *pd;
   exit_status[cur->tid] = cur->exit_status;
 
+  /* Let outstanding asynchronous I/O finish before the process's
+     resources go away. */
+  aio_exit ();
+
   /* Destroy the current process's page directory and switch back
      to the kernel-only page directory. */
   pd = cur->pagedir;
@@ -1,6 +1,10 @@
 #include "userprog/syscall.h"
+#include <statfs.h>
 #include <stdio.h>
+#include <string.h>
 #include <syscall-nr.h>
+#include <uio.h>
+#include "userprog/aio.h"
 #include "userprog/process.h"
 #include "userprog/pagedir.h"
 #include "threads/interrupt.h"
@@ -8,10 +12,13 @@
 #include "threads/vaddr.h"
 #include "threads/synch.h"
 #include "threads/malloc.h"
+#include "threads/palloc.h"
 #include "filesys/filesys.h"
+#include "filesys/cache.h"
 #include "filesys/file.h"
 #include "filesys/directory.h"
 #include "filesys/inode.h"
+#include "devices/block.h"
 #include "devices/shutdown.h"
 #include "devices/intq.h"
 #include "devices/input.h"
@@ -19,7 +26,7 @@
 static void syscall_handler (struct intr_frame *);
 
 /* Interrupt handler wrapper functions */
-static int (*syscall_handler_wrapper[20]) (struct intr_frame *);
+static int (*syscall_handler_wrapper[SYS_CNT]) (struct intr_frame *);
 
 /* Projects 2 and later. */
 void syscall_halt (void);
@@ -50,6 +57,23 @@ bool syscall_readdir (int, char[READDIR_MAX_LEN + 1]);
 bool syscall_isdir (int);
 int syscall_inumber (int);
 
+/* Extensions. */
+bool syscall_blkstat (const char *, struct blkstat *);
+bool syscall_directio (int, bool);
+bool syscall_fsync (int, bool);
+int syscall_pread (int, void *, unsigned, unsigned);
+int syscall_pwrite (int, const void *, unsigned, unsigned);
+int syscall_readv (int, const struct iovec *, int);
+int syscall_writev (int, const struct iovec *, int);
+int syscall_sendfile (int, int, unsigned);
+int syscall_aio_submit (struct aiocb **, int);
+int syscall_aio_reap (struct aiocb **, int, bool);
+bool syscall_fadvise (int, unsigned, unsigned, int);
+bool syscall_defrag (int);
+bool syscall_compress (int, bool);
+bool syscall_clone (const char *, const char *);
+bool syscall_statfs (struct statfs *);
+
 /* System call wrappers. */
 /* Projects 2 and later. */
 static int syscall_halt_wrapper (struct intr_frame *);
@@ -77,6 +101,24 @@ static int syscall_readdir_wrapper (struct intr_frame *);
 static int syscall_isdir_wrapper (struct intr_frame *);
 static int syscall_inumber_wrapper (struct intr_frame *);
 
+/* Extensions. */
+static int syscall_blkstat_wrapper (struct intr_frame *);
+static int syscall_directio_wrapper (struct intr_frame *);
+static int syscall_fsync_wrapper (struct intr_frame *);
+static int syscall_fdatasync_wrapper (struct intr_frame *);
+static int syscall_pread_wrapper (struct intr_frame *);
+static int syscall_pwrite_wrapper (struct intr_frame *);
+static int syscall_readv_wrapper (struct intr_frame *);
+static int syscall_writev_wrapper (struct intr_frame *);
+static int syscall_sendfile_wrapper (struct intr_frame *);
+static int syscall_aio_submit_wrapper (struct intr_frame *);
+static int syscall_aio_reap_wrapper (struct intr_frame *);
+static int syscall_fadvise_wrapper (struct intr_frame *);
+static int syscall_defrag_wrapper (struct intr_frame *);
+static int syscall_compress_wrapper (struct intr_frame *);
+static int syscall_clone_wrapper (struct intr_frame *);
+static int syscall_statfs_wrapper (struct intr_frame *);
+
 /* File descriptor entry point */
 struct fd_entry
 {
@@ -133,6 +175,23 @@ syscall_init (void)
   syscall_handler_wrapper[SYS_READDIR] = &syscall_readdir_wrapper;
   syscall_handler_wrapper[SYS_ISDIR] = &syscall_isdir_wrapper;
   syscall_handler_wrapper[SYS_INUMBER] = &syscall_inumber_wrapper;
+  syscall_handler_wrapper[SYS_BLKSTAT] = &syscall_blkstat_wrapper;
+  syscall_handler_wrapper[SYS_DIRECTIO] = &syscall_directio_wrapper;
+  syscall_handler_wrapper[SYS_FSYNC] = &syscall_fsync_wrapper;
+  syscall_handler_wrapper[SYS_FDATASYNC] = &syscall_fdatasync_wrapper;
+  syscall_handler_wrapper[SYS_PREAD] = &syscall_pread_wrapper;
+  syscall_handler_wrapper[SYS_PWRITE] = &syscall_pwrite_wrapper;
+  syscall_handler_wrapper[SYS_READV] = &syscall_readv_wrapper;
+  syscall_handler_wrapper[SYS_WRITEV] = &syscall_writev_wrapper;
+  syscall_handler_wrapper[SYS_SENDFILE] = &syscall_sendfile_wrapper;
+  syscall_handler_wrapper[SYS_AIO_SUBMIT] = &syscall_aio_submit_wrapper;
+  syscall_handler_wrapper[SYS_AIO_REAP] = &syscall_aio_reap_wrapper;
+  syscall_handler_wrapper[SYS_FADVISE] = &syscall_fadvise_wrapper;
+  syscall_handler_wrapper[SYS_DEFRAG] = &syscall_defrag_wrapper;
+  syscall_handler_wrapper[SYS_COMPRESS] = &syscall_compress_wrapper;
+  syscall_handler_wrapper[SYS_CLONE] = &syscall_clone_wrapper;
+  syscall_handler_wrapper[SYS_STATFS] = &syscall_statfs_wrapper;
+  aio_init ();
 }
 
 /* Kill the program which is violating the system */
@@ -155,6 +214,29 @@ is_valid_addr (const void *uaddr)
   return true;
 }
 
+/* Copies the IOVCNT-element iovec array at user address UIOV into
+   IOV, which must have room for IOV_MAX elements, and checks that
+   the array and every buffer it describes are valid user memory.
+   Returns true if so, false otherwise. */
+static bool
+copy_in_iovec (struct iovec *iov, const struct iovec *uiov, int iovcnt)
+{
+  if (iovcnt < 0 || iovcnt > IOV_MAX)
+    return false;
+  if (iovcnt == 0)
+    return true;
+  if (uiov == NULL || !is_valid_addr (uiov)
+      || !is_valid_addr ((const char *) (uiov + iovcnt) - 1))
+    return false;
+
+  memcpy (iov, uiov, iovcnt * sizeof *iov);
+  for (int i = 0; i < iovcnt; i++)
+    if (iov[i].iov_base == NULL || !is_valid_addr (iov[i].iov_base)
+        || !is_valid_addr ((char *) iov[i].iov_base + iov[i].iov_len))
+      return false;
+  return true;
+}
+
 /* Check whether the string is valid */
 bool 
 check_the_string (void *str)
@@ -186,7 +268,7 @@ syscall_handler (struct intr_frame *f)
   int syscall_num = *(int*) (f->esp);
   int wrapper_return;
   /* Check whether correct syscall num is correct */
-  if (syscall_num < 0 || syscall_num >= 20)
+  if (syscall_num < 0 || syscall_num >= SYS_CNT)
     {
       terminate_program (-1);
     }
@@ -386,6 +468,7 @@ syscall_write (int fd, const void *buffer, unsigned length)
   lock_acquire (&file_lock);
   ret = file_write (fd_e->file, buffer, length);
   lock_release (&file_lock);
+  buffer_cache_balance_dirty ();
   return ret;
 }
 
@@ -534,6 +617,321 @@ syscall_inumber (int fd)
   return result;
 }
 
+/* Extensions. */
+
+/* Copies the I/O statistics of the block device named DEVICE, or
+   of the file system device if DEVICE is null, into ST.
+   Returns true if successful, false if there is no such
+   device. */
+bool
+syscall_blkstat (const char *device, struct blkstat *st)
+{
+  struct block *block = (device != NULL ? block_get_by_name (device)
+                         : block_get_role (BLOCK_FILESYS));
+  if (block == NULL)
+    return false;
+  block_get_stats (block, st);
+  return true;
+}
+
+/* Sets whether reads and writes of the file open as FD bypass the
+   buffer cache, for whole file system blocks.  Returns true if
+   successful, false if FD is not an open file. */
+bool
+syscall_directio (int fd, bool enable)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return false;
+  lock_acquire (&file_lock);
+  file_set_direct (fd_e->file, enable);
+  lock_release (&file_lock);
+  return true;
+}
+
+/* Writes the dirty data of the file open as FD to disk, with its
+   metadata or, if DATA_ONLY, with only the metadata needed to
+   read the data back, and waits for the writes to finish.
+   Returns true if successful, false if FD is not open. */
+bool
+syscall_fsync (int fd, bool data_only)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  if (fd_e == NULL)
+    return false;
+  lock_acquire (&file_lock);
+  file_sync (fd_e->file, data_only);
+  lock_release (&file_lock);
+  return true;
+}
+
+/* Reads LENGTH bytes from the file open as FD into BUFFER,
+   starting at byte OFFSET, without using or changing the file
+   position.  Returns the number of bytes read (0 at end of file),
+   or -1 if FD is not an open file. */
+int
+syscall_pread (int fd, void *buffer, unsigned length, unsigned offset)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  int ret;
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return -1;
+  lock_acquire (&file_lock);
+  ret = file_read_at (fd_e->file, buffer, length, offset);
+  lock_release (&file_lock);
+  return ret;
+}
+
+/* Writes LENGTH bytes from BUFFER to the file open as FD,
+   starting at byte OFFSET, without using or changing the file
+   position.  Returns the number of bytes written, or -1 if FD is
+   not an open file. */
+int
+syscall_pwrite (int fd, const void *buffer, unsigned length,
+                unsigned offset)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  int ret;
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return -1;
+  lock_acquire (&file_lock);
+  ret = file_write_at (fd_e->file, buffer, length, offset);
+  lock_release (&file_lock);
+  buffer_cache_balance_dirty ();
+  return ret;
+}
+
+/* Reads from the file open as FD into the IOVCNT buffers in IOV,
+   which the caller has validated, filling each before moving on
+   to the next.  Returns the number of bytes read, or -1 if FD is
+   not an open file. */
+int
+syscall_readv (int fd, const struct iovec *iov, int iovcnt)
+{
+  int ret = 0;
+
+  if (fd == STDIN_FILENO)
+    {
+      for (int i = 0; i < iovcnt; i++)
+        ret += syscall_read (fd, iov[i].iov_base, iov[i].iov_len);
+      return ret;
+    }
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return -1;
+  lock_acquire (&file_lock);
+  ret = file_readv (fd_e->file, iov, iovcnt);
+  lock_release (&file_lock);
+  return ret;
+}
+
+/* Writes the IOVCNT buffers in IOV, which the caller has
+   validated, to the file open as FD, as one write under one
+   acquisition of the file system lock.  Returns the number of
+   bytes written, or -1 if FD is not an open file. */
+int
+syscall_writev (int fd, const struct iovec *iov, int iovcnt)
+{
+  int ret = 0;
+
+  if (fd == STDOUT_FILENO)
+    {
+      for (int i = 0; i < iovcnt; i++)
+        {
+          putbuf (iov[i].iov_base, iov[i].iov_len);
+          ret += iov[i].iov_len;
+        }
+      return ret;
+    }
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return -1;
+  lock_acquire (&file_lock);
+  ret = file_writev (fd_e->file, iov, iovcnt);
+  lock_release (&file_lock);
+  buffer_cache_balance_dirty ();
+  return ret;
+}
+
+/* Copies up to LENGTH bytes from the file open as IN_FD, starting
+   at its current position, to the file open as OUT_FD or, if
+   OUT_FD is STDOUT_FILENO, to the console.  The data moves through
+   a kernel page, a page-aligned chunk at a time so that whole
+   cached blocks are copied, and never through user memory.
+   Advances both files' positions by the number of bytes copied,
+   stopping early if a write to OUT_FD falls short.  Returns the
+   number of bytes copied, or -1 if either fd is not an open file. */
+int
+syscall_sendfile (int out_fd, int in_fd, unsigned length)
+{
+  struct fd_entry *in = get_fd_entry (in_fd);
+  struct fd_entry *out = NULL;
+  void *buffer;
+  int copied = 0;
+
+  if (in == NULL || in->directory != NULL)
+    return -1;
+  if (out_fd != STDOUT_FILENO)
+    {
+      out = get_fd_entry (out_fd);
+      if (out == NULL || out->directory != NULL)
+        return -1;
+    }
+  buffer = palloc_get_page (0);
+  if (buffer == NULL)
+    return -1;
+
+  while (length > 0)
+    {
+      off_t written = 0;
+
+      /* Hold file_lock for one chunk at a time, so that other
+         file system users can get in between. */
+      lock_acquire (&file_lock);
+      off_t chunk = PGSIZE - file_tell (in->file) % PGSIZE;
+      if ((unsigned) chunk > length)
+        chunk = length;
+      off_t n = file_read (in->file, buffer, chunk);
+      if (n > 0 && out != NULL)
+        {
+          written = file_write (out->file, buffer, n);
+
+          /* Leave IN_FD just past the bytes actually copied. */
+          if (written < n)
+            file_seek (in->file, file_tell (in->file) - (n - written));
+        }
+      lock_release (&file_lock);
+
+      if (n <= 0)
+        break;
+      if (out != NULL)
+        {
+          buffer_cache_balance_dirty ();
+          if (written > 0)
+            copied += written;
+          if (written < n)
+            break;
+        }
+      else
+        {
+          putbuf (buffer, n);
+          copied += n;
+        }
+      length -= n;
+    }
+
+  palloc_free_page (buffer);
+  return copied;
+}
+
+/* Queues the CNT asynchronous requests whose control blocks CBS
+   points to, which the caller has validated, in order, stopping
+   at the first that names a bad fd or cannot be queued.  Returns
+   the number queued, or -1 if none could be. */
+int
+syscall_aio_submit (struct aiocb **cbs, int cnt)
+{
+  int submitted = 0;
+
+  lock_acquire (&file_lock);
+  for (; submitted < cnt; submitted++)
+    {
+      struct aiocb cb = *cbs[submitted];
+      struct fd_entry *fd_e = get_fd_entry (cb.aio_fd);
+      if (fd_e == NULL || fd_e->directory != NULL
+          || !aio_queue_request (cbs[submitted], &cb, fd_e->file))
+        break;
+    }
+  lock_release (&file_lock);
+  return submitted > 0 ? submitted : -1;
+}
+
+/* Stores up to MAX finished asynchronous requests into DONE,
+   which the caller has validated, waiting for one to finish
+   first if WAIT is true and none has.  Returns the number
+   stored. */
+int
+syscall_aio_reap (struct aiocb **done, int max, bool wait)
+{
+  return aio_collect (done, max, wait);
+}
+
+/* Advises the kernel how the LEN bytes of the file open as FD
+   starting at OFFSET, or the rest of the file if LEN is 0, will
+   be accessed, so that it can tune read-ahead and caching.
+   ADVICE is one of the FADV_* values.  Returns true if
+   successful, false if FD is not an open file or ADVICE is not
+   known. */
+bool
+syscall_fadvise (int fd, unsigned offset, unsigned len, int advice)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  bool success;
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return false;
+  lock_acquire (&file_lock);
+  success = file_advise (fd_e->file, advice, offset, len);
+  lock_release (&file_lock);
+  return success;
+}
+
+/* Moves the data of the file or directory open as FD into
+   consecutive blocks, while it stays open.  Returns true if
+   successful, false if FD is not open or no large enough run of
+   free blocks exists. */
+bool
+syscall_defrag (int fd)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  bool success;
+  if (fd_e == NULL)
+    return false;
+  lock_acquire (&file_lock);
+  success = file_defragment (fd_e->file);
+  lock_release (&file_lock);
+  return success;
+}
+
+/* Makes the file open as FD keep its data compressed if ENABLE is
+   true, or plainly otherwise.  Returns true if successful, false
+   if FD is not open or is not an empty regular file, or if the
+   file system's blocks are too large for compression. */
+bool
+syscall_compress (int fd, bool enable)
+{
+  struct fd_entry *fd_e = get_fd_entry (fd);
+  bool success;
+  if (fd_e == NULL || fd_e->directory != NULL)
+    return false;
+  lock_acquire (&file_lock);
+  success = file_set_compressed (fd_e->file, enable);
+  lock_release (&file_lock);
+  return success;
+}
+
+/* Creates NEW_FILE as a copy of FILE that shares FILE's blocks
+   until either is written.  Returns true if successful, false
+   otherwise. */
+bool
+syscall_clone (const char *file, const char *new_file)
+{
+  lock_acquire (&file_lock);
+  bool ret = filesys_clone (file, new_file);
+  lock_release (&file_lock);
+  return ret;
+}
+
+/* Stores a summary of the file system's size and free space into
+   *ST.  Returns true. */
+bool
+syscall_statfs (struct statfs *st)
+{
+  lock_acquire (&file_lock);
+  filesys_statfs (st);
+  lock_release (&file_lock);
+  return true;
+}
+
 /* System call wrappers.
    Retrive correct argument from the stack and send it to call 
    functions. 
@@ -863,3 +1261,315 @@ syscall_inumber_wrapper (struct intr_frame *f UNUSED)
 
   return 0;
 }
+
+/* Extensions. */
+
+static int
+syscall_blkstat_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 2; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  char *device = *(char**)(f->esp + 4);
+  struct blkstat *st = *(struct blkstat**)(f->esp + 8);
+  if (device != NULL && !check_the_string (device))
+    return -1;
+  if (st == NULL || !is_valid_addr (st)
+      || !is_valid_addr ((char *) st + sizeof *st - 1))
+    return -1;
+
+  f->eax = syscall_blkstat (device, st);
+  return 0;
+}
+
+static int
+syscall_directio_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 2; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  bool enable = *((int*)(f->esp + 8)) != 0;
+
+  f->eax = syscall_directio (fd, enable);
+  return 0;
+}
+
+static int
+syscall_fsync_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  if (!is_valid_addr ((void*)((char *)f->esp + 4)))
+    return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+
+  f->eax = syscall_fsync (fd, false);
+  return 0;
+}
+
+static int
+syscall_fdatasync_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  if (!is_valid_addr ((void*)((char *)f->esp + 4)))
+    return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+
+  f->eax = syscall_fsync (fd, true);
+  return 0;
+}
+
+static int
+syscall_pread_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 4; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  void *buffer = *(char**)(f->esp + 8);
+  unsigned length = *((unsigned*)(f->esp + 12));
+  unsigned offset = *((unsigned*)(f->esp + 16));
+  if (buffer == NULL || !is_valid_addr (buffer)
+      || !is_valid_addr ((char *) buffer + length))
+    return -1;
+
+  f->eax = syscall_pread (fd, buffer, length, offset);
+  return 0;
+}
+
+static int
+syscall_pwrite_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 4; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  const void *buffer = *(char**)(f->esp + 8);
+  unsigned length = *((unsigned*)(f->esp + 12));
+  unsigned offset = *((unsigned*)(f->esp + 16));
+  if (buffer == NULL || !is_valid_addr (buffer)
+      || !is_valid_addr ((char *) buffer + length))
+    return -1;
+
+  f->eax = syscall_pwrite (fd, buffer, length, offset);
+  return 0;
+}
+
+static int
+syscall_readv_wrapper (struct intr_frame *f)
+{
+  struct iovec iov[IOV_MAX];
+
+  /* Validate memory address */
+  for (int i = 1; i <= 3; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  const struct iovec *uiov = *(struct iovec**)(f->esp + 8);
+  int iovcnt = *((int*)(f->esp + 12));
+  if (!copy_in_iovec (iov, uiov, iovcnt))
+    return -1;
+
+  f->eax = syscall_readv (fd, iov, iovcnt);
+  return 0;
+}
+
+static int
+syscall_writev_wrapper (struct intr_frame *f)
+{
+  struct iovec iov[IOV_MAX];
+
+  /* Validate memory address */
+  for (int i = 1; i <= 3; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  const struct iovec *uiov = *(struct iovec**)(f->esp + 8);
+  int iovcnt = *((int*)(f->esp + 12));
+  if (!copy_in_iovec (iov, uiov, iovcnt))
+    return -1;
+
+  f->eax = syscall_writev (fd, iov, iovcnt);
+  return 0;
+}
+
+static int
+syscall_sendfile_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 3; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int out_fd = *((int*)(f->esp + 4));
+  int in_fd = *((int*)(f->esp + 8));
+  unsigned length = *((unsigned*)(f->esp + 12));
+
+  f->eax = syscall_sendfile (out_fd, in_fd, length);
+  return 0;
+}
+
+static int
+syscall_aio_submit_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 2; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  struct aiocb **cbs = *(struct aiocb***)(f->esp + 4);
+  int cnt = *((int*)(f->esp + 8));
+  if (cnt <= 0 || cnt > AIO_MAX)
+    {
+      f->eax = -1;
+      return 0;
+    }
+  if (cbs == NULL || !is_valid_addr (cbs)
+      || !is_valid_addr ((char *) (cbs + cnt) - 1))
+    return -1;
+  for (int i = 0; i < cnt; i++)
+    {
+      struct aiocb *cb = cbs[i];
+      if (cb == NULL || !is_valid_addr (cb)
+          || !is_valid_addr ((char *) (cb + 1) - 1))
+        return -1;
+      if (cb->aio_buf == NULL || !is_valid_addr (cb->aio_buf)
+          || !is_valid_addr ((char *) cb->aio_buf + cb->aio_nbytes))
+        return -1;
+    }
+
+  f->eax = syscall_aio_submit (cbs, cnt);
+  return 0;
+}
+
+static int
+syscall_aio_reap_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 3; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  struct aiocb **done = *(struct aiocb***)(f->esp + 4);
+  int max = *((int*)(f->esp + 8));
+  bool wait = *((int*)(f->esp + 12)) != 0;
+  if (max <= 0)
+    {
+      f->eax = 0;
+      return 0;
+    }
+  if (done == NULL || !is_valid_addr (done)
+      || !is_valid_addr ((char *) (done + max) - 1))
+    return -1;
+
+  f->eax = syscall_aio_reap (done, max, wait);
+  return 0;
+}
+
+static int
+syscall_fadvise_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 4; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  unsigned offset = *((unsigned*)(f->esp + 8));
+  unsigned len = *((unsigned*)(f->esp + 12));
+  int advice = *((int*)(f->esp + 16));
+
+  f->eax = syscall_fadvise (fd, offset, len, advice);
+  return 0;
+}
+
+static int
+syscall_defrag_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  if (!is_valid_addr ((void*)((char *)f->esp + 4)))
+    return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+
+  f->eax = syscall_defrag (fd);
+  return 0;
+}
+
+static int
+syscall_compress_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 2; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  int fd = *((int*)(f->esp + 4));
+  bool enable = *((int*)(f->esp + 8)) != 0;
+
+  f->eax = syscall_compress (fd, enable);
+  return 0;
+}
+
+static int
+syscall_clone_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  for (int i = 1; i <= 2; i++)
+    if (!is_valid_addr ((void*)((char *)f->esp + i * 4)))
+      return -1;
+
+  /* Decode parameters */
+  char *file = *(char**)(f->esp + 4);
+  char *new_file = *(char**)(f->esp + 8);
+
+  if (file == NULL || !check_the_string (file)
+      || new_file == NULL || !check_the_string (new_file))
+    terminate_program (-1);
+
+  f->eax = syscall_clone (file, new_file);
+  return 0;
+}
+
+static int
+syscall_statfs_wrapper (struct intr_frame *f)
+{
+  /* Validate memory address */
+  if (!is_valid_addr ((void*)((char *)f->esp + 4)))
+    return -1;
+
+  /* Decode parameters */
+  struct statfs *st = *(struct statfs**)(f->esp + 4);
+  if (st == NULL || !is_valid_addr (st)
+      || !is_valid_addr ((char *) st + sizeof *st - 1))
+    return -1;
+
+  f->eax = syscall_statfs (st);
+  return 0;
+}
@@ -0,0 +1,610 @@
+/* pintos-mkfs: builds a Pintos file system image on the host.
+
+   Copies a host directory tree into a new, formatted file system
+   image that the kernel mounts without -f, which is much faster
+   than booting Pintos to run "extract" or "put" for each file.
+   The image holds just the file system, to be placed in a disk's
+   file system partition with "pintos-mkdisk --filesys-from=IMAGE"
+   or "pintos --filesys-from=IMAGE".
+
+   The on-disk structures come from filesys/ondisk.h, which the
+   kernel uses too.  The image is laid out the way the kernel
+   formats a disk, except that each file's data occupies one run
+   of consecutive blocks, preceded by its indirect blocks. */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Pintos's NAME_MAX replaces the host's. */
+#undef NAME_MAX
+#include "filesys/ondisk.h"
+
+/* Bytes copied from a host file at a time. */
+#define COPY_SIZE (64 * 1024)
+
+/* Entries in the root directory of a new file system, matching
+   the kernel's do_format(). */
+#define ROOT_DIR_ENTRIES 16
+
+/* A file or directory to be copied into the image. */
+struct node
+  {
+    char name[NAME_MAX + 1];    /* Name in its parent directory. */
+    char *path;                 /* Host path. */
+    bool is_dir;                /* Directory or regular file? */
+    uint64_t length;            /* Bytes in the file or directory. */
+    uint32_t inumber;           /* Inode number in the image. */
+    struct node **children;     /* Directory members, sorted by name. */
+    size_t child_cnt;           /* Number of directory members. */
+  };
+
+static const char *program_name;
+
+static void fail (const char *, ...)
+  __attribute__ ((noreturn, format (printf, 1, 2)));
+static void usage (int) __attribute__ ((noreturn));
+
+/* The image being built. */
+static const char *image_name;
+static int image_fd = -1;
+static struct super_block super;
+static uint32_t block_size;         /* Bytes per block. */
+static uint8_t *free_map;           /* One bit per block. */
+static uint8_t *inode_map;          /* One bit per inode. */
+static uint32_t next_block;         /* Next block to allocate. */
+static uint32_t next_inumber;       /* Next inode number to assign. */
+static size_t file_cnt, dir_cnt;    /* Files and directories copied. */
+
+/* Prints a message formatted like printf() and exits, removing
+   the partly built image. */
+static void
+fail (const char *format, ...)
+{
+  va_list args;
+
+  fprintf (stderr, "%s: ", program_name);
+  va_start (args, format);
+  vfprintf (stderr, format, args);
+  va_end (args);
+  putc ('\n', stderr);
+
+  if (image_fd >= 0)
+    unlink (image_name);
+  exit (EXIT_FAILURE);
+}
+
+/* Allocates and returns SIZE bytes of zeros, exiting if memory is
+   short. */
+static void *
+xcalloc (size_t size)
+{
+  void *p = calloc (1, size > 0 ? size : 1);
+  if (p == NULL)
+    fail ("out of memory");
+  return p;
+}
+
+/* Returns X / Y, rounded up. */
+static uint64_t
+div_round_up (uint64_t x, uint64_t y)
+{
+  return (x + y - 1) / y;
+}
+
+/* Returns the number of bytes the kernel's bitmap code uses to
+   store BIT_CNT bits in a file: whole 32-bit elements. */
+static uint32_t
+bitmap_file_size (uint32_t bit_cnt)
+{
+  return div_round_up (bit_cnt, 32) * 4;
+}
+
+/* Returns the number of block numbers in an indirect block. */
+static uint32_t
+indirect_cnt (void)
+{
+  return block_size / sizeof (uint32_t);
+}
+
+/* Returns the number of data blocks in a file of LENGTH bytes. */
+static uint64_t
+data_blocks (uint64_t length)
+{
+  return div_round_up (length, block_size);
+}
+
+/* Returns the number of indirect and double indirect blocks that
+   index DATA_CNT data blocks. */
+static uint64_t
+index_blocks (uint64_t data_cnt)
+{
+  uint64_t per = indirect_cnt ();
+  uint64_t cnt = 0;
+
+  if (data_cnt > DIRECT_BLOCK)
+    cnt++;
+  if (data_cnt > DIRECT_BLOCK + per)
+    cnt += 1 + div_round_up (data_cnt - DIRECT_BLOCK - per, per);
+  return cnt;
+}
+
+/* Returns the number of blocks, data and index, taken by a file
+   of LENGTH bytes. */
+static uint64_t
+file_blocks (uint64_t length)
+{
+  uint64_t data_cnt = data_blocks (length);
+  return data_cnt + index_blocks (data_cnt);
+}
+
+/* Compares the names of the nodes that A and B point to, for
+   qsort(). */
+static int
+compare_nodes (const void *a_, const void *b_)
+{
+  const struct node *a = *(struct node *const *) a_;
+  const struct node *b = *(struct node *const *) b_;
+  return strcmp (a->name, b->name);
+}
+
+/* Reads the host file or directory tree at PATH, to be named NAME
+   in the image, into a new node and returns it.  Returns a null
+   pointer for a host file that is neither a regular file nor a
+   directory, which is skipped. */
+static struct node *
+scan (const char *path, const char *name)
+{
+  struct node *node;
+  struct stat st;
+
+  if (stat (path, &st) < 0)
+    fail ("%s: %s", path, strerror (errno));
+  if (!S_ISREG (st.st_mode) && !S_ISDIR (st.st_mode))
+    {
+      fprintf (stderr, "%s: %s: skipping special file\n",
+               program_name, path);
+      return NULL;
+    }
+  if (strlen (name) > NAME_MAX)
+    fail ("%s: name longer than %d characters", path, NAME_MAX);
+
+  node = xcalloc (sizeof *node);
+  strcpy (node->name, name);
+  node->path = strdup (path);
+  if (node->path == NULL)
+    fail ("out of memory");
+  node->is_dir = S_ISDIR (st.st_mode);
+
+  if (node->is_dir)
+    {
+      size_t capacity = 0;
+      struct dirent *de;
+      DIR *dir;
+
+      dir = opendir (path);
+      if (dir == NULL)
+        fail ("%s: %s", path, strerror (errno));
+      while ((de = readdir (dir)) != NULL)
+        {
+          struct node *child;
+          char *child_path;
+
+          if (!strcmp (de->d_name, ".") || !strcmp (de->d_name, ".."))
+            continue;
+          child_path = xcalloc (strlen (path) + strlen (de->d_name) + 2);
+          sprintf (child_path, "%s/%s", path, de->d_name);
+          child = scan (child_path, de->d_name);
+          free (child_path);
+          if (child == NULL)
+            continue;
+
+          if (node->child_cnt == capacity)
+            {
+              capacity = capacity > 0 ? capacity * 2 : 16;
+              node->children = realloc (node->children,
+                                        capacity * sizeof *node->children);
+              if (node->children == NULL)
+                fail ("out of memory");
+            }
+          node->children[node->child_cnt++] = child;
+        }
+      closedir (dir);
+      if (node->child_cnt > 1)
+        qsort (node->children, node->child_cnt, sizeof *node->children,
+               compare_nodes);
+
+      /* One entry per member, after the parent entry. */
+      node->length = (node->child_cnt + 1) * sizeof (struct dir_entry);
+    }
+  else
+    node->length = st.st_size;
+
+  if (node->length > INT32_MAX)
+    fail ("%s: too large for a Pintos file", path);
+  return node;
+}
+
+/* Counts the inodes and blocks that NODE and everything below it
+   will take, adding them to *INODE_CNT and *BLOCK_CNT. */
+static void
+count_tree (const struct node *node, uint64_t *inode_cnt,
+            uint64_t *block_cnt)
+{
+  size_t i;
+
+  ++*inode_cnt;
+  *block_cnt += file_blocks (node->length);
+  for (i = 0; i < node->child_cnt; i++)
+    count_tree (node->children[i], inode_cnt, block_cnt);
+}
+
+/* Returns the number of blocks taken by the free map, inode map
+   and reference count files of a file system of BLOCK_CNT blocks
+   and INODE_CNT inodes. */
+static uint64_t
+system_blocks (uint32_t block_cnt, uint32_t inode_cnt)
+{
+  return (file_blocks (bitmap_file_size (block_cnt))
+          + file_blocks (bitmap_file_size (inode_cnt))
+          + file_blocks (block_cnt));
+}
+
+/* Returns true if a file system of BLOCK_CNT blocks has room for
+   INODE_CNT inodes and FILE_BLOCK_CNT blocks besides those of its
+   system files. */
+static bool
+fits (uint32_t block_cnt, uint64_t inode_cnt, uint64_t file_block_cnt)
+{
+  struct super_block s;
+
+  return (super_block_init (&s, block_cnt, block_size)
+          && inode_cnt <= s.inode_cnt - (REFCOUNT_INODE + 1)
+          && (file_block_cnt + system_blocks (block_cnt, s.inode_cnt)
+              <= block_cnt - s.data_start));
+}
+
+/* Sets bit IDX in BITMAP. */
+static void
+bitmap_mark (uint8_t *bitmap, uint32_t idx)
+{
+  bitmap[idx / 8] |= 1 << (idx % 8);
+}
+
+/* Allocates CNT consecutive blocks and returns the first. */
+static uint32_t
+allocate_blocks (uint64_t cnt)
+{
+  uint32_t start = next_block;
+  uint64_t i;
+
+  if (cnt > super.block_cnt - next_block)
+    fail ("%s: file system full", image_name);
+  for (i = 0; i < cnt; i++)
+    bitmap_mark (free_map, next_block++);
+  return start;
+}
+
+/* Writes SIZE bytes from BUFFER to the image at byte OFFSET. */
+static void
+write_at (uint64_t offset, const void *buffer, size_t size)
+{
+  const uint8_t *p = buffer;
+
+  while (size > 0)
+    {
+      ssize_t n = pwrite (image_fd, p, size, offset);
+      if (n <= 0)
+        fail ("%s: write failed: %s", image_name,
+              n < 0 ? strerror (errno) : "no space");
+      p += n;
+      offset += n;
+      size -= n;
+    }
+}
+
+/* Writes block numbers FIRST through FIRST + CNT - 1 into a new
+   indirect block numbered BLOCK. */
+static void
+write_indirect (uint32_t block, uint32_t first, uint32_t cnt)
+{
+  uint32_t *ib = xcalloc (block_size);
+  uint32_t i;
+
+  for (i = 0; i < cnt; i++)
+    ib[i] = first + i;
+  write_at ((uint64_t) block * block_size, ib, block_size);
+  free (ib);
+}
+
+/* Creates inode INUMBER for a file of LENGTH bytes, a directory if
+   IS_DIR is true, and allocates its blocks: first any indirect
+   blocks, then all of its data blocks consecutively.  Returns the
+   first data block, or 0 if LENGTH is 0. */
+static uint32_t
+create_inode (uint32_t inumber, uint64_t length, bool is_dir)
+{
+  uint32_t inodes_per_block = block_size / INODE_DISK_SIZE;
+  uint64_t per = indirect_cnt ();
+  uint64_t data_cnt = data_blocks (length);
+  uint64_t max_cnt = DIRECT_BLOCK + per + per * per;
+  struct inode_disk inode;
+  uint32_t index, first, i;
+  uint64_t done;
+
+  if (data_cnt > max_cnt)
+    fail ("file of %llu bytes is too large for %"PRIu32"-byte blocks",
+          (unsigned long long) length, block_size);
+
+  memset (&inode, 0, sizeof inode);
+  inode.length = length;
+  inode.magic = INODE_MAGIC;
+  inode.is_dir = is_dir;
+
+  index = allocate_blocks (index_blocks (data_cnt));
+  first = data_cnt > 0 ? allocate_blocks (data_cnt) : 0;
+
+  /* Direct blocks. */
+  done = data_cnt < DIRECT_BLOCK ? data_cnt : DIRECT_BLOCK;
+  for (i = 0; i < done; i++)
+    inode.blocks[i] = first + i;
+
+  /* Indirect block. */
+  if (done < data_cnt)
+    {
+      uint64_t cnt = data_cnt - done < per ? data_cnt - done : per;
+      inode.blocks[DIRECT_BLOCK] = index++;
+      write_indirect (inode.blocks[DIRECT_BLOCK], first + done, cnt);
+      done += cnt;
+    }
+
+  /* Double indirect block, and the indirect blocks under it. */
+  if (done < data_cnt)
+    {
+      uint32_t *dib = xcalloc (block_size);
+
+      inode.blocks[DIRECT_BLOCK + 1] = index++;
+      for (i = 0; done < data_cnt; i++)
+        {
+          uint64_t cnt = data_cnt - done < per ? data_cnt - done : per;
+          dib[i] = index++;
+          write_indirect (dib[i], first + done, cnt);
+          done += cnt;
+        }
+      write_at ((uint64_t) inode.blocks[DIRECT_BLOCK + 1] * block_size,
+                dib, block_size);
+      free (dib);
+    }
+
+  write_at (((uint64_t) (super.inode_table + inumber / inodes_per_block)
+             * block_size
+             + inumber % inodes_per_block * INODE_DISK_SIZE),
+            &inode, sizeof inode);
+  bitmap_mark (inode_map, inumber);
+  return first;
+}
+
+/* Assigns inode numbers to NODE and everything below it, in the
+   order they will be copied. */
+static void
+number_tree (struct node *node)
+{
+  size_t i;
+
+  for (i = 0; i < node->child_cnt; i++)
+    node->children[i]->inumber = next_inumber++;
+  for (i = 0; i < node->child_cnt; i++)
+    number_tree (node->children[i]);
+}
+
+/* Copies the regular file NODE into the image. */
+static void
+copy_file (const struct node *node)
+{
+  uint32_t first = create_inode (node->inumber, node->length, false);
+  uint64_t offset = (uint64_t) first * block_size;
+  uint64_t left = node->length;
+  char *buffer = xcalloc (COPY_SIZE);
+  int fd;
+
+  fd = open (node->path, O_RDONLY);
+  if (fd < 0)
+    fail ("%s: %s", node->path, strerror (errno));
+  while (left > 0)
+    {
+      size_t chunk = left < COPY_SIZE ? left : COPY_SIZE;
+      ssize_t n = read (fd, buffer, chunk);
+      if (n < 0)
+        fail ("%s: %s", node->path, strerror (errno));
+      else if (n == 0)
+        fail ("%s: file shrank while being copied", node->path);
+      write_at (offset, buffer, n);
+      offset += n;
+      left -= n;
+    }
+  close (fd);
+  free (buffer);
+  file_cnt++;
+}
+
+/* Copies directory NODE, whose parent directory has inode number
+   PARENT, and everything below it into the image.  Each directory
+   is followed by its members, so that a directory and its files
+   end up close together. */
+static void
+copy_dir (const struct node *node, uint32_t parent)
+{
+  struct dir_entry *entries = xcalloc (node->length);
+  uint32_t first;
+  size_t i;
+
+  entries[0].inode_sector = parent;
+  entries[0].in_use = true;
+  for (i = 0; i < node->child_cnt; i++)
+    {
+      struct dir_entry *e = &entries[i + 1];
+      e->inode_sector = node->children[i]->inumber;
+      strcpy (e->name, node->children[i]->name);
+      e->in_use = true;
+    }
+  first = create_inode (node->inumber, node->length, true);
+  write_at ((uint64_t) first * block_size, entries, node->length);
+  free (entries);
+  dir_cnt++;
+
+  for (i = 0; i < node->child_cnt; i++)
+    if (!node->children[i]->is_dir)
+      copy_file (node->children[i]);
+  for (i = 0; i < node->child_cnt; i++)
+    if (node->children[i]->is_dir)
+      copy_dir (node->children[i], node->inumber);
+}
+
+static void
+usage (int exit_code)
+{
+  fprintf (stderr,
+           "pintos-mkfs: builds a Pintos file system image\n"
+           "usage: %s [OPTION...] IMAGE [DIRECTORY]\n"
+           "Creates IMAGE holding a copy of the files and directories\n"
+           "under DIRECTORY, or an empty file system without DIRECTORY.\n"
+           "Options:\n"
+           "  -b BYTES  File system block size, a power of 2 from %d\n"
+           "            to %d (default %d).\n"
+           "  -s MB     Size of the file system in megabytes (default:\n"
+           "            enough for DIRECTORY with a quarter left free).\n"
+           "Use IMAGE with \"pintos --filesys-from=IMAGE\" or\n"
+           "\"pintos-mkdisk --filesys-from=IMAGE\".\n",
+           program_name, FS_BLOCK_SIZE_MIN, FS_BLOCK_SIZE_MAX,
+           FS_BLOCK_SIZE_MIN);
+  exit (exit_code);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const uint32_t endian_test = 1;
+  struct node *root;
+  double size_mb = 0.0;
+  uint64_t inode_cnt = 0, file_block_cnt = 0;
+  uint32_t block_cnt;
+  uint32_t map_bytes;
+  uint32_t free_map_start, inode_map_start;
+  int opt;
+
+  program_name = argv[0];
+  block_size = FS_BLOCK_SIZE_MIN;
+  while ((opt = getopt (argc, argv, "b:s:h")) != -1)
+    switch (opt)
+      {
+      case 'b':
+        block_size = strtoul (optarg, NULL, 10);
+        break;
+      case 's':
+        size_mb = strtod (optarg, NULL);
+        if (size_mb <= 0.0)
+          fail ("invalid size \"%s\"", optarg);
+        break;
+      case 'h':
+        usage (EXIT_SUCCESS);
+      default:
+        usage (EXIT_FAILURE);
+      }
+  if (argc - optind != 1 && argc - optind != 2)
+    usage (EXIT_FAILURE);
+  if (block_size < FS_BLOCK_SIZE_MIN || block_size > FS_BLOCK_SIZE_MAX
+      || (block_size & (block_size - 1)) != 0)
+    fail ("unsupported block size %"PRIu32, block_size);
+  if (*(const uint8_t *) &endian_test != 1)
+    fail ("images can only be built on a little-endian host");
+
+  /* Read the tree to copy, then size the file system for it. */
+  if (argc - optind == 2)
+    {
+      root = scan (argv[optind + 1], "");
+      if (!root->is_dir)
+        fail ("%s: not a directory", argv[optind + 1]);
+    }
+  else
+    root = xcalloc (sizeof *root);
+  root->is_dir = true;
+  if (root->length < ROOT_DIR_ENTRIES * sizeof (struct dir_entry))
+    root->length = ROOT_DIR_ENTRIES * sizeof (struct dir_entry);
+  count_tree (root, &inode_cnt, &file_block_cnt);
+  inode_cnt--;                  /* The root's inode is reserved. */
+
+  if (size_mb > 0.0)
+    {
+      block_cnt = size_mb * 1024 * 1024 / block_size;
+      if (!fits (block_cnt, inode_cnt, file_block_cnt))
+        fail ("%g MB is too small for the files to copy", size_mb);
+    }
+  else
+    {
+      block_cnt = file_block_cnt;
+      while (!fits (block_cnt, inode_cnt, file_block_cnt))
+        block_cnt += block_cnt / 16 + 1;
+      block_cnt += block_cnt / 3;
+    }
+  super_block_init (&super, block_cnt, block_size);
+
+  /* Create the image, empty, with a zeroed inode table and an
+     empty journal. */
+  image_name = argv[optind];
+  image_fd = open (image_name, O_WRONLY | O_CREAT | O_EXCL, 0666);
+  if (image_fd < 0)
+    {
+      if (errno == EEXIST)
+        fail ("%s: already exists", image_name);
+      fail ("%s: %s", image_name, strerror (errno));
+    }
+  if (ftruncate (image_fd, (off_t) block_cnt * block_size) < 0)
+    fail ("%s: %s", image_name, strerror (errno));
+
+  /* Create the system files in the order do_format() does.  The
+     reference count file stays all zeros. */
+  map_bytes = bitmap_file_size (block_cnt);
+  free_map = xcalloc (map_bytes);
+  inode_map = xcalloc (bitmap_file_size (super.inode_cnt));
+  next_block = 0;
+  allocate_blocks (super.data_start);
+  free_map_start = create_inode (FREE_MAP_INODE, map_bytes, false);
+  inode_map_start = create_inode (INODE_MAP_INODE,
+                                  bitmap_file_size (super.inode_cnt),
+                                  false);
+  create_inode (REFCOUNT_INODE, block_cnt, false);
+
+  /* Copy the tree. */
+  root->inumber = ROOT_DIR_INODE;
+  next_inumber = REFCOUNT_INODE + 1;
+  number_tree (root);
+  copy_dir (root, ROOT_DIR_INODE);
+
+  /* Now that every block and inode is allocated, write the maps,
+     and finally the superblock, marked clean so that the kernel
+     trusts its free counts.  Everything allocated is below the
+     hints. */
+  write_at ((uint64_t) free_map_start * block_size, free_map, map_bytes);
+  write_at ((uint64_t) inode_map_start * block_size, inode_map,
+            bitmap_file_size (super.inode_cnt));
+  super.clean = 1;
+  super.free_blocks = block_cnt - next_block;
+  super.free_inodes = super.inode_cnt - next_inumber;
+  super.block_hint = next_block;
+  super.inode_hint = next_inumber;
+  write_at ((uint64_t) SUPER_BLOCK * block_size, &super, sizeof super);
+  if (close (image_fd) < 0)
+    fail ("%s: %s", image_name, strerror (errno));
+
+  printf ("%s: %zu files and %zu directories in %"PRIu32" of %"PRIu32
+          " %"PRIu32"-byte blocks\n", image_name, file_cnt, dir_cnt,
+          next_block, block_cnt, block_size);
+  return EXIT_SUCCESS;
+}